@@ -0,0 +1,113 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include <time.h>
+
+#include "host.h"
+
+#include "../src/clock.h"
+
+/*
+ * The src/clock.c interface over CLOCK_MONOTONIC. The cycle counter
+ * counts at the 64 MHz of the nRF9160 core, so that the cycle figures
+ * the application reports keep their unit.
+ *
+ * The tests move the time forward with host_clock_advance(), to run
+ * minutes of radio timers in a moment. The clock and the timed waits
+ * of the kernel see the jump; the cycle counter does not, it measures
+ * the CPU time.
+ */
+
+#define	HOST_CPU_MHZ	64
+
+static uint64_t clock_base;
+static uint64_t cycles_base;
+static uint64_t clock_skew;	/* ns, see host_clock_advance() */
+
+static uint64_t
+clock_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+uint64_t
+host_clock_ns(void)
+{
+
+	return (clock_ns() + __atomic_load_n(&clock_skew, __ATOMIC_SEQ_CST));
+}
+
+void
+host_clock_advance(uint32_t ms)
+{
+
+	__atomic_add_fetch(&clock_skew, (uint64_t)ms * 1000000,
+	    __ATOMIC_SEQ_CST);
+	host_kernel_wakeup();
+}
+
+uint64_t
+clock_usec(void)
+{
+
+	return ((host_clock_ns() - clock_base) / 1000);
+}
+
+uint32_t
+clock_ms(void)
+{
+
+	return ((host_clock_ns() - clock_base) / 1000000);
+}
+
+uint32_t
+clock_cycles(void)
+{
+
+	return ((clock_ns() - cycles_base) * HOST_CPU_MHZ / 1000);
+}
+
+void
+clock_cycles_start(void)
+{
+
+	cycles_base = clock_ns();
+}
+
+void
+clock_init(void)
+{
+
+	clock_cycles_start();
+	clock_base = host_clock_ns();
+}
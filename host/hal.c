@@ -0,0 +1,510 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+#include <dev/gpio/gpio.h>
+#include <dev/intc/intc.h>
+#include <dev/mc6470/mc6470.h>
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+
+#include <math.h>
+
+#include "host.h"
+
+#include "../src/antenna.h"
+#include "../src/bench.h"
+#include "../src/board.h"
+#include "../src/disk.h"
+#include "../src/mtrace.h"
+#include "../src/prof.h"
+
+/*
+ * The board as seen by src/: the devices it looks up, the GPIO and
+ * interrupt controllers, and an MC6470 that answers on the I2C bus.
+ */
+
+#define	HOST_NGPIOTE	8
+#define	HOST_NGPIO	32
+#define	HOST_NIRQ	64
+#define	HOST_NSTATE	8
+#define	HOST_STATE_SIZE	128
+#define	MC6470_ACC_1G	4096	/* LSB per g, 2g range */
+#define	MC6470_MAG_H	300	/* Horizontal field, LSB */
+
+/* Hard-iron bias of the board, as calibrated in sensor_init(). */
+static const int16_t mc6470_bias[3] = { 228, -859, 274 };
+
+static struct mdx_device host_devs[] = {
+	{ "nrf_gpio", 0, NULL },
+	{ "nrf_gpiote", 0, NULL },
+	{ "nrf_twim", 0, NULL },
+	{ "nrf_uarte", 0, NULL },
+	{ "nrf_timer", 1, NULL },
+	{ "nvic", 0, NULL },
+};
+
+static int host_gpio[HOST_NGPIO];
+static uint32_t host_nmisroutes;
+
+static struct gpiote_cfg {
+	void	(*handler)(void *arg, int irq);
+	void	*arg;
+	bool	enabled;
+} gpiote_cfg[HOST_NGPIOTE];
+
+static struct intc_irq {
+	void	(*handler)(void *arg, int irq);
+	void	*arg;
+} intc_irq[HOST_NIRQ];
+
+static struct host_state {
+	char		name[16];
+	uint8_t		buf[HOST_STATE_SIZE];
+	uint32_t	size;
+} host_state[HOST_NSTATE];
+static uint32_t host_state_nwrites;
+
+static uint8_t mc6470_acc[256];
+static uint8_t mc6470_mag[256];
+static uint32_t mc6470_sample;
+static double mc6470_pitch;
+static double mc6470_roll;
+
+mdx_device_t
+mdx_device_lookup_by_name(const char *name, int unit)
+{
+	int i;
+
+	for (i = 0; i < nitems(host_devs); i++)
+		if (host_devs[i].unit == unit &&
+		    strcmp(host_devs[i].name, name) == 0)
+			return (&host_devs[i]);
+
+	return (NULL);
+}
+
+mdx_device_t
+board_device(const char *name, int unit)
+{
+
+	return (mdx_device_lookup_by_name(name, unit));
+}
+
+void
+nrf_gpio_pincfg(mdx_device_t dev, int pin, int cfg)
+{
+
+}
+
+int
+mdx_gpio_configure(mdx_device_t dev, int pin, int flags)
+{
+
+	return (0);
+}
+
+int
+mdx_gpio_set(mdx_device_t dev, int pin, int value)
+{
+
+	if (pin >= 0 && pin < HOST_NGPIO)
+		host_gpio[pin] = value;
+
+	/* The antenna must stay on LTE through a probe. */
+	if (pin == PIN_SW3_CTL && value != 0 && antenna_lte_probing())
+		host_nmisroutes++;
+
+	return (0);
+}
+
+int
+mdx_gpio_get(mdx_device_t dev, int pin)
+{
+
+	if (pin >= 0 && pin < HOST_NGPIO)
+		return (host_gpio[pin]);
+
+	return (0);
+}
+
+void
+nrf_gpiote_config(mdx_device_t dev, int cfg_id, struct nrf_gpiote_conf *conf)
+{
+
+}
+
+void
+nrf_gpiote_setup_intr(mdx_device_t dev, int cfg_id,
+    void (*handler)(void *arg, int irq), void *arg)
+{
+
+	gpiote_cfg[cfg_id].handler = handler;
+	gpiote_cfg[cfg_id].arg = arg;
+}
+
+void
+nrf_gpiote_intctl(mdx_device_t dev, int cfg_id, bool enable)
+{
+
+	gpiote_cfg[cfg_id].enabled = enable;
+}
+
+/*
+ * Raise the GPIOTE event as the pin would. The handler runs under the
+ * critical section lock, like an interrupt handler on the board.
+ */
+void
+host_gpiote_fire(int cfg_id)
+{
+	struct gpiote_cfg *cfg;
+
+	cfg = &gpiote_cfg[cfg_id];
+	if (!cfg->enabled || cfg->handler == NULL)
+		return;
+
+	critical_enter();
+	cfg->handler(cfg->arg, cfg_id);
+	critical_exit();
+}
+
+void
+nrf_nvmc_icache_control(mdx_device_t dev, bool enable)
+{
+
+}
+
+void
+nrf_uarte_register_callback(mdx_device_t dev,
+    void (*func)(int c, void *arg), void *arg)
+{
+
+}
+
+void
+mdx_intc_setup(mdx_device_t dev, int irq,
+    void (*handler)(void *arg, int irq), void *arg)
+{
+
+	intc_irq[irq].handler = handler;
+	intc_irq[irq].arg = arg;
+}
+
+void
+mdx_intc_set_prio(mdx_device_t dev, int irq, int prio)
+{
+
+}
+
+void
+mdx_intc_enable(mdx_device_t dev, int irq)
+{
+
+}
+
+void
+mdx_intc_disable(mdx_device_t dev, int irq)
+{
+
+}
+
+void
+mdx_intc_set(mdx_device_t dev, int irq)
+{
+
+}
+
+void
+mdx_intc_clear(mdx_device_t dev, int irq)
+{
+
+}
+
+/*
+ * Raise an NVIC interrupt, under the critical section lock like
+ * host_gpiote_fire().
+ */
+void
+host_intc_fire(int irq)
+{
+	struct intc_irq *ii;
+
+	ii = &intc_irq[irq];
+	if (ii->handler == NULL)
+		return;
+
+	critical_enter();
+	ii->handler(ii->arg, irq);
+	critical_exit();
+}
+
+/*
+ * The modem trace sink needs the UART and the flash, it is not built
+ * here either.
+ */
+void
+mtrace_put(const uint8_t *buf, uint32_t len)
+{
+
+}
+
+/*
+ * The PC sampler reads the exception frame and the benchmarks time
+ * the flash and the RAM functions of the target. The host benchmarks
+ * are in main.c.
+ */
+int
+prof_start(uint32_t hz)
+{
+
+	return (-1);
+}
+
+void
+prof_stop(void)
+{
+
+}
+
+void
+prof_reset(void)
+{
+
+}
+
+void
+prof_dump(void)
+{
+
+}
+
+void
+bench_ramfunc(void)
+{
+
+}
+
+void
+bench_suite(void)
+{
+
+}
+
+/*
+ * The run-time state page of disk.c, in RAM. Identical records are
+ * not written again, as on the board; host_state_writes() counts the
+ * others.
+ */
+int
+load_state(const char *name, void *buf, uint32_t size)
+{
+	struct host_state *st;
+	int i;
+
+	for (i = 0; i < HOST_NSTATE; i++) {
+		st = &host_state[i];
+		if (strcmp(st->name, name) == 0 && st->size == size) {
+			memcpy(buf, st->buf, size);
+			return (0);
+		}
+	}
+
+	return (-1);
+}
+
+int
+save_state(const char *name, const void *buf, uint32_t size)
+{
+	struct host_state *st;
+	int i;
+
+	if (size > HOST_STATE_SIZE)
+		return (-1);
+
+	for (i = 0; i < HOST_NSTATE; i++) {
+		st = &host_state[i];
+		if (strcmp(st->name, name) == 0 || st->name[0] == '\0')
+			break;
+	}
+	if (i == HOST_NSTATE)
+		return (-1);
+
+	if (st->size == size && memcmp(st->buf, buf, size) == 0)
+		return (0);
+
+	snprintf(st->name, sizeof(st->name), "%s", name);
+	memcpy(st->buf, buf, size);
+	st->size = size;
+	host_state_nwrites++;
+
+	return (0);
+}
+
+uint32_t
+host_state_writes(void)
+{
+
+	return (host_state_nwrites);
+}
+
+/*
+ * The times SW3 routed the onboard antenna to GNSS during an LTE
+ * antenna probe.
+ */
+uint32_t
+host_misroutes(void)
+{
+
+	return (host_nmisroutes);
+}
+
+static void
+mc6470_put16(uint8_t *regs, int reg, int16_t val)
+{
+
+	regs[reg] = val & 0xff;
+	regs[reg + 1] = (val >> 8) & 0xff;
+}
+
+/*
+ * Latch a new sample into the output registers: gravity for the
+ * configured tilt and a horizontal field that turns by a degree per
+ * sample, so that the azimuth sweeps the full circle. The field is
+ * clean once sensor_init() has programmed the offsets.
+ */
+static void
+mc6470_latch(void)
+{
+	double heading;
+	int16_t mag[3];
+	int16_t off;
+	int i;
+
+	mc6470_put16(mc6470_acc, MC6470_XOUT_EX_L,
+	    -sin(mc6470_pitch) * MC6470_ACC_1G);
+	mc6470_put16(mc6470_acc, MC6470_XOUT_EX_L + 2,
+	    sin(mc6470_roll) * cos(mc6470_pitch) * MC6470_ACC_1G);
+	mc6470_put16(mc6470_acc, MC6470_XOUT_EX_L + 4,
+	    cos(mc6470_roll) * cos(mc6470_pitch) * MC6470_ACC_1G);
+
+	heading = (mc6470_sample++ % 360) * M_PI / 180;
+	mag[0] = cos(heading) * MC6470_MAG_H + mc6470_bias[0];
+	mag[1] = -sin(heading) * MC6470_MAG_H + mc6470_bias[1];
+	mag[2] = mc6470_bias[2];
+
+	/* The offset registers are subtracted by the device. */
+	for (i = 0; i < 3; i++) {
+		off = mc6470_mag[MC6470_MAG_XOFFL + i * 2] |
+		    mc6470_mag[MC6470_MAG_XOFFH + i * 2] << 8;
+		mc6470_put16(mc6470_mag, MC6470_MAG_XOUTL + i * 2,
+		    mag[i] - off);
+	}
+}
+
+static uint8_t *
+mc6470_regs(uint8_t addr)
+{
+
+	switch (addr) {
+	case MC6470_ACC:
+		return (mc6470_acc);
+	case MC6470_MAG:
+		return (mc6470_mag);
+	}
+
+	return (NULL);
+}
+
+int
+mc6470_read_reg(mdx_device_t dev, uint8_t addr, uint8_t reg, uint8_t *val)
+{
+
+	return (mc6470_read_data(dev, addr, reg, 1, val));
+}
+
+int
+mc6470_write_reg(mdx_device_t dev, uint8_t addr, uint8_t reg, uint8_t val)
+{
+	uint8_t *regs;
+
+	regs = mc6470_regs(addr);
+	if (regs == NULL)
+		return (-1);
+
+	/* The calibration bits clear themselves. */
+	if (addr == MC6470_MAG && reg == MC6470_MAG_CTRL3)
+		val &= ~MAG_CTRL3_OCL;
+
+	critical_enter();
+	regs[reg] = val;
+	critical_exit();
+
+	return (0);
+}
+
+int
+mc6470_read_data(mdx_device_t dev, uint8_t addr, uint8_t reg, int len,
+    uint8_t *buf)
+{
+	uint8_t *regs;
+
+	regs = mc6470_regs(addr);
+	if (regs == NULL || reg + len > 256)
+		return (-1);
+
+	/* The bus transfers are serialized, as on the TWIM. */
+	critical_enter();
+	if (addr == MC6470_MAG && reg == MC6470_MAG_XOUTL)
+		mc6470_latch();
+
+	memcpy(buf, &regs[reg], len);
+
+	/* The tap status is cleared on read. */
+	if (addr == MC6470_ACC && reg == MC6470_SR)
+		regs[MC6470_SR] = 0;
+	critical_exit();
+
+	return (0);
+}
+
+void
+host_mc6470_set_tilt(int pitch, int roll)
+{
+
+	mc6470_pitch = pitch * M_PI / 180;
+	mc6470_roll = roll * M_PI / 180;
+}
+
+void
+host_hal_init(void)
+{
+
+	mc6470_mag[MC6470_MAG_CTRL1] = MAG_CTRL1_PC | MAG_CTRL1_FS;
+	mc6470_acc[MC6470_MODE] = MODE_OPCON_WAKE;
+	mc6470_latch();
+}
@@ -0,0 +1,65 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _HOST_HOST_H_
+#define	_HOST_HOST_H_
+
+/* clock.c */
+uint64_t host_clock_ns(void);
+void host_clock_advance(uint32_t ms);
+
+/* kernel.c */
+void host_kernel_init(void);
+void host_kernel_wakeup(void);
+void host_run(const char *name, uint32_t stack_size,
+    void (*entry)(void *), void *arg);
+
+/* hal.c */
+void host_hal_init(void);
+void host_gpiote_fire(int cfg_id);
+void host_intc_fire(int irq);
+void host_mc6470_set_tilt(int pitch, int roll);
+uint32_t host_state_writes(void);
+uint32_t host_misroutes(void);
+
+/* malloc.c */
+void host_malloc_holes(const uint32_t *sizes, int n);
+uint32_t host_malloc_real(void);
+
+/* modem.c */
+void host_modem_init(void);
+void host_modem_gnss_frames(int nframes);
+void host_modem_rpc(uint32_t context);
+int host_modem_rpc_take(uint32_t context);
+int host_modem_traffic(void);
+int host_modem_gnss_window(void);
+void host_modem_rsrp(int rsrp);
+void host_modem_coverage(int on);
+
+/* test.c */
+int host_test(const char *name);
+
+#endif /* !_HOST_HOST_H_ */
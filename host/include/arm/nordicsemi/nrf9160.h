@@ -0,0 +1,62 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _HOST_ARM_NORDICSEMI_NRF9160_H_
+#define	_HOST_ARM_NORDICSEMI_NRF9160_H_
+
+#include <sys/cdefs.h>
+
+#define	ID_TIMER1	16
+#define	ID_RTC1		21
+#define	ID_EGU1		28
+#define	ID_EGU2		29
+#define	ID_EGU3		30
+#define	ID_IPC		42
+
+#define	CNF_DIR_OUT	(1 << 0)
+#define	CNF_INPUT_DIS	(1 << 1)
+#define	CNF_PULL_DOWN	(1 << 2)
+
+#define	GPIOTE_MODE_EVENT	1
+#define	GPIOTE_POLARITY_HITOLO	2
+
+struct nrf_gpiote_conf {
+	int	pol;
+	int	mode;
+	int	pin;
+};
+
+void nrf_gpio_pincfg(mdx_device_t dev, int pin, int cfg);
+void nrf_gpiote_config(mdx_device_t dev, int cfg_id,
+    struct nrf_gpiote_conf *conf);
+void nrf_gpiote_setup_intr(mdx_device_t dev, int cfg_id,
+    void (*handler)(void *arg, int irq), void *arg);
+void nrf_gpiote_intctl(mdx_device_t dev, int cfg_id, bool enable);
+void nrf_nvmc_icache_control(mdx_device_t dev, bool enable);
+void nrf_uarte_register_callback(mdx_device_t dev,
+    void (*func)(int c, void *arg), void *arg);
+
+#endif /* !_HOST_ARM_NORDICSEMI_NRF9160_H_ */
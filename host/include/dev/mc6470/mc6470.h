@@ -0,0 +1,87 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * MC6470 6-axis eCompass, simulated by host/hal.c. The register map is
+ * the one of the device: an MC3610-style accelerometer and a magnetometer
+ * on separate I2C addresses.
+ */
+
+#ifndef _HOST_DEV_MC6470_MC6470_H_
+#define	_HOST_DEV_MC6470_MC6470_H_
+
+#include <sys/cdefs.h>
+
+#define	MC6470_ACC		0x4c	/* I2C addresses */
+#define	MC6470_MAG		0x0c
+
+/* Accelerometer */
+#define	MC6470_SR		0x03
+#define	MC6470_OPSTAT		0x04
+#define	MC6470_INTEN		0x06
+#define	 INTEN_TIXPEN		(1 << 0)
+#define	 INTEN_TIXNEN		(1 << 1)
+#define	MC6470_MODE		0x07
+#define	 MODE_OPCON_STANDBY	0x00
+#define	 MODE_OPCON_WAKE	0x01
+#define	MC6470_SRTFR		0x08
+#define	 SRTFR_RATE_64HZ	0x00
+#define	MC6470_TAPEN		0x09
+#define	 TAPEN_TAPXPEN		(1 << 0)
+#define	 TAPEN_TAPXNEN		(1 << 1)
+#define	 TAPEN_THRDUR		(1 << 6)
+#define	 TAPEN_TAP_EN		(1 << 7)
+#define	MC6470_TTTRX		0x0a
+#define	MC6470_TTTRY		0x0b
+#define	MC6470_TTTRZ		0x0c
+#define	MC6470_XOUT_EX_L	0x0d	/* X, Y, Z, 16 bits each */
+#define	MC6470_OUTCFG		0x20
+#define	 OUTCFG_RANGE_2G	0x00
+
+/* Magnetometer */
+#define	MC6470_MAG_XOUTL	0x10	/* X, Y, Z, 16 bits each */
+#define	MC6470_MAG_CTRL1	0x1b
+#define	 MAG_CTRL1_FS		(1 << 1)
+#define	 MAG_CTRL1_PC		(1 << 7)
+#define	MC6470_MAG_CTRL3	0x1d
+#define	 MAG_CTRL3_OCL		(1 << 0)
+#define	MC6470_MAG_CTRL4	0x1e
+#define	 MAG_CTRL4_RS		(1 << 4)
+#define	MC6470_MAG_XOFFL	0x20
+#define	MC6470_MAG_XOFFH	0x21
+#define	MC6470_MAG_YOFFL	0x22
+#define	MC6470_MAG_YOFFH	0x23
+#define	MC6470_MAG_ZOFFL	0x24
+#define	MC6470_MAG_ZOFFH	0x25
+
+int mc6470_read_reg(mdx_device_t dev, uint8_t addr, uint8_t reg,
+    uint8_t *val);
+int mc6470_write_reg(mdx_device_t dev, uint8_t addr, uint8_t reg,
+    uint8_t val);
+int mc6470_read_data(mdx_device_t dev, uint8_t addr, uint8_t reg,
+    int len, uint8_t *buf);
+
+#endif /* !_HOST_DEV_MC6470_MC6470_H_ */
@@ -0,0 +1,109 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Host build: the subset of the mdepx kernel interface used by src/,
+ * implemented over POSIX in host/kernel.c.
+ */
+
+#ifndef _HOST_SYS_CDEFS_H_
+#define	_HOST_SYS_CDEFS_H_
+
+#include_next <sys/cdefs.h>
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#ifndef __unused
+#define	__unused	__attribute__((__unused__))
+#endif
+#define	__aligned(x)	__attribute__((__aligned__(x)))
+#define	__packed	__attribute__((__packed__))
+#define	__section(x)	__attribute__((__section__(x)))
+
+#define	nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+
+#define	CONTAINER_OF(ptr, type, member)					\
+	((type *)((char *)(ptr) - offsetof(type, member)))
+
+struct entry {
+	struct entry	*next;
+	struct entry	*prev;
+};
+
+static inline void
+list_init(struct entry *head)
+{
+
+	head->next = head;
+	head->prev = head;
+}
+
+static inline int
+list_empty(struct entry *head)
+{
+
+	return (head->next == head);
+}
+
+static inline void
+list_append(struct entry *head, struct entry *e)
+{
+
+	e->prev = head->prev;
+	e->next = head;
+	head->prev->next = e;
+	head->prev = e;
+}
+
+static inline void
+list_remove(struct entry *e)
+{
+
+	e->prev->next = e->next;
+	e->next->prev = e->prev;
+}
+
+struct mdx_device {
+	const char	*name;
+	int		unit;
+	void		*sc;
+};
+
+typedef struct mdx_device * mdx_device_t;
+
+void critical_enter(void);
+void critical_exit(void);
+void panic(const char *fmt, ...) __attribute__((__noreturn__));
+
+mdx_device_t mdx_device_lookup_by_name(const char *name, int unit);
+
+#endif /* !_HOST_SYS_CDEFS_H_ */
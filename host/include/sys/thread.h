@@ -0,0 +1,59 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _HOST_SYS_THREAD_H_
+#define	_HOST_SYS_THREAD_H_
+
+#include <sys/cdefs.h>
+
+#include <pthread.h>
+
+/*
+ * The threads run on a stack allocated here, so that src/stack.c can
+ * paint and scan it. Its size is the firmware one scaled up, as libc
+ * on the host needs far more than the firmware does.
+ */
+struct thread {
+	const char	*td_name;
+	uint8_t		*td_stack;
+	uint32_t	td_stack_size;
+	void		*td_tf;		/* Top of the unused stack */
+	int		td_prio;
+	void		(*td_entry)(void *);
+	void		*td_arg;
+	pthread_t	td_pthread;
+};
+
+struct thread *mdx_thread_create(const char *name, int prio,
+    uint32_t quantum, uint32_t stack_size, void (*entry)(void *), void *arg);
+void mdx_sched_add(struct thread *td);
+void mdx_usleep(uint32_t usec);
+void mdx_thread_yield(void);
+struct thread *mdx_thread_self(void);
+
+#define	curthread	mdx_thread_self()
+
+#endif /* !_HOST_SYS_THREAD_H_ */
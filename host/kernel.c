@@ -0,0 +1,348 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+#include <sys/mutex.h>
+
+#include <stdarg.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+
+/*
+ * The mdepx kernel primitives over pthreads.
+ *
+ * critical_enter() stops the interrupts on the board. Here it takes a
+ * recursive lock that the simulated interrupt handlers take as well,
+ * so the sections are still atomic with respect to them and to each
+ * other.
+ *
+ * The timeouts run on the clock of clock.c. The threads in a timed
+ * wait are listed, so that host_clock_advance() can wake them up to
+ * check their timeout again.
+ */
+
+#define	HOST_STACK_SCALE	16
+#define	HOST_STACK_MIN		(64 * 1024)
+
+struct host_sleeper {
+	mdx_sem_t		*sem;
+	struct host_sleeper	*next;
+};
+
+static pthread_mutex_t giant;
+static pthread_mutex_t sleepers_mtx = PTHREAD_MUTEX_INITIALIZER;
+static struct host_sleeper *sleepers;
+static __thread struct thread *host_td;
+
+void
+critical_enter(void)
+{
+
+	pthread_mutex_lock(&giant);
+}
+
+void
+critical_exit(void)
+{
+
+	pthread_mutex_unlock(&giant);
+}
+
+void
+panic(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	fprintf(stderr, "panic: ");
+	vfprintf(stderr, fmt, ap);
+	fprintf(stderr, "\n");
+	va_end(ap);
+
+	abort();
+}
+
+void
+mdx_sem_init(mdx_sem_t *sem, int count)
+{
+	pthread_condattr_t attr;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&sem->cv, &attr);
+	pthread_condattr_destroy(&attr);
+	pthread_mutex_init(&sem->mtx, NULL);
+	sem->count = count;
+}
+
+void
+mdx_sem_post(mdx_sem_t *sem)
+{
+
+	pthread_mutex_lock(&sem->mtx);
+	sem->count++;
+	pthread_cond_signal(&sem->cv);
+	pthread_mutex_unlock(&sem->mtx);
+}
+
+void
+mdx_sem_wait(mdx_sem_t *sem)
+{
+
+	pthread_mutex_lock(&sem->mtx);
+	while (sem->count == 0)
+		pthread_cond_wait(&sem->cv, &sem->mtx);
+	sem->count--;
+	pthread_mutex_unlock(&sem->mtx);
+}
+
+int
+mdx_sem_trywait(mdx_sem_t *sem)
+{
+	int ret;
+
+	ret = 0;
+	pthread_mutex_lock(&sem->mtx);
+	if (sem->count > 0) {
+		sem->count--;
+		ret = 1;
+	}
+	pthread_mutex_unlock(&sem->mtx);
+
+	return (ret);
+}
+
+static void
+host_sleeper_add(struct host_sleeper *sl, mdx_sem_t *sem)
+{
+
+	sl->sem = sem;
+	pthread_mutex_lock(&sleepers_mtx);
+	sl->next = sleepers;
+	sleepers = sl;
+	pthread_mutex_unlock(&sleepers_mtx);
+}
+
+static void
+host_sleeper_remove(struct host_sleeper *sl)
+{
+	struct host_sleeper **p;
+
+	pthread_mutex_lock(&sleepers_mtx);
+	for (p = &sleepers; *p != sl; p = &(*p)->next)
+		;
+	*p = sl->next;
+	pthread_mutex_unlock(&sleepers_mtx);
+}
+
+/*
+ * The time has moved, wake up the timed waits.
+ */
+void
+host_kernel_wakeup(void)
+{
+	struct host_sleeper *sl;
+
+	pthread_mutex_lock(&sleepers_mtx);
+	for (sl = sleepers; sl != NULL; sl = sl->next) {
+		pthread_mutex_lock(&sl->sem->mtx);
+		pthread_cond_broadcast(&sl->sem->cv);
+		pthread_mutex_unlock(&sl->sem->mtx);
+	}
+	pthread_mutex_unlock(&sleepers_mtx);
+}
+
+/*
+ * Returns 1 if the semaphore was taken, 0 on timeout.
+ */
+int
+mdx_sem_timedwait(mdx_sem_t *sem, uint32_t usec)
+{
+	struct host_sleeper sl;
+	struct timespec ts;
+	uint64_t deadline;
+	uint64_t now;
+	uint64_t left;
+	int ret;
+
+	deadline = host_clock_ns() + (uint64_t)usec * 1000;
+
+	host_sleeper_add(&sl, sem);
+	pthread_mutex_lock(&sem->mtx);
+	while (sem->count == 0) {
+		now = host_clock_ns();
+		if (now >= deadline)
+			break;
+		left = deadline - now;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		ts.tv_sec += left / 1000000000;
+		ts.tv_nsec += left % 1000000000;
+		if (ts.tv_nsec >= 1000000000) {
+			ts.tv_sec++;
+			ts.tv_nsec -= 1000000000;
+		}
+		pthread_cond_timedwait(&sem->cv, &sem->mtx, &ts);
+	}
+	if (sem->count > 0) {
+		sem->count--;
+		ret = 1;
+	} else
+		ret = 0;
+	pthread_mutex_unlock(&sem->mtx);
+	host_sleeper_remove(&sl);
+
+	return (ret);
+}
+
+void
+mdx_mutex_init(struct mdx_mutex *m)
+{
+
+	pthread_mutex_init(&m->mtx, NULL);
+}
+
+void
+mdx_mutex_lock(struct mdx_mutex *m)
+{
+
+	pthread_mutex_lock(&m->mtx);
+}
+
+void
+mdx_mutex_unlock(struct mdx_mutex *m)
+{
+
+	pthread_mutex_unlock(&m->mtx);
+}
+
+struct thread *
+mdx_thread_create(const char *name, int prio, uint32_t quantum,
+    uint32_t stack_size, void (*entry)(void *), void *arg)
+{
+	struct thread *td;
+	size_t size;
+
+	size = (size_t)stack_size * HOST_STACK_SCALE;
+	if (size < HOST_STACK_MIN)
+		size = HOST_STACK_MIN;
+
+	td = calloc(1, sizeof(struct thread));
+	if (td == NULL)
+		return (NULL);
+	if (posix_memalign((void **)&td->td_stack, 4096, size) != 0) {
+		free(td);
+		return (NULL);
+	}
+
+	td->td_name = name;
+	td->td_stack_size = size;
+	td->td_tf = td->td_stack + size;
+	td->td_prio = prio;
+	td->td_entry = entry;
+	td->td_arg = arg;
+
+	return (td);
+}
+
+static void *
+host_thread_start(void *arg)
+{
+	struct thread *td;
+
+	td = arg;
+	host_td = td;
+	td->td_entry(td->td_arg);
+
+	return (NULL);
+}
+
+void
+mdx_sched_add(struct thread *td)
+{
+	pthread_attr_t attr;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setstack(&attr, td->td_stack, td->td_stack_size);
+	if (pthread_create(&td->td_pthread, &attr, host_thread_start, td))
+		panic("can't start thread %s", td->td_name);
+	pthread_attr_destroy(&attr);
+}
+
+struct thread *
+mdx_thread_self(void)
+{
+
+	return (host_td);
+}
+
+void
+mdx_usleep(uint32_t usec)
+{
+	mdx_sem_t sem;
+
+	mdx_sem_init(&sem, 0);
+	mdx_sem_timedwait(&sem, usec);
+}
+
+void
+mdx_thread_yield(void)
+{
+
+	sched_yield();
+}
+
+/*
+ * Run the entry on a thread of its own, so that it has a struct thread
+ * like the mdepx main thread, and wait for it.
+ */
+void
+host_run(const char *name, uint32_t stack_size, void (*entry)(void *),
+    void *arg)
+{
+	struct thread *td;
+
+	td = mdx_thread_create(name, 1, 0, stack_size, entry, arg);
+	if (td == NULL)
+		panic("can't create thread %s", name);
+	mdx_sched_add(td);
+	pthread_join(td->td_pthread, NULL);
+}
+
+void
+host_kernel_init(void)
+{
+	pthread_mutexattr_t attr;
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&giant, &attr);
+	pthread_mutexattr_destroy(&attr);
+}
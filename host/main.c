@@ -0,0 +1,415 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include <nrfxlib/bsdlib/include/bsd_os.h>
+
+#include <time.h>
+#include <unistd.h>
+
+#include "host.h"
+
+#include "../src/app.h"
+#include "../src/at.h"
+#include "../src/board.h"
+#include "../src/clock.h"
+#include "../src/cpu.h"
+#include "../src/energy.h"
+#include "../src/gps.h"
+#include "../src/heap.h"
+#include "../src/log.h"
+#include "../src/metrics.h"
+#include "../src/sensor.h"
+#include "../src/stack.h"
+#include "../src/workq.h"
+
+/*
+ * Native driver for the application logic: brings up the same
+ * services as src/main.c over the host kernel and simulated devices,
+ * then runs each benchmark and prints one line per benchmark to
+ * stderr:
+ *
+ *	bench <name> <iterations> <ns per iteration>
+ *
+ * The application's own output goes to stdout, -q discards it.
+ *
+ * With -e the benchmarks are skipped and the energy model replays a
+ * script instead, one event per line, times in ms from the start:
+ *
+ *	current <state> <uA>	set the current of a state
+ *	<ms> <state>		enter a state, e.g. "1000 lte_connected"
+ *	<ms> msg		a message was published
+ *	<ms> cpu <busy ms>	CPU busy time since the start
+ *	<ms> end		end of the run, print the report
+ *
+ * The scripts of energy/ are replayed by "make energy", which compares
+ * the reports with the expected ones next to them. The exit status is
+ * 1 if a script can't be replayed.
+ *
+ * With -T the unit tests of test.c run instead, and the argument names
+ * a test rather than a benchmark. The exit status is 1 if one fails.
+ *
+ * The bsd_os benchmark prints one more line, the wakeups of the
+ * threads waiting in bsd_os_timedwait() that found no event of their
+ * own:
+ *
+ *	bsd_os <events> <wakeups> <spurious> <spurious per second>
+ */
+
+#define	BSD_BENCH_NTD		3	/* GNSS, AT and MQTT sockets */
+#define	BSD_BENCH_WAIT_MS	10
+
+struct host_bench {
+	const char	*name;
+	void		(*fn)(int n);
+};
+
+static int iterations = 1000;
+static mdx_sem_t bsd_bench_sem;
+static uint32_t bsd_bench_wakeups;
+static uint32_t bsd_bench_spurious;
+static int bsd_bench_stop;
+static int sensor_enable;
+static const char *energy_script;
+static int test_mode;
+static int host_status;
+
+static uint64_t
+host_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void
+bench_ecompass(int n)
+{
+	struct ecompass_data data;
+	int i;
+
+	for (i = 0; i < n; i++)
+		mc6470_process(&data);
+}
+
+static void
+bench_app(int n)
+{
+	char *str;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		str = app1();
+		app_release(str);
+	}
+}
+
+static void
+bench_at_parse(int n)
+{
+	static const char *resp[] = {
+		"OK\r\n",
+		"+CESQ: 99,99,255,255,22,58\r\nOK\r\n",
+		"+CEREG: 5,\"0A0B\",\"01020304\",7\r\n",
+		"ERROR\r\n",
+		"+CME ERROR: 514\r\n",
+	};
+	int bodylen;
+	int error;
+	int i;
+
+	for (i = 0; i < n; i++)
+		at_parse(resp[i % nitems(resp)], &error, &bodylen);
+}
+
+static void
+bench_at_cmd(int n)
+{
+	char buf[64];
+	int i;
+
+	for (i = 0; i < n; i++)
+		at_cmd("AT+CESQ", buf, sizeof(buf));
+}
+
+static void
+bench_gps(int n)
+{
+
+	host_modem_gnss_frames(n);
+	if (gps_init() == 0)
+		gps_test();
+}
+
+/*
+ * A socket thread of bsdlib: waits for the events of its context and
+ * reports each one to bench_bsd_os().
+ */
+static void
+bsd_bench_thread(void *arg)
+{
+	uint32_t context;
+	int32_t tmout;
+	int woken;
+	int event;
+
+	context = (uintptr_t)arg;
+
+	while (!bsd_bench_stop) {
+		tmout = BSD_BENCH_WAIT_MS;
+		woken = bsd_os_timedwait(context, &tmout) == 0;
+		event = host_modem_rpc_take(context);
+		if (woken) {
+			critical_enter();
+			bsd_bench_wakeups++;
+			if (!event)
+				bsd_bench_spurious++;
+			critical_exit();
+		}
+		if (event)
+			mdx_sem_post(&bsd_bench_sem);
+	}
+
+	mdx_sem_post(&bsd_bench_sem);
+}
+
+/*
+ * Deliver the events round-robin to the contexts, one at a time.
+ */
+static void
+bench_bsd_os(int n)
+{
+	struct thread *td;
+	uint64_t t0, t1;
+	int i;
+
+	mdx_sem_init(&bsd_bench_sem, 0);
+	bsd_bench_wakeups = bsd_bench_spurious = 0;
+	bsd_bench_stop = 0;
+
+	for (i = 0; i < BSD_BENCH_NTD; i++) {
+		td = mdx_thread_create("bsd", PRIO_NORMAL, 0, 4096,
+		    bsd_bench_thread, (void *)(uintptr_t)i);
+		if (td == NULL)
+			panic("can't create thread");
+		mdx_sched_add(td);
+	}
+
+	/* Let them all block before the first event. */
+	mdx_usleep(BSD_BENCH_WAIT_MS * 1000);
+
+	t0 = host_ns();
+	for (i = 0; i < n; i++) {
+		host_modem_rpc(i % BSD_BENCH_NTD);
+		mdx_sem_wait(&bsd_bench_sem);
+	}
+	t1 = host_ns();
+
+	bsd_bench_stop = 1;
+	for (i = 0; i < BSD_BENCH_NTD; i++)
+		mdx_sem_wait(&bsd_bench_sem);
+
+	fprintf(stderr, "bsd_os %d %u %u %llu\n", n, bsd_bench_wakeups,
+	    bsd_bench_spurious, (unsigned long long)bsd_bench_spurious *
+	    1000000000 / (t1 - t0));
+}
+
+static void
+host_energy(const char *path)
+{
+	char line[128];
+	char name[32];
+	uint32_t busy, now;
+	unsigned int ms, val;
+	int comp, state;
+	int lineno;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		host_status = 1;
+		return;
+	}
+
+	energy_reset(0);
+	busy = now = 0;
+
+	for (lineno = 1; fgets(line, sizeof(line), f) != NULL; lineno++) {
+		if (line[0] == '#' || line[0] == '\n')
+			continue;
+		if (sscanf(line, "current %31s %u", name, &val) == 2) {
+			if (energy_set_current(name, val) != 0)
+				break;
+			continue;
+		}
+		if (sscanf(line, "%u %31s %u", &ms, name, &val) < 2)
+			break;
+		now = ms;
+		if (strcmp(name, "end") == 0) {
+			energy_print(now, busy);
+			fclose(f);
+			return;
+		} else if (strcmp(name, "msg") == 0)
+			energy_message();
+		else if (strcmp(name, "cpu") == 0)
+			busy = val;
+		else if (energy_lookup(name, &comp, &state) == 0)
+			energy_set_at(comp, state, now);
+		else
+			break;
+	}
+
+	fprintf(stderr, "%s:%d: bad line\n", path, lineno);
+	host_status = 1;
+	fclose(f);
+}
+
+static const struct host_bench benches[] = {
+	{ "ecompass", bench_ecompass },
+	{ "app", bench_app },
+	{ "at_parse", bench_at_parse },
+	{ "at_cmd", bench_at_cmd },
+	{ "gps", bench_gps },
+	{ "bsd_os", bench_bsd_os },
+};
+
+static void
+host_main(void *arg)
+{
+	const char *name;
+	uint64_t t0, t1;
+	int i;
+
+	name = arg;
+
+	clock_init();
+	metrics_init();
+	log_init();
+	workq_init();
+	cpu_init();
+	heap_init();
+	stack_init();
+	stack_watch(curthread);
+
+	host_hal_init();
+	host_modem_init();
+	bsd_os_init();
+	at_init();
+	app_init();
+
+	/* Programs the MC6470 and takes one tap interrupt. */
+	if (sensor_enable) {
+		sensor_init();
+		host_gpiote_fire(MC6470_GPIOTE_CFG_ID);
+	}
+
+	if (energy_script != NULL) {
+		host_energy(energy_script);
+		return;
+	}
+
+	if (test_mode) {
+		if (host_test(name) != 0)
+			host_status = 1;
+		return;
+	}
+
+	for (i = 0; i < nitems(benches); i++) {
+		if (name != NULL && strcmp(name, benches[i].name) != 0)
+			continue;
+		t0 = host_ns();
+		benches[i].fn(iterations);
+		t1 = host_ns();
+		fprintf(stderr, "bench %s %d %llu\n", benches[i].name,
+		    iterations,
+		    (unsigned long long)((t1 - t0) / iterations));
+	}
+
+	fflush(stdout);
+	metrics_dump();
+}
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "usage: md009-host [-qsT] [-e script] "
+	    "[-n iterations] [-t pitch,roll] [benchmark]\n");
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	int pitch, roll;
+	int ch;
+
+	while ((ch = getopt(argc, argv, "e:n:qst:T")) != -1) {
+		switch (ch) {
+		case 'e':
+			energy_script = optarg;
+			break;
+		case 'n':
+			iterations = atoi(optarg);
+			if (iterations <= 0)
+				usage();
+			break;
+		case 'q':
+			if (freopen("/dev/null", "w", stdout) == NULL)
+				perror("/dev/null");
+			break;
+		case 's':
+			sensor_enable = 1;
+			break;
+		case 't':
+			if (sscanf(optarg, "%d,%d", &pitch, &roll) != 2)
+				usage();
+			host_mc6470_set_tilt(pitch, roll);
+			break;
+		case 'T':
+			test_mode = 1;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc > 1)
+		usage();
+
+	host_kernel_init();
+	host_run("main", 4096, host_main, argc ? argv[0] : NULL);
+
+	return (host_status);
+}
@@ -0,0 +1,170 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include "host.h"
+
+/*
+ * A malloc() shim for the tests. The application is linked with
+ * --wrap=malloc,--wrap=free, so its calls come here and normally go on
+ * to the C library. After host_malloc_holes() the calls of that thread
+ * are served from a set of holes of the given sizes instead, like a
+ * fragmented heap: a block is carved from the smallest hole it fits in
+ * and given back to it when freed. The holes do not merge.
+ */
+
+#define	HOST_NHOLES	64
+#define	HOST_NCHUNKS	64
+
+struct host_chunk {
+	void		*ptr;
+	uint32_t	size;
+	int		hole;
+};
+
+static uint32_t holes[HOST_NHOLES];
+static int nholes;
+static struct host_chunk chunks[HOST_NCHUNKS];
+static uint32_t shim_calls;
+static __thread int shim_on;
+
+void *__real_malloc(size_t size);
+void __real_free(void *ptr);
+void *__wrap_malloc(size_t size);
+void __wrap_free(void *ptr);
+
+static void *
+shim_malloc(size_t size)
+{
+	struct host_chunk *c;
+	int best;
+	int i;
+
+	shim_calls++;
+
+	best = -1;
+	for (i = 0; i < nholes; i++)
+		if (holes[i] >= size &&
+		    (best == -1 || holes[i] < holes[best]))
+			best = i;
+	if (best == -1)
+		return (NULL);
+
+	for (i = 0; i < HOST_NCHUNKS; i++)
+		if (chunks[i].ptr == NULL)
+			break;
+	if (i == HOST_NCHUNKS)
+		return (NULL);
+
+	c = &chunks[i];
+	c->ptr = __real_malloc(size ? size : 1);
+	if (c->ptr == NULL)
+		return (NULL);
+	c->size = size;
+	c->hole = best;
+	holes[best] -= size;
+
+	return (c->ptr);
+}
+
+static int
+shim_free(void *ptr)
+{
+	struct host_chunk *c;
+	int i;
+
+	for (i = 0; i < HOST_NCHUNKS; i++) {
+		c = &chunks[i];
+		if (c->ptr != ptr)
+			continue;
+		holes[c->hole] += c->size;
+		c->ptr = NULL;
+		__real_free(ptr);
+		return (1);
+	}
+
+	return (0);
+}
+
+void *
+__wrap_malloc(size_t size)
+{
+
+	if (shim_on)
+		return (shim_malloc(size));
+
+	return (__real_malloc(size));
+}
+
+void
+__wrap_free(void *ptr)
+{
+
+	if (ptr == NULL)
+		return;
+	if (shim_on && shim_free(ptr))
+		return;
+
+	__real_free(ptr);
+}
+
+/*
+ * Serve the calls of this thread from holes of the given sizes, until
+ * host_malloc_real().
+ */
+void
+host_malloc_holes(const uint32_t *sizes, int n)
+{
+	int i;
+
+	if (n > HOST_NHOLES)
+		panic("%s: %d holes", __func__, n);
+
+	for (i = 0; i < n; i++)
+		holes[i] = sizes[i];
+	nholes = n;
+	shim_calls = 0;
+	shim_on = 1;
+}
+
+/*
+ * Back to the C library. Returns the number of malloc() calls made in
+ * the holes.
+ */
+uint32_t
+host_malloc_real(void)
+{
+	int i;
+
+	for (i = 0; i < HOST_NCHUNKS; i++)
+		if (chunks[i].ptr != NULL)
+			panic("%s: %p not freed", __func__, chunks[i].ptr);
+	shim_on = 0;
+
+	return (shim_calls);
+}
@@ -0,0 +1,810 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/socket.h>
+#include <sys/sem.h>
+
+#include <errno.h>
+
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <nrfxlib/bsdlib/include/bsd_os.h>
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+
+#include "host.h"
+
+#include "../src/clock.h"
+
+/*
+ * The bsdlib socket interface for the host build.
+ *
+ * IP sockets are host sockets. The AT and GNSS sockets of the modem
+ * are one end of a socketpair; the other end is written by the
+ * simulated modem below, one packet per response, URC or GNSS frame,
+ * as the modem delivers them. SOCK_SEQPACKET keeps the boundaries and
+ * unlike a datagram socket ends the stream when the modem closes it.
+ *
+ * The LTE timing is simulated too, on the clock of clock.c. +CFUN
+ * switches the LTE part on and off, and the network registration is
+ * reported MODEM_ATTACH_MS later. Traffic, see host_modem_traffic(),
+ * sets up the RRC connection. The network releases it after
+ * MODEM_INACTIVITY_MS without traffic. The modem then stays reachable
+ * for the granted active time and sleeps in PSM until the next
+ * traffic. These transitions are reported with +CEREG, +CSCON and
+ * %XMODEMSLEEP. GNSS has the radio while LTE is off or asleep.
+ * Without coverage, see host_modem_coverage(), it does not register.
+ */
+
+#define	MODEM_NFDS		256
+
+#define	MODEM_SOCK_INET		1
+#define	MODEM_SOCK_AT		2
+#define	MODEM_SOCK_GNSS		3
+
+#define	MODEM_GNSS_FIX		5	/* First fix after this many */
+
+#define	MODEM_ATTACH_MS		2000
+#define	MODEM_INACTIVITY_MS	10000
+#define	MODEM_ACTIVE_MS		20000	/* Granted, see the +CEREG below */
+#define	MODEM_IDLE_MS		1000	/* Nothing scheduled */
+#define	MODEM_RSRP		-83	/* dBm, see host_modem_rsrp() */
+#define	MODEM_RSRQ_IDX		22	/* -9 dB */
+
+void IPC_IRQHandler(void);
+
+struct modem_sock {
+	int		kind;
+	int		peer;		/* Modem end of the socketpair */
+};
+
+struct modem_at {
+	const char	*cmd;		/* Prefix */
+	const char	*resp;		/* Before the final OK */
+	const char	*urc;		/* Sent after the response */
+};
+
+static struct modem_sock modem_socks[MODEM_NFDS];
+static pthread_t gnss_td;
+static uint16_t gnss_interval;
+static int gnss_nframes;
+static uint32_t rpc_pending;	/* Events by context, see host_modem_rpc() */
+
+static pthread_mutex_t lte_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t lte_td;
+static mdx_sem_t lte_sem;
+static int lte_fd = -1;		/* Modem end of the AT socket */
+static int lte_on;
+static int lte_registered;
+static int lte_rrc;
+static int lte_sleep;
+static uint32_t lte_attach_at;
+static uint32_t lte_release_at;
+static uint32_t lte_sleep_at;
+static int lte_rsrp = MODEM_RSRP;
+static int lte_coverage = 1;
+
+static const char lte_cereg[] =
+    "+CEREG: 5,\"0A0B\",\"01020304\",7,,,\"00001010\",\"00100001\"";
+
+static const struct modem_at modem_at[] = {
+	{ "AT+CGPADDR", "+CGPADDR: 0,\"10.160.10.2\"", NULL },
+	{ "AT+CGDCONT?",
+	    "+CGDCONT: 0,\"IP\",\"internet\",\"10.160.10.2\",0,0", NULL },
+	{ "AT+CEDRXRDP", "+CEDRXRDP: 5,\"0101\",\"0101\",\"0011\"", NULL },
+	{ "AT%XSYSTEMMODE?", "%XSYSTEMMODE: 1,0,1,0", NULL },
+	{ "AT%XMONITOR",
+	    "%XMONITOR: 5,\"\",\"\",\"26201\",\"0A0B\",7,20,\"01020304\","
+	    "316,6300,58,22,\"\",\"00001010\",\"00100001\"", NULL },
+};
+
+static int
+modem_write(int fd, const void *buf, size_t len)
+{
+
+	/* The application may have closed its end. */
+	if (send(fd, buf, len, MSG_NOSIGNAL) != (ssize_t)len)
+		return (-1);
+
+	return (0);
+}
+
+static int
+modem_put(int fd, const char *str)
+{
+	size_t len;
+
+	len = strlen(str);
+
+	return (modem_write(fd, str, len));
+}
+
+static void
+lte_urc(const char *urc)
+{
+	char buf[256];
+
+	snprintf(buf, sizeof(buf), "%s\r\n", urc);
+	if (lte_fd >= 0)
+		modem_put(lte_fd, buf);
+}
+
+/*
+ * +CFUN=<fun>. Called with lte_mtx held.
+ */
+static void
+lte_cfun(int fun)
+{
+
+	switch (fun) {
+	case 1:
+	case 21:
+		if (lte_on)
+			break;
+		lte_on = 1;
+		lte_registered = 0;
+		lte_attach_at = clock_ms() + MODEM_ATTACH_MS;
+		mdx_sem_post(&lte_sem);
+		break;
+	case 0:
+	case 4:
+	case 20:
+		if (lte_on == 0)
+			break;
+		lte_on = 0;
+		lte_registered = 0;
+		lte_rrc = 0;
+		lte_sleep = 0;
+		lte_urc("+CEREG: 0");
+		break;
+	}
+}
+
+/*
+ * The next LTE transition. Returns the time until it is due, ms.
+ */
+static int32_t
+lte_step(void)
+{
+	uint32_t now;
+	int32_t left;
+
+	now = clock_ms();
+	left = MODEM_IDLE_MS;
+
+	pthread_mutex_lock(&lte_mtx);
+	if (lte_on && !lte_registered) {
+		left = lte_coverage ? lte_attach_at - now : MODEM_IDLE_MS;
+		if (lte_coverage && left <= 0) {
+			lte_registered = 1;
+			lte_sleep_at = now + MODEM_ACTIVE_MS;
+			lte_urc(lte_cereg);
+			left = 0;
+		}
+	} else if (lte_rrc) {
+		left = lte_release_at - now;
+		if (left <= 0) {
+			lte_rrc = 0;
+			lte_sleep_at = now + MODEM_ACTIVE_MS;
+			lte_urc("+CSCON: 0");
+			left = 0;
+		}
+	} else if (lte_registered && !lte_sleep) {
+		left = lte_sleep_at - now;
+		if (left <= 0) {
+			lte_sleep = 1;
+			lte_urc("%XMODEMSLEEP: 1,3600000");
+			left = MODEM_IDLE_MS;
+		}
+	}
+	pthread_mutex_unlock(&lte_mtx);
+
+	return (left);
+}
+
+static void *
+lte_thread(void *arg)
+{
+	int32_t wait;
+
+	for (;;) {
+		wait = lte_step();
+		if (wait > 0)
+			mdx_sem_timedwait(&lte_sem, wait * 1000);
+	}
+
+	return (NULL);
+}
+
+/*
+ * The application sends or receives on the LTE link. Returns -1 if
+ * the link is not up.
+ */
+int
+host_modem_traffic(void)
+{
+
+	pthread_mutex_lock(&lte_mtx);
+	if (!lte_on || !lte_registered) {
+		pthread_mutex_unlock(&lte_mtx);
+		return (-1);
+	}
+	if (lte_sleep) {
+		lte_sleep = 0;
+		lte_urc("%XMODEMSLEEP: 1,0");
+	}
+	if (!lte_rrc) {
+		lte_rrc = 1;
+		lte_urc("+CSCON: 1");
+	}
+	lte_release_at = clock_ms() + MODEM_INACTIVITY_MS;
+	pthread_mutex_unlock(&lte_mtx);
+
+	mdx_sem_post(&lte_sem);
+
+	return (0);
+}
+
+/*
+ * Set the coverage reported by +CESQ, dBm.
+ */
+void
+host_modem_rsrp(int rsrp)
+{
+
+	pthread_mutex_lock(&lte_mtx);
+	lte_rsrp = rsrp;
+	pthread_mutex_unlock(&lte_mtx);
+}
+
+/*
+ * Lose or regain the LTE coverage. The registration is lost at once
+ * and comes back MODEM_ATTACH_MS after the coverage.
+ */
+void
+host_modem_coverage(int on)
+{
+
+	pthread_mutex_lock(&lte_mtx);
+	lte_coverage = on;
+	if (on)
+		lte_attach_at = clock_ms() + MODEM_ATTACH_MS;
+	else if (lte_registered) {
+		lte_registered = 0;
+		lte_sleep = 0;
+		if (lte_rrc) {
+			lte_rrc = 0;
+			lte_urc("+CSCON: 0");
+		}
+		lte_urc("+CEREG: 2");
+	}
+	pthread_mutex_unlock(&lte_mtx);
+
+	mdx_sem_post(&lte_sem);
+}
+
+/*
+ * Whether the GNSS receiver has the radio.
+ */
+int
+host_modem_gnss_window(void)
+{
+	int ret;
+
+	pthread_mutex_lock(&lte_mtx);
+	ret = !lte_on || lte_sleep;
+	pthread_mutex_unlock(&lte_mtx);
+
+	return (ret);
+}
+
+static void
+modem_at_cmd(int fd, const char *buf, size_t len)
+{
+	const struct modem_at *at;
+	char resp[256];
+	char urc[256];
+	int i;
+
+	at = NULL;
+	for (i = 0; i < nitems(modem_at); i++)
+		if (strncmp(buf, modem_at[i].cmd,
+		    strlen(modem_at[i].cmd)) == 0) {
+			at = &modem_at[i];
+			break;
+		}
+
+	if (strncmp(buf, "AT+CESQ", 7) == 0) {
+		/* The RSRP index is in 1 dB steps from -140 dBm. */
+		pthread_mutex_lock(&lte_mtx);
+		snprintf(resp, sizeof(resp),
+		    "+CESQ: 99,99,255,255,%d,%d\r\nOK\r\n",
+		    MODEM_RSRQ_IDX, lte_rsrp + 141);
+		pthread_mutex_unlock(&lte_mtx);
+	} else if (at != NULL && at->resp != NULL)
+		snprintf(resp, sizeof(resp), "%s\r\nOK\r\n", at->resp);
+	else
+		snprintf(resp, sizeof(resp), "OK\r\n");
+	modem_put(fd, resp);
+
+	if (strncmp(buf, "AT+CFUN=", 8) == 0) {
+		pthread_mutex_lock(&lte_mtx);
+		lte_cfun(atoi(buf + 8));
+		pthread_mutex_unlock(&lte_mtx);
+	}
+
+	if (at != NULL && at->urc != NULL) {
+		snprintf(urc, sizeof(urc), "%s\r\n", at->urc);
+		modem_put(fd, urc);
+	}
+}
+
+/*
+ * A receiver that gets a fix after MODEM_GNSS_FIX epochs, with the
+ * satellites rising in strength meanwhile, and an NMEA GGA sentence
+ * after each PVT frame.
+ */
+static int
+modem_gnss_frame(int fd, int epoch)
+{
+	nrf_gnss_data_frame_t frame;
+	nrf_gnss_pvt_data_frame_t *pvt;
+	int i;
+
+	bzero(&frame, sizeof(frame));
+	frame.data_id = NRF_GNSS_PVT_DATA_ID;
+	pvt = &frame.pvt;
+	for (i = 0; i < 8; i++) {
+		pvt->sv[i].sv = 3 + i * 4;
+		pvt->sv[i].signal = 1;
+		pvt->sv[i].cn0 = 150 + epoch * 10 + i * 20;
+		pvt->sv[i].elevation = 10 + i * 9;
+		pvt->sv[i].azimuth = i * 45;
+		if (epoch >= MODEM_GNSS_FIX && i < 6)
+			pvt->sv[i].flags = NRF_GNSS_SV_FLAG_USED_IN_FIX;
+	}
+	if (epoch >= MODEM_GNSS_FIX) {
+		pvt->flags = NRF_GNSS_PVT_FLAG_FIX_VALID_BIT;
+		pvt->latitude = 51.4779 + epoch * 0.00001;
+		pvt->longitude = -0.0015 - epoch * 0.00001;
+	}
+	if (modem_write(fd, &frame, sizeof(frame)) != 0)
+		return (-1);
+
+	if (epoch < MODEM_GNSS_FIX)
+		return (0);
+
+	bzero(&frame, sizeof(frame));
+	frame.data_id = NRF_GNSS_NMEA_DATA_ID;
+	snprintf(frame.nmea, sizeof(frame.nmea),
+	    "$GPGGA,%06d.00,5128.6740,N,00000.0900,W,1,06,1.2,45.0,M,"
+	    "47.0,M,,*47", epoch % 240000);
+
+	return (modem_write(fd, &frame, sizeof(frame)));
+}
+
+static void *
+modem_gnss_thread(void *arg)
+{
+	int epoch;
+	int fd;
+
+	fd = (intptr_t)arg;
+
+	for (epoch = 0; gnss_nframes == 0 || epoch < gnss_nframes; epoch++) {
+		if (gnss_nframes == 0)
+			sleep(gnss_interval);
+		if (modem_gnss_frame(fd, epoch) != 0)
+			break;
+	}
+
+	/* The receiver sees the end of the stream. */
+	close(fd);
+
+	return (NULL);
+}
+
+static int
+modem_gnss_setsockopt(struct modem_sock *s, int optname, const void *val,
+    nrf_socklen_t len)
+{
+
+	switch (optname) {
+	case NRF_SO_GNSS_FIX_INTERVAL:
+		gnss_interval = *(const nrf_gnss_fix_interval_t *)val;
+		if (gnss_interval == 0)
+			gnss_interval = 1;
+		break;
+	case NRF_SO_GNSS_START:
+		if (pthread_create(&gnss_td, NULL, modem_gnss_thread,
+		    (void *)(intptr_t)s->peer) != 0)
+			return (-1);
+		pthread_detach(gnss_td);
+		break;
+	}
+
+	return (0);
+}
+
+static struct modem_sock *
+modem_sock(int fd)
+{
+
+	if (fd < 0 || fd >= MODEM_NFDS || modem_socks[fd].kind == 0) {
+		errno = EBADF;
+		return (NULL);
+	}
+
+	return (&modem_socks[fd]);
+}
+
+int
+nrf_socket(int family, int type, int protocol)
+{
+	struct modem_sock *s;
+	int sv[2];
+	int fd;
+
+	switch (protocol) {
+	case NRF_PROTO_AT:
+	case NRF_PROTO_GNSS:
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) != 0)
+			return (-1);
+		fd = sv[0];
+		break;
+	default:
+		if (family != NRF_AF_INET) {
+			errno = EAFNOSUPPORT;
+			return (-1);
+		}
+		fd = socket(AF_INET, type == NRF_SOCK_STREAM ?
+		    SOCK_STREAM : SOCK_DGRAM, 0);
+		if (fd < 0)
+			return (-1);
+		sv[1] = -1;
+		break;
+	}
+
+	if (fd >= MODEM_NFDS) {
+		close(fd);
+		if (sv[1] >= 0)
+			close(sv[1]);
+		errno = EMFILE;
+		return (-1);
+	}
+
+	s = &modem_socks[fd];
+	s->peer = sv[1];
+	if (protocol == NRF_PROTO_AT) {
+		s->kind = MODEM_SOCK_AT;
+		pthread_mutex_lock(&lte_mtx);
+		lte_fd = s->peer;
+		pthread_mutex_unlock(&lte_mtx);
+	} else if (protocol == NRF_PROTO_GNSS)
+		s->kind = MODEM_SOCK_GNSS;
+	else
+		s->kind = MODEM_SOCK_INET;
+
+	return (fd);
+}
+
+int
+nrf_close(int fd)
+{
+	struct modem_sock *s;
+
+	s = modem_sock(fd);
+	if (s == NULL)
+		return (-1);
+
+	if (s->kind == MODEM_SOCK_AT) {
+		pthread_mutex_lock(&lte_mtx);
+		if (lte_fd == s->peer)
+			lte_fd = -1;
+		pthread_mutex_unlock(&lte_mtx);
+	}
+
+	/* The GNSS feeder sees EPIPE and stops. */
+	if (s->peer >= 0 && s->kind != MODEM_SOCK_GNSS)
+		close(s->peer);
+	s->kind = 0;
+
+	return (close(fd));
+}
+
+ssize_t
+nrf_send(int fd, const void *buf, size_t len, int flags)
+{
+	struct modem_sock *s;
+
+	s = modem_sock(fd);
+	if (s == NULL)
+		return (-1);
+
+	switch (s->kind) {
+	case MODEM_SOCK_AT:
+		modem_at_cmd(s->peer, buf, len);
+		return (len);
+	case MODEM_SOCK_GNSS:
+		errno = EOPNOTSUPP;
+		return (-1);
+	}
+
+	return (send(fd, buf, len, MSG_NOSIGNAL |
+	    ((flags & NRF_MSG_DONTWAIT) ? MSG_DONTWAIT : 0)));
+}
+
+ssize_t
+nrf_recv(int fd, void *buf, size_t len, int flags)
+{
+
+	if (modem_sock(fd) == NULL)
+		return (-1);
+
+	return (recv(fd, buf, len,
+	    (flags & NRF_MSG_DONTWAIT) ? MSG_DONTWAIT : 0));
+}
+
+static void
+modem_sin(struct sockaddr_in *sin, const struct nrf_sockaddr_in *nsin)
+{
+
+	bzero(sin, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	sin->sin_port = nsin->sin_port;
+	sin->sin_addr.s_addr = nsin->sin_addr.s_addr;
+}
+
+int
+nrf_bind(int fd, const struct nrf_sockaddr *addr, nrf_socklen_t len)
+{
+	struct sockaddr_in sin;
+
+	if (modem_sock(fd) == NULL)
+		return (-1);
+
+	modem_sin(&sin, (const struct nrf_sockaddr_in *)addr);
+
+	return (bind(fd, (struct sockaddr *)&sin, sizeof(sin)));
+}
+
+int
+nrf_connect(int fd, const void *addr, nrf_socklen_t len)
+{
+	struct sockaddr_in sin;
+
+	if (modem_sock(fd) == NULL)
+		return (-1);
+
+	modem_sin(&sin, addr);
+
+	return (connect(fd, (struct sockaddr *)&sin, sizeof(sin)));
+}
+
+int
+nrf_setsockopt(int fd, int level, int optname, const void *val,
+    nrf_socklen_t len)
+{
+	const struct nrf_timeval *ntv;
+	struct modem_sock *s;
+	struct timeval tv;
+
+	s = modem_sock(fd);
+	if (s == NULL)
+		return (-1);
+
+	if (s->kind == MODEM_SOCK_GNSS && level == NRF_SOL_GNSS)
+		return (modem_gnss_setsockopt(s, optname, val, len));
+
+	if (level != NRF_SOL_SOCKET)
+		return (0);
+
+	switch (optname) {
+	case NRF_SO_RCVTIMEO:
+	case NRF_SO_SNDTIMEO:
+		ntv = val;
+		tv.tv_sec = ntv->tv_sec;
+		tv.tv_usec = ntv->tv_usec;
+		return (setsockopt(fd, SOL_SOCKET,
+		    optname == NRF_SO_RCVTIMEO ? SO_RCVTIMEO : SO_SNDTIMEO,
+		    &tv, sizeof(tv)));
+	}
+
+	return (0);
+}
+
+int
+nrf_poll(struct nrf_pollfd *fds, uint32_t nfds, int timeout)
+{
+	struct pollfd pfd[8];
+	int ret;
+	int i;
+
+	if (nfds > nitems(pfd)) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	for (i = 0; i < nfds; i++) {
+		pfd[i].fd = fds[i].fd;
+		pfd[i].events = 0;
+		if (fds[i].events & NRF_POLLIN)
+			pfd[i].events |= POLLIN;
+		if (fds[i].events & NRF_POLLOUT)
+			pfd[i].events |= POLLOUT;
+	}
+
+	ret = poll(pfd, nfds, timeout);
+	if (ret < 0)
+		return (ret);
+
+	for (i = 0; i < nfds; i++) {
+		fds[i].revents = 0;
+		if (pfd[i].revents & POLLIN)
+			fds[i].revents |= NRF_POLLIN;
+		if (pfd[i].revents & POLLOUT)
+			fds[i].revents |= NRF_POLLOUT;
+		if (pfd[i].revents & POLLERR)
+			fds[i].revents |= NRF_POLLERR;
+		if (pfd[i].revents & POLLHUP)
+			fds[i].revents |= NRF_POLLHUP;
+	}
+
+	return (ret);
+}
+
+/*
+ * IPv4 only, as the modem is configured here. The result is a single
+ * entry, freed with nrf_freeaddrinfo().
+ */
+int
+nrf_getaddrinfo(const char *node, const char *service,
+    const struct nrf_addrinfo *hints, struct nrf_addrinfo **res)
+{
+	struct nrf_sockaddr_in *nsin;
+	struct sockaddr_in *sin;
+	struct addrinfo hint;
+	struct addrinfo *ai;
+	struct nrf_addrinfo *nai;
+	int err;
+
+	*res = NULL;
+
+	bzero(&hint, sizeof(hint));
+	hint.ai_family = AF_INET;
+	hint.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(node, service, &hint, &ai);
+	if (err != 0)
+		return (err);
+
+	nai = calloc(1, sizeof(*nai) + sizeof(*nsin));
+	if (nai == NULL) {
+		freeaddrinfo(ai);
+		return (EAI_MEMORY);
+	}
+
+	sin = (struct sockaddr_in *)ai->ai_addr;
+	nsin = (struct nrf_sockaddr_in *)(nai + 1);
+	nsin->sin_len = sizeof(*nsin);
+	nsin->sin_family = NRF_AF_INET;
+	nsin->sin_port = sin->sin_port;
+	nsin->sin_addr.s_addr = sin->sin_addr.s_addr;
+
+	nai->ai_family = NRF_AF_INET;
+	nai->ai_socktype = NRF_SOCK_STREAM;
+	nai->ai_addrlen = sizeof(*nsin);
+	nai->ai_addr = (struct nrf_sockaddr *)nsin;
+	freeaddrinfo(ai);
+
+	*res = nai;
+
+	return (0);
+}
+
+void
+nrf_freeaddrinfo(struct nrf_addrinfo *res)
+{
+
+	free(res);
+}
+
+/*
+ * With nframes set, the GNSS frames are produced back to back rather
+ * than once per fix interval, and the stream ends after nframes.
+ */
+void
+host_modem_gnss_frames(int nframes)
+{
+
+	gnss_nframes = nframes;
+}
+
+/*
+ * The RPC transport of bsdlib. The modem has an event for a context,
+ * e.g. a socket, and raises the application interrupt: bsd_os.c wakes
+ * the threads waiting in bsd_os_timedwait(), and each of them takes
+ * the event of its context, if there is one. Contexts are 0 to 31.
+ */
+void
+host_modem_rpc(uint32_t context)
+{
+
+	critical_enter();
+	rpc_pending |= (1U << context);
+	critical_exit();
+
+	host_intc_fire(ID_EGU1);
+}
+
+int
+host_modem_rpc_take(uint32_t context)
+{
+	int ret;
+
+	critical_enter();
+	ret = (rpc_pending & (1U << context)) != 0;
+	rpc_pending &= ~(1U << context);
+	critical_exit();
+
+	return (ret);
+}
+
+void
+bsd_os_application_irq_handler(void)
+{
+
+}
+
+void
+bsd_os_trace_irq_handler(void)
+{
+
+}
+
+void
+IPC_IRQHandler(void)
+{
+
+}
+
+void
+host_modem_init(void)
+{
+
+	gnss_interval = 1;
+
+	mdx_sem_init(&lte_sem, 0);
+	if (pthread_create(&lte_td, NULL, lte_thread, NULL) != 0)
+		panic("can't start the LTE timing");
+	pthread_detach(lte_td);
+}
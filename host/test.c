@@ -0,0 +1,690 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+
+#include <mbedtls/platform.h>
+
+#include <unistd.h>
+
+#include "host.h"
+
+#include "../src/antenna.h"
+#include "../src/board.h"
+#include "../src/clock.h"
+#include "../src/energy.h"
+#include "../src/heap.h"
+#include "../src/log.h"
+#include "../src/metrics.h"
+#include "../src/radio.h"
+#include "../src/shell.h"
+
+/*
+ * Unit tests of src/ over the host kernel, run with -T. Each test
+ * prints the checks that fail and one line to stderr:
+ *
+ *	test <name> ok|FAIL
+ */
+
+#define	CHECK(x)	test_check((x), #x, __LINE__)
+
+/* HEAP_PROBE_CALLS, and the HEAP_PROBE_MAX blocks taken at the end. */
+#define	TEST_PROBE_CALLS	(48 + 8)
+
+/* The log test waits up to TEST_LOG_TRIES of TEST_STEP_US for its line. */
+#define	TEST_LOG_TRIES		1000
+#define	TEST_LOG_LINE		" I test log -1 string 3735928559\n"
+
+/*
+ * The radio test runs TEST_RADIO_MS of simulated time, in steps of
+ * TEST_STEP_MS given TEST_STEP_US of real time each to settle.
+ */
+#define	TEST_RADIO_MS		(15 * 60 * 1000)
+#define	TEST_STEP_MS		100
+#define	TEST_STEP_US		500
+#define	TEST_UPLINK_MS		30000	/* Telemetry period */
+#define	TEST_UPLINK_BYTES	200
+#define	TEST_FIX_FRAMES		5	/* In a window before the fix */
+#define	TEST_LATENCY_MS		(60000 + 2000 + 1000) /* Deadline, attach */
+
+/*
+ * The uplink test: TEST_SENSORS producers a TEST_SENSOR_MS period
+ * apart, in each coverage and class for TEST_PHASE_MS after
+ * TEST_SETTLE_MS.
+ */
+#define	TEST_SENSORS		4
+#define	TEST_SENSOR_MS		20000
+#define	TEST_SETTLE_MS		120000
+#define	TEST_PHASE_MS		(10 * 60 * 1000)
+#define	TEST_RSRP_GOOD		-83	/* dBm */
+#define	TEST_RSRP_POOR		-115
+#define	TEST_AMP_UA		5000	/* See energy.c */
+
+/* The normal class deadline and RADIO_UPLINK_WAIT_MS, see radio.c. */
+#define	TEST_TIMEOUT_MS		(60000 + 300000)
+
+struct host_test {
+	const char	*name;
+	void		(*fn)(void);
+};
+
+struct test_phase {
+	const char	*name;
+	int		rsrp;
+	int		class;
+	uint64_t	nah;		/* Results */
+	uint32_t	bytes;
+	uint32_t	bytes_poor;
+	uint32_t	deadline;
+};
+
+static int test_failed;
+static int test_stop;
+static int test_nthreads;
+static mdx_sem_t test_done;
+static int test_uplink_class;
+static uint32_t test_uplink_ms;
+static int test_uplink_error;
+
+static struct test_phase test_phases[] = {
+	{ "poor urgent", TEST_RSRP_POOR, RADIO_UPLINK_URGENT },
+	{ "poor normal", TEST_RSRP_POOR, RADIO_UPLINK_NORMAL },
+	{ "good urgent", TEST_RSRP_GOOD, RADIO_UPLINK_URGENT },
+	{ "good normal", TEST_RSRP_GOOD, RADIO_UPLINK_NORMAL },
+};
+
+static void
+test_check(int ok, const char *expr, int line)
+{
+
+	if (ok)
+		return;
+
+	fprintf(stderr, "test.c:%d: %s\n", line, expr);
+	test_failed = 1;
+}
+
+static void
+test_heap_tags(void)
+{
+	static const uint32_t small[] = { 64 };
+	uint32_t cur0, peak0;
+	uint32_t cur, peak;
+	void *a, *b;
+
+	heap_usage(HEAP_TAG_JSON, &cur0, &peak0);
+	a = heap_alloc(HEAP_TAG_JSON, 1000);
+	b = heap_alloc(HEAP_TAG_JSON, 500);
+	heap_usage(HEAP_TAG_JSON, &cur, &peak);
+	CHECK(cur == cur0 + 1500);
+	CHECK(peak >= cur0 + 1500);
+	heap_free(a);
+	heap_usage(HEAP_TAG_JSON, &cur, &peak);
+	CHECK(cur == cur0 + 500);
+	CHECK(peak >= cur0 + 1500);
+	heap_free(b);
+	heap_usage(HEAP_TAG_JSON, &cur, &peak);
+	CHECK(cur == cur0);
+
+	/* mbedTLS allocates with the TLS tag. */
+	heap_usage(HEAP_TAG_TLS, &cur0, &peak0);
+	a = mbedtls_calloc(4, 25);
+	heap_usage(HEAP_TAG_TLS, &cur, &peak);
+	CHECK(a != NULL);
+	CHECK(cur == cur0 + 100);
+	mbedtls_free(a);
+	heap_usage(HEAP_TAG_TLS, &cur, &peak);
+	CHECK(cur == cur0);
+
+	/* A failed allocation is not accounted. */
+	heap_usage(HEAP_TAG_DISK, &cur0, &peak0);
+	host_malloc_holes(small, nitems(small));
+	a = heap_alloc(HEAP_TAG_DISK, 1000);
+	host_malloc_real();
+	heap_usage(HEAP_TAG_DISK, &cur, &peak);
+	CHECK(a == NULL);
+	CHECK(cur == cur0);
+	CHECK(peak == peak0);
+}
+
+static void
+test_heap_probe(void)
+{
+	static const uint32_t holes[] = { 8192, 4096, 1024, 512 };
+	static uint32_t frag[32];
+	uint32_t total;
+	uint32_t calls;
+	uint32_t avail;
+	int i;
+
+	total = 0;
+	for (i = 0; i < nitems(holes); i++)
+		total += holes[i];
+
+	host_malloc_holes(holes, nitems(holes));
+	avail = heap_free_space();
+	calls = host_malloc_real();
+
+	CHECK(heap_largest_free <= 8192);
+	CHECK(heap_largest_free >= 8192 - 8192 / 16);
+	CHECK(avail <= total);
+	CHECK(avail >= total - total / 16);
+	CHECK(heap_frag == 1000 - (uint64_t)heap_largest_free * 1000 / avail);
+	CHECK(calls <= TEST_PROBE_CALLS);
+
+	/* Too fragmented to probe: the free space is a lower bound. */
+	for (i = 0; i < nitems(frag); i++)
+		frag[i] = 1024;
+	host_malloc_holes(frag, nitems(frag));
+	avail = heap_free_space();
+	calls = host_malloc_real();
+
+	CHECK(heap_largest_free >= 1024 - 1024 / 16);
+	CHECK(avail <= 1024 * nitems(frag));
+	CHECK(avail >= heap_largest_free);
+	CHECK(calls <= TEST_PROBE_CALLS);
+
+	/* Nothing free. */
+	host_malloc_holes(NULL, 0);
+	avail = heap_free_space();
+	host_malloc_real();
+	CHECK(avail == 0);
+	CHECK(heap_largest_free == 0);
+	CHECK(heap_frag == 0);
+}
+
+/*
+ * Feed the line discipline as the shell thread does. Returns the
+ * number of lines completed, the last one is left in l->buf.
+ */
+static int
+test_line(struct shell_line *l, const char *in, int len)
+{
+	int lines;
+	int i;
+
+	lines = 0;
+	l->len = 0;
+	for (i = 0; i < len; i++)
+		if (shell_line_input(l, (uint8_t)in[i])) {
+			lines++;
+			l->len = 0;
+		}
+
+	return (lines);
+}
+
+#define	TEST_LINE(l, s)	test_line((l), (s), sizeof(s) - 1)
+
+static void
+test_shell_line(void)
+{
+	char longline[SHELL_LINE_SIZE * 2 + 1];
+	struct shell_line l;
+
+	/* CR, LF and CRLF end a line, empty lines are not reported. */
+	CHECK(TEST_LINE(&l, "stats\r") == 1);
+	CHECK(strcmp(l.buf, "stats") == 0);
+	CHECK(TEST_LINE(&l, "heap\n") == 1);
+	CHECK(strcmp(l.buf, "heap") == 0);
+	CHECK(TEST_LINE(&l, "help\r\n") == 1);
+	CHECK(TEST_LINE(&l, "\r\n\r\r\n") == 0);
+	CHECK(TEST_LINE(&l, "at+cesq\r\nstack\r\n") == 2);
+	CHECK(strcmp(l.buf, "stack") == 0);
+
+	/* No line end, no line. */
+	CHECK(TEST_LINE(&l, "trace") == 0);
+	CHECK(l.len == 5);
+
+	/* BS and DEL erase, also on an empty line. */
+	CHECK(TEST_LINE(&l, "\b\x7fhex\bap\r") == 1);
+	CHECK(strcmp(l.buf, "heap") == 0);
+	CHECK(TEST_LINE(&l, "ab\x7f\x7f\x7f\r") == 0);
+	CHECK(TEST_LINE(&l, "x\b\r") == 0);
+
+	/* Other control and non-ASCII characters are dropped. */
+	CHECK(TEST_LINE(&l, "bo\x01\to\x1b\x80\xfft\r") == 1);
+	CHECK(strcmp(l.buf, "boot") == 0);
+
+	/* An overlong line is cut at the buffer size. */
+	memset(longline, 'a', sizeof(longline) - 2);
+	longline[sizeof(longline) - 2] = '\r';
+	longline[sizeof(longline) - 1] = '\0';
+	CHECK(test_line(&l, longline, sizeof(longline) - 1) == 1);
+	CHECK(strlen(l.buf) == SHELL_LINE_SIZE - 1);
+
+	/* ... and can still be edited at the end. */
+	longline[sizeof(longline) - 2] = '\b';
+	CHECK(test_line(&l, longline, sizeof(longline) - 1) == 0);
+	CHECK(shell_line_input(&l, 'b') == 0);
+	CHECK(shell_line_input(&l, '\r') == 1);
+	CHECK(strlen(l.buf) == SHELL_LINE_SIZE - 1);
+	CHECK(l.buf[SHELL_LINE_SIZE - 2] == 'b');
+}
+
+/*
+ * A deferred log record with %s arguments: the string pointers must
+ * survive the ring in the 64-bit build.
+ */
+static void
+test_log(void)
+{
+	char buf[256];
+	ssize_t len;
+	FILE *f;
+	int out;
+	int i;
+
+	f = tmpfile();
+	CHECK(f != NULL);
+	if (f == NULL)
+		return;
+
+	fflush(stdout);
+	out = dup(STDOUT_FILENO);
+	dup2(fileno(f), STDOUT_FILENO);
+
+	log_info("test %s %d %s %u\n", "log", -1, "string", 0xdeadbeefU);
+
+	/* The log thread prints it when nothing else runs. */
+	buf[0] = '\0';
+	for (i = 0; i < TEST_LOG_TRIES && strstr(buf, TEST_LOG_LINE) == NULL;
+	    i++) {
+		usleep(TEST_STEP_US);
+		fflush(stdout);
+		len = pread(fileno(f), buf, sizeof(buf) - 1, 0);
+		buf[len > 0 ? len : 0] = '\0';
+	}
+
+	dup2(out, STDOUT_FILENO);
+	close(out);
+	fclose(f);
+
+	CHECK(strstr(buf, TEST_LOG_LINE) != NULL);
+}
+
+static uint32_t
+test_metric(const char *group, const char *name)
+{
+	uint32_t val;
+
+	if (metrics_read(group, name, &val) != 0) {
+		fprintf(stderr, "test.c: no metric %s.%s\n", group, name);
+		test_failed = 1;
+		return (0);
+	}
+
+	return (val);
+}
+
+/*
+ * Advance the simulated time, letting the threads run in between.
+ */
+static void
+test_run(uint32_t ms)
+{
+	uint32_t t;
+
+	for (t = 0; t < ms; t += TEST_STEP_MS) {
+		host_clock_advance(TEST_STEP_MS);
+		usleep(TEST_STEP_US);
+	}
+}
+
+/*
+ * The telemetry: one uplink per period, after a start delay.
+ */
+static void
+test_uplink_thread(void *arg)
+{
+
+	mdx_usleep((uintptr_t)arg * 1000);
+
+	while (!test_stop) {
+		if (radio_uplink_begin(test_uplink_class) == 0)
+			host_modem_traffic();
+		radio_uplink_end(TEST_UPLINK_BYTES);
+		mdx_usleep(test_uplink_ms * 1000);
+	}
+
+	mdx_sem_post(&test_done);
+}
+
+/*
+ * The receiver: one PVT frame a second, with a fix after a few frames
+ * while it has the radio.
+ */
+static void
+test_gnss_thread(void *arg)
+{
+	uint8_t flags;
+	int frames;
+
+	frames = 0;
+
+	while (!test_stop) {
+		if (host_modem_gnss_window()) {
+			flags = 0;
+			if (++frames >= TEST_FIX_FRAMES)
+				flags = NRF_GNSS_PVT_FLAG_FIX_VALID_BIT;
+		} else {
+			flags = NRF_GNSS_PVT_FLAG_NOT_ENOUGH_WINDOW_TIME;
+			frames = 0;
+		}
+		radio_gnss_pvt(flags);
+		mdx_usleep(1000000);
+	}
+
+	/* Stopped, not waiting for a window. */
+	radio_gnss_pvt(0);
+	energy_set(ENERGY_GNSS, ENERGY_OFF);
+
+	mdx_sem_post(&test_done);
+}
+
+static void
+test_thread(const char *name, void (*entry)(void *), uintptr_t arg)
+{
+	struct thread *td;
+
+	td = mdx_thread_create(name, PRIO_NORMAL, 0, 4096, entry,
+	    (void *)arg);
+	if (td == NULL)
+		panic("can't create thread %s", name);
+	mdx_sched_add(td);
+	test_nthreads++;
+}
+
+/*
+ * Stop the test threads, running the time until they are done.
+ */
+static void
+test_join(void)
+{
+
+	test_stop = 1;
+	while (test_nthreads > 0) {
+		if (mdx_sem_trywait(&test_done))
+			test_nthreads--;
+		else
+			test_run(TEST_STEP_MS);
+	}
+	test_stop = 0;
+}
+
+/*
+ * The radio runs over the simulated modem from the first test that
+ * needs it on.
+ */
+static void
+test_radio_start(void)
+{
+	static int started;
+
+	if (started)
+		return;
+	started = 1;
+
+	mdx_sem_init(&test_done, 0);
+	radio_init();
+	radio_start();
+}
+
+/*
+ * The radio scheduler over the modem timing of modem.c: GNSS gets the
+ * PSM sleeps, the uplinks leave within their deadline and the state
+ * records are not written again on each registration. An idle LTE
+ * antenna probe keeps the antenna routed to LTE.
+ */
+static void
+test_radio(void)
+{
+	uint32_t pvt, blocked, fix;
+	uint32_t uplinks;
+	uint32_t writes;
+	uint32_t probes;
+
+	test_radio_start();
+
+	test_uplink_class = RADIO_UPLINK_NORMAL;
+	test_uplink_ms = TEST_UPLINK_MS;
+	test_thread("uplink", test_uplink_thread, 0);
+	test_thread("gnss", test_gnss_thread, 0);
+
+	/* Registered, the first records are written. */
+	test_run(TEST_UPLINK_MS);
+	CHECK(test_metric("psm", "attaches") >= 1);
+	writes = host_state_writes();
+
+	test_run(TEST_RADIO_MS - TEST_UPLINK_MS);
+
+	test_join();
+	radio_stats();
+
+	pvt = test_metric("radio", "pvt");
+	blocked = test_metric("radio", "pvt_blocked");
+	fix = test_metric("radio", "pvt_fix");
+	uplinks = test_metric("radio", "uplinks");
+
+	CHECK(pvt > blocked);
+	CHECK(blocked > 0);
+	CHECK(fix > 0);
+	CHECK(uplinks >= TEST_RADIO_MS / TEST_UPLINK_MS / 2);
+	CHECK(test_metric("radio", "uplink_latency_max_ms") <=
+	    TEST_LATENCY_MS);
+	CHECK(test_metric("radio", "uplink_bytes") ==
+	    uplinks * TEST_UPLINK_BYTES);
+	CHECK(test_metric("radio", "rrc_connected_ms") > 0);
+	CHECK(test_metric("radio", "modem_sleeps") > 0);
+	CHECK(host_state_writes() == writes);
+
+	/* With the link idle, the probe keeps the antenna on LTE. */
+	probes = test_metric("antenna", "lte_probes");
+	test_run(antenna_lte_probe_next() + TEST_UPLINK_MS);
+	CHECK(test_metric("antenna", "lte_probes") > probes);
+	CHECK(host_misroutes() == 0);
+}
+
+static uint64_t
+test_nah(void)
+{
+	struct energy_report r;
+
+	energy_get(&r, clock_ms(), 0);
+
+	return (r.nah);
+}
+
+static void
+test_uplink_phase(struct test_phase *p)
+{
+	uint32_t bytes, poor, deadline;
+	uint64_t nah;
+	int i;
+
+	host_modem_rsrp(p->rsrp);
+	test_uplink_class = p->class;
+	test_uplink_ms = TEST_SENSOR_MS;
+	for (i = 0; i < TEST_SENSORS; i++)
+		test_thread("sensor", test_uplink_thread,
+		    i * TEST_SENSOR_MS / TEST_SENSORS);
+
+	/* Let the signal quality and the batches follow. */
+	test_run(TEST_SETTLE_MS);
+
+	nah = test_nah();
+	bytes = test_metric("radio", "uplink_bytes");
+	poor = test_metric("radio", "uplink_bytes_poor");
+	deadline = test_metric("radio", "uplink_deadline");
+
+	test_run(TEST_PHASE_MS);
+
+	p->nah = test_nah() - nah;
+	p->bytes = test_metric("radio", "uplink_bytes") - bytes;
+	p->bytes_poor = test_metric("radio", "uplink_bytes_poor") - poor;
+	p->deadline = test_metric("radio", "uplink_deadline") - deadline;
+
+	test_join();
+
+	printf("uplink: %s: %u bytes (%u poor), %u forced by deadline, "
+	    "%u.%03u uAh, %u pAh/byte\n", p->name, p->bytes, p->bytes_poor,
+	    p->deadline, (uint32_t)(p->nah / 1000), (uint32_t)(p->nah % 1000),
+	    p->bytes ? (uint32_t)(p->nah * 1000 / p->bytes) : 0);
+}
+
+/*
+ * Energy per delivered byte of the uplink classes in poor and good
+ * coverage. The normal class waits in poor coverage for its deadline
+ * and batches the sensors in one RRC connection, the urgent one keeps
+ * the connection up. The antenna is routed to GNSS in between, its
+ * amplifier is not part of the uplink cost.
+ */
+static void
+test_uplink(void)
+{
+	struct test_phase *p;
+	uint32_t lat;
+	int i;
+
+	test_radio_start();
+	energy_set_current("amp_on", 0);
+
+	for (i = 0; i < nitems(test_phases); i++) {
+		p = &test_phases[i];
+		test_uplink_phase(p);
+		CHECK(p->bytes > 0);
+		CHECK(p->bytes % TEST_UPLINK_BYTES == 0);
+		if (p->rsrp == TEST_RSRP_POOR)
+			CHECK(p->bytes_poor == p->bytes);
+		else
+			CHECK(p->bytes_poor == 0);
+	}
+
+	/* Poor coverage: deferred to the deadline, at less per byte. */
+	CHECK(test_phases[0].deadline == 0);
+	CHECK(test_phases[1].deadline > 0);
+	CHECK(test_phases[1].nah * test_phases[0].bytes <
+	    test_phases[0].nah * test_phases[1].bytes);
+
+	/* Good coverage: batched, not forced. */
+	CHECK(test_phases[3].deadline == 0);
+	CHECK(test_phases[3].nah * test_phases[2].bytes <
+	    test_phases[2].nah * test_phases[3].bytes);
+
+	lat = test_metric("radio", "uplink_latency_max_ms");
+	CHECK(lat <= TEST_LATENCY_MS);
+
+	radio_stats();
+	energy_set_current("amp_on", TEST_AMP_UA);
+}
+
+static void
+test_timeout_thread(void *arg)
+{
+
+	test_uplink_error = radio_uplink_begin(RADIO_UPLINK_NORMAL);
+	if (test_uplink_error == 0)
+		host_modem_traffic();
+	radio_uplink_end(0);
+
+	mdx_sem_post(&test_done);
+}
+
+/*
+ * Without coverage an uplink fails once it waited too long past its
+ * deadline, and succeeds again once the modem registers.
+ */
+static void
+test_uplink_timeout(void)
+{
+	uint32_t timeouts;
+	uint32_t uplinks;
+
+	test_radio_start();
+
+	host_modem_coverage(0);
+	timeouts = test_metric("radio", "uplink_timeouts");
+	uplinks = test_metric("radio", "uplinks");
+
+	test_thread("uplink", test_timeout_thread, 0);
+	/* The clock also runs in real time, see clock.c. */
+	test_run(TEST_TIMEOUT_MS - 10000);
+	CHECK(test_metric("radio", "uplink_timeouts") == timeouts);
+
+	test_run(20000);
+	CHECK(test_metric("radio", "uplink_timeouts") == timeouts + 1);
+	if (test_failed)
+		return;		/* Still waiting, can't be joined */
+	test_join();
+	CHECK(test_uplink_error != 0);
+	CHECK(test_metric("radio", "uplinks") == uplinks);
+
+	host_modem_coverage(1);
+	test_thread("uplink", test_timeout_thread, 0);
+	test_join();
+	CHECK(test_uplink_error == 0);
+	CHECK(test_metric("radio", "uplinks") == uplinks + 1);
+}
+
+static const struct host_test tests[] = {
+	{ "heap_tags", test_heap_tags },
+	{ "heap_probe", test_heap_probe },
+	{ "shell_line", test_shell_line },
+	{ "log", test_log },
+	{ "radio", test_radio },
+	{ "uplink", test_uplink },
+	{ "uplink_timeout", test_uplink_timeout },
+};
+
+/*
+ * Run the tests, or the named one. Returns the number of failures.
+ */
+int
+host_test(const char *name)
+{
+	int nfailed;
+	int i;
+
+	nfailed = 0;
+
+	for (i = 0; i < nitems(tests); i++) {
+		if (name != NULL && strcmp(name, tests[i].name) != 0)
+			continue;
+		test_failed = 0;
+		tests[i].fn();
+		fprintf(stderr, "test %s %s\n", tests[i].name,
+		    test_failed ? "FAIL" : "ok");
+		nfailed += test_failed;
+	}
+
+	return (nfailed);
+}
@@ -0,0 +1,464 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/mutex.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+
+#include <dev/gpio/gpio.h>
+
+#include "antenna.h"
+#include "board.h"
+#include "clock.h"
+#include "disk.h"
+#include "energy.h"
+#include "lte.h"
+#include "metrics.h"
+
+/*
+ * Antenna diversity.
+ *
+ * Both LTE (SW2) and GPS (SW1) can be routed either to the onboard
+ * antenna or to the u.FL connector. Both paths are measured at startup
+ * and then periodically: RSRP for LTE and the average C/N0 of the
+ * tracked satellites for GNSS. The better path is used and saved to
+ * the disk so the next boot starts with it.
+ */
+
+#define	ANTENNA_ONBOARD		0
+#define	ANTENNA_UFL		1
+#define	ANTENNA_NPATHS		2
+
+#define	ANTENNA_MAGIC		0x616e7431	/* ant1 */
+#define	ANTENNA_STATE		"antenna"
+
+#define	ANTENNA_SETTLE_MS	3000	/* A couple of DRX cycles */
+#define	ANTENNA_LTE_PERIOD_MS	(60 * 60 * 1000)
+#define	ANTENNA_LTE_RETRY_MS	(5 * 60 * 1000)
+#define	ANTENNA_LTE_HYST	3	/* dB */
+#define	ANTENNA_GNSS_PERIOD_MS	(30 * 60 * 1000)
+#define	ANTENNA_GNSS_FRAMES	10	/* PVT frames per path */
+#define	ANTENNA_GNSS_HYST	10	/* 0.1 dB-Hz */
+#define	ANTENNA_RSRP_INVALID	-200
+
+struct antenna_state {
+	uint32_t	magic;
+	int32_t		lte_sel;
+	int32_t		gnss_sel;
+	int32_t		rsrp[ANTENNA_NPATHS];	/* dBm */
+	int32_t		cn0[ANTENNA_NPATHS];	/* 0.1 dB-Hz */
+};
+
+static struct antenna_state state;
+static struct mdx_mutex antenna_mtx;
+static mdx_device_t gpio;
+static bool route_gps;
+
+static int lte_probe = -1;
+static uint32_t lte_next;
+static uint32_t lte_settle;
+static int32_t lte_rsrp[ANTENNA_NPATHS];
+
+static int gnss_probe = -1;
+static uint32_t gnss_next;
+static int gnss_frames;
+static uint32_t gnss_sum;
+static uint32_t gnss_nsv;
+
+static uint32_t lte_probes;
+static uint32_t gnss_probes;
+static uint32_t switches;
+
+static const struct metric antenna_metrics[] = {
+	METRIC_I32("lte_sel", &state.lte_sel),
+	METRIC_I32("lte_rsrp_onboard", &state.rsrp[ANTENNA_ONBOARD]),
+	METRIC_I32("lte_rsrp_ufl", &state.rsrp[ANTENNA_UFL]),
+	METRIC_I32("gnss_sel", &state.gnss_sel),
+	METRIC_I32("gnss_cn0_onboard", &state.cn0[ANTENNA_ONBOARD]),
+	METRIC_I32("gnss_cn0_ufl", &state.cn0[ANTENNA_UFL]),
+	METRIC_U32("lte_probes", &lte_probes),
+	METRIC_U32("gnss_probes", &gnss_probes),
+	METRIC_U32("switches", &switches),
+};
+
+static struct metrics_group antenna_group = {
+	.name = "antenna",
+	.metrics = antenna_metrics,
+	.nmetrics = nitems(antenna_metrics),
+};
+
+static void
+sw_init(void)
+{
+	uint32_t reg;
+
+	reg = CNF_DIR_OUT | CNF_INPUT_DIS | CNF_PULL_DOWN;
+
+	/*
+	 * SW1: GPS antenna switch
+	 * 0: u.FL
+	 * 1: MN
+	 */
+	nrf_gpio_pincfg(gpio, PIN_SW1_CTL, reg);
+	mdx_gpio_configure(gpio, PIN_SW1_CTL, MDX_GPIO_OUTPUT);
+
+	/*
+	 * SW2: LTE antenna switch
+	 * 0: MN
+	 * 1: u.FL
+	 */
+	nrf_gpio_pincfg(gpio, PIN_SW2_CTL, reg);
+	mdx_gpio_configure(gpio, PIN_SW2_CTL, MDX_GPIO_OUTPUT);
+
+	/*
+	 * SW2: Fractus antenna switch
+	 * 0: LTE
+	 * 1: GPS
+	 */
+	nrf_gpio_pincfg(gpio, PIN_SW3_CTL, reg);
+	mdx_gpio_configure(gpio, PIN_SW3_CTL, MDX_GPIO_OUTPUT);
+
+	/* GPS Amplifier */
+	nrf_gpio_pincfg(gpio, PIN_GPS_AMP_EN, reg);
+	mdx_gpio_configure(gpio, PIN_GPS_AMP_EN, MDX_GPIO_OUTPUT);
+
+	/* LED1 */
+	nrf_gpio_pincfg(gpio, PIN_LED1, reg);
+	mdx_gpio_configure(gpio, PIN_LED1, MDX_GPIO_OUTPUT);
+	mdx_gpio_set(gpio, PIN_LED1, 1);
+
+	/* LED2 */
+	nrf_gpio_pincfg(gpio, PIN_LED2, reg);
+	mdx_gpio_configure(gpio, PIN_LED2, MDX_GPIO_OUTPUT);
+	mdx_gpio_set(gpio, PIN_LED2, 1);
+}
+
+static void
+sw_ctl(bool gps_enable, bool onboard_antenna)
+{
+
+	if (gps_enable == false) {
+		/* LTE antenna */
+		if (onboard_antenna)
+			mdx_gpio_set(gpio, PIN_SW2_CTL, 0);
+		else
+			mdx_gpio_set(gpio, PIN_SW2_CTL, 1);
+		mdx_gpio_set(gpio, PIN_SW3_CTL, 0);
+		mdx_gpio_set(gpio, PIN_GPS_AMP_EN, 0);
+	} else {
+		/* GPS antenna */
+		mdx_gpio_set(gpio, PIN_SW3_CTL, 1);
+		if (onboard_antenna)
+			mdx_gpio_set(gpio, PIN_SW1_CTL, 1);
+		else
+			mdx_gpio_set(gpio, PIN_SW1_CTL, 0);
+		mdx_gpio_set(gpio, PIN_GPS_AMP_EN, 1);
+	}
+
+	energy_set(ENERGY_AMP, gps_enable ? ENERGY_ON : ENERGY_OFF);
+}
+
+/*
+ * Apply the current route. Called with antenna_mtx held.
+ */
+static void
+antenna_apply(void)
+{
+	int path;
+
+	if (route_gps)
+		path = gnss_probe >= 0 ? gnss_probe : state.gnss_sel;
+	else
+		path = lte_probe >= 0 ? lte_probe : state.lte_sel;
+
+	sw_ctl(route_gps, path == ANTENNA_ONBOARD);
+}
+
+static void
+antenna_save(void)
+{
+	struct antenna_state tmp;
+
+	mdx_mutex_lock(&antenna_mtx);
+	tmp = state;
+	mdx_mutex_unlock(&antenna_mtx);
+
+	save_state(ANTENNA_STATE, &tmp, sizeof(struct antenna_state));
+}
+
+/*
+ * Pick the better of two paths. The current one is kept unless the
+ * other is better by more than hyst.
+ */
+static int
+antenna_pick(int cur, const int32_t *val, int hyst)
+{
+	int other;
+
+	other = (cur == ANTENNA_ONBOARD) ? ANTENNA_UFL : ANTENNA_ONBOARD;
+	if (val[other] > val[cur] + hyst)
+		return (other);
+
+	return (cur);
+}
+
+void
+antenna_route(bool gps)
+{
+
+	mdx_mutex_lock(&antenna_mtx);
+	route_gps = gps;
+	antenna_apply();
+	mdx_mutex_unlock(&antenna_mtx);
+}
+
+/*
+ * Time until the next LTE probe is due, ms. Zero or negative if due.
+ */
+int32_t
+antenna_lte_probe_next(void)
+{
+
+	return ((int32_t)(lte_next - clock_ms()));
+}
+
+/*
+ * Measure RSRP on both LTE paths, one step per call: each path is
+ * routed, left to settle and measured. The caller must route the
+ * antenna to LTE and keep the link idle meanwhile. Returns the time
+ * until the next step, ms, and once the probe is over the time until
+ * the next probe.
+ */
+int32_t
+antenna_lte_probe(void)
+{
+	int32_t left;
+	int rsrq;
+	int val;
+	int sel;
+
+	if (lte_probe >= 0) {
+		left = (int32_t)(lte_settle - clock_ms());
+		if (left > 0)
+			return (left);
+
+		if (lte_cesq(&val, &rsrq) == 0)
+			lte_rsrp[lte_probe] = val;
+		else
+			lte_rsrp[lte_probe] = ANTENNA_RSRP_INVALID;
+	}
+
+	if (lte_probe + 1 < ANTENNA_NPATHS) {
+		mdx_mutex_lock(&antenna_mtx);
+		lte_probe++;
+		antenna_apply();
+		mdx_mutex_unlock(&antenna_mtx);
+
+		lte_settle = clock_ms() + ANTENNA_SETTLE_MS;
+
+		return (ANTENNA_SETTLE_MS);
+	}
+
+	mdx_mutex_lock(&antenna_mtx);
+	lte_probe = -1;
+	lte_probes++;
+
+	if (lte_rsrp[ANTENNA_ONBOARD] == ANTENNA_RSRP_INVALID &&
+	    lte_rsrp[ANTENNA_UFL] == ANTENNA_RSRP_INVALID) {
+		/* No measurement, e.g. the modem is in PSM. */
+		lte_next = clock_ms() + ANTENNA_LTE_RETRY_MS;
+		antenna_apply();
+		mdx_mutex_unlock(&antenna_mtx);
+		return (antenna_lte_probe_next());
+	}
+
+	state.rsrp[ANTENNA_ONBOARD] = lte_rsrp[ANTENNA_ONBOARD];
+	state.rsrp[ANTENNA_UFL] = lte_rsrp[ANTENNA_UFL];
+	sel = antenna_pick(state.lte_sel, state.rsrp, ANTENNA_LTE_HYST);
+	lte_next = clock_ms() + ANTENNA_LTE_PERIOD_MS;
+	antenna_apply();
+	mdx_mutex_unlock(&antenna_mtx);
+
+	printf("%s: rsrp onboard %d u.FL %d dBm\n", __func__,
+	    lte_rsrp[ANTENNA_ONBOARD], lte_rsrp[ANTENNA_UFL]);
+
+	if (sel != state.lte_sel) {
+		printf("%s: LTE switched to %s\n", __func__,
+		    sel == ANTENNA_ONBOARD ? "onboard" : "u.FL");
+		mdx_mutex_lock(&antenna_mtx);
+		state.lte_sel = sel;
+		switches++;
+		antenna_apply();
+		mdx_mutex_unlock(&antenna_mtx);
+		antenna_save();
+	}
+
+	return (antenna_lte_probe_next());
+}
+
+/*
+ * Whether a probe is in progress, the antenna must stay on LTE.
+ */
+bool
+antenna_lte_probing(void)
+{
+
+	return (lte_probe >= 0);
+}
+
+/*
+ * Stop a probe in progress, to use the link. It is retried later.
+ */
+void
+antenna_lte_probe_abort(void)
+{
+
+	if (lte_probe < 0)
+		return;
+
+	mdx_mutex_lock(&antenna_mtx);
+	lte_probe = -1;
+	lte_next = clock_ms() + ANTENNA_LTE_RETRY_MS;
+	antenna_apply();
+	mdx_mutex_unlock(&antenna_mtx);
+}
+
+/*
+ * Account a PVT frame. Called from the GNSS thread.
+ */
+void
+antenna_gnss_pvt(nrf_gnss_pvt_data_frame_t *pvt)
+{
+	nrf_gnss_sv_t *sv;
+	bool save;
+	int sel;
+	int i;
+
+	/* No tracking is happening. */
+	if (pvt->flags & NRF_GNSS_PVT_FLAG_NOT_ENOUGH_WINDOW_TIME)
+		return;
+
+	save = false;
+
+	mdx_mutex_lock(&antenna_mtx);
+	if (gnss_probe < 0) {
+		if ((int32_t)(clock_ms() - gnss_next) < 0) {
+			mdx_mutex_unlock(&antenna_mtx);
+			return;
+		}
+
+		/* Start with the onboard path. */
+		gnss_probe = ANTENNA_ONBOARD;
+		gnss_frames = 0;
+		gnss_sum = 0;
+		gnss_nsv = 0;
+		antenna_apply();
+		mdx_mutex_unlock(&antenna_mtx);
+		return;
+	}
+
+	for (i = 0; i < NRF_GNSS_MAX_SATELLITES; i++) {
+		sv = &pvt->sv[i];
+		if (sv->sv > 0 && sv->cn0 > 0) {
+			gnss_sum += sv->cn0;
+			gnss_nsv++;
+		}
+	}
+
+	if (++gnss_frames < ANTENNA_GNSS_FRAMES) {
+		mdx_mutex_unlock(&antenna_mtx);
+		return;
+	}
+
+	state.cn0[gnss_probe] = gnss_nsv ? gnss_sum / gnss_nsv : 0;
+	gnss_frames = 0;
+	gnss_sum = 0;
+	gnss_nsv = 0;
+
+	if (gnss_probe == ANTENNA_ONBOARD) {
+		gnss_probe = ANTENNA_UFL;
+		antenna_apply();
+		mdx_mutex_unlock(&antenna_mtx);
+		return;
+	}
+
+	gnss_probe = -1;
+	gnss_probes++;
+	gnss_next = clock_ms() + ANTENNA_GNSS_PERIOD_MS;
+
+	sel = antenna_pick(state.gnss_sel, state.cn0, ANTENNA_GNSS_HYST);
+	if (sel != state.gnss_sel) {
+		state.gnss_sel = sel;
+		switches++;
+		save = true;
+	}
+	antenna_apply();
+	mdx_mutex_unlock(&antenna_mtx);
+
+	printf("%s: cn0 onboard %d u.FL %d, using %s\n", __func__,
+	    state.cn0[ANTENNA_ONBOARD], state.cn0[ANTENNA_UFL],
+	    state.gnss_sel == ANTENNA_ONBOARD ? "onboard" : "u.FL");
+
+	if (save)
+		antenna_save();
+}
+
+void
+antenna_init(void)
+{
+	struct antenna_state tmp;
+
+	mdx_mutex_init(&antenna_mtx);
+
+	gpio = board_device("nrf_gpio", 0);
+	if (!gpio)
+		panic("gpio dev not found");
+
+	state.magic = ANTENNA_MAGIC;
+	state.lte_sel = ANTENNA_ONBOARD;
+	state.gnss_sel = ANTENNA_ONBOARD;
+	state.rsrp[ANTENNA_ONBOARD] = ANTENNA_RSRP_INVALID;
+	state.rsrp[ANTENNA_UFL] = ANTENNA_RSRP_INVALID;
+
+	if (load_state(ANTENNA_STATE, &tmp, sizeof(tmp)) == 0 &&
+	    tmp.magic == ANTENNA_MAGIC) {
+		state = tmp;
+		printf("%s: LTE %s, GNSS %s\n", __func__,
+		    state.lte_sel == ANTENNA_ONBOARD ? "onboard" : "u.FL",
+		    state.gnss_sel == ANTENNA_ONBOARD ? "onboard" : "u.FL");
+	}
+
+	sw_init();
+
+	route_gps = false;
+	antenna_apply();
+
+	metrics_register(&antenna_group);
+}
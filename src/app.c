@@ -25,11 +25,98 @@
  */
 
 #include <sys/cdefs.h>
+#include <sys/mutex.h>
 
 #include <lib/cJSON/cJSON.h>
 
 #include "sensor.h"
 #include "app.h"
+#include "arena.h"
+#include "clock.h"
+#include "cpu.h"
+#include "heap.h"
+#include "metrics.h"
+
+/*
+ * The JSON document of a report, nodes and output string, is built in
+ * an arena and dropped at once by app_release() after the publication.
+ * Blocks that do not fit fall back to the heap. One report is built at
+ * a time: app1() takes app_mtx and app_release() drops it, so the
+ * publisher and the shell benchmark do not share the arena or the
+ * sensor.
+ *
+ * The counters cover the last report, so the cost with and without
+ * APP_ARENA can be compared.
+ */
+
+#define	APP_ARENA
+#define	APP_ARENA_SIZE		2048
+
+#ifdef APP_ARENA
+static uint64_t app_arena_buf[APP_ARENA_SIZE / sizeof(uint64_t)];
+static struct arena app_arena;
+#endif
+
+static struct mdx_mutex app_mtx;
+static uint32_t app_reports;
+static uint32_t app_allocs;
+static uint32_t app_frees;
+static uint32_t app_build_cycles;
+static uint32_t app_cycles;
+
+static const struct metric app_metrics[] = {
+	METRIC_U32("reports", &app_reports),
+	METRIC_U32("allocs", &app_allocs),
+	METRIC_U32("frees", &app_frees),
+	METRIC_U32("cycles", &app_cycles),
+#ifdef APP_ARENA
+	METRIC_U32("arena_peak", &app_arena.peak),
+	METRIC_U32("arena_fails", &app_arena.fails),
+#endif
+};
+
+static struct metrics_group app_group = {
+	.name = "app",
+	.metrics = app_metrics,
+	.nmetrics = nitems(app_metrics),
+};
+
+static void *
+app_json_malloc(size_t size)
+{
+#ifdef APP_ARENA
+	void *ptr;
+#endif
+
+	app_allocs++;
+
+#ifdef APP_ARENA
+	ptr = arena_alloc(&app_arena, size);
+	if (ptr != NULL)
+		return (ptr);
+#endif
+
+	return (heap_alloc(HEAP_TAG_JSON, size));
+}
+
+static void
+app_json_free(void *ptr)
+{
+
+	app_frees++;
+
+#ifdef APP_ARENA
+	if (arena_owns(&app_arena, ptr))
+		return;
+#endif
+
+	heap_free(ptr);
+}
+
+static cJSON_Hooks app_json_hooks = {
+	.malloc_fn = app_json_malloc,
+	.free_fn = app_json_free,
+};
 
 static int
 ecompass_get(cJSON *obj)
@@ -59,14 +146,40 @@ ecompass_get(cJSON *obj)
 	return (0);
 }
 
+static void
+health_get(cJSON *obj)
+{
+
+	cJSON_AddItemToObject(obj, "heap_peak",
+	    cJSON_CreateNumber(heap_total_peak));
+	cJSON_AddItemToObject(obj, "heap_largest",
+	    cJSON_CreateNumber(heap_largest_free));
+	cJSON_AddItemToObject(obj, "heap_frag",
+	    cJSON_CreateNumber(heap_frag));
+	cJSON_AddItemToObject(obj, "cpu_duty",
+	    cJSON_CreateNumber(cpu_duty_permille));
+}
+
+/*
+ * The returned string is released with app_release(), which must be
+ * called even if it is NULL.
+ */
 char *
 app1(void)
 {
 	cJSON *obj;
 	cJSON *ecompass;
+	cJSON *health;
+	uint32_t t0;
 	char *str;
 
-	cJSON_InitHooks(NULL);
+	mdx_mutex_lock(&app_mtx);
+
+	app_allocs = 0;
+	app_frees = 0;
+	t0 = clock_cycles();
+
+	cJSON_InitHooks(&app_json_hooks);
 
 	obj = cJSON_CreateObject();
 	ecompass = cJSON_CreateObject();
@@ -75,11 +188,49 @@ app1(void)
 
 	cJSON_AddItemToObject(obj, "ecompass", ecompass);
 
-	str = cJSON_Print(obj);
+	health = cJSON_CreateObject();
+	health_get(health);
+	cJSON_AddItemToObject(obj, "health", health);
 
-	printf("Str: %s\n", str);
+	str = cJSON_Print(obj);
 
 	cJSON_Delete(obj);
 
+	app_build_cycles = clock_cycles() - t0;
+
+	printf("Str: %s\n", str);
+
 	return (str);
 }
+
+void
+app_release(char *str)
+{
+	uint32_t t0;
+
+	t0 = clock_cycles();
+
+	if (str != NULL)
+		app_json_free(str);
+#ifdef APP_ARENA
+	arena_reset(&app_arena);
+#endif
+
+	app_cycles = app_build_cycles + clock_cycles() - t0;
+	app_reports++;
+
+	mdx_mutex_unlock(&app_mtx);
+}
+
+void
+app_init(void)
+{
+
+	mdx_mutex_init(&app_mtx);
+
+#ifdef APP_ARENA
+	arena_init(&app_arena, app_arena_buf, APP_ARENA_SIZE);
+#endif
+
+	metrics_register(&app_group);
+}
@@ -27,6 +27,8 @@
 #ifndef _SRC_APP_H_
 #define	_SRC_APP_H_
 
+void app_init(void);
 char *app1(void);
+void app_release(char *str);
 
 #endif /* !_SRC_APP_H_ */
@@ -0,0 +1,78 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+
+#include "arena.h"
+
+#define	ARENA_ALIGN	8
+
+void
+arena_init(struct arena *a, void *buf, uint32_t size)
+{
+
+	a->base = buf;
+	a->size = size;
+	a->used = 0;
+	a->peak = 0;
+	a->nallocs = 0;
+	a->fails = 0;
+}
+
+void *
+arena_alloc(struct arena *a, uint32_t size)
+{
+	void *ptr;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	if (size > a->size - a->used) {
+		a->fails++;
+		return (NULL);
+	}
+
+	ptr = a->base + a->used;
+	a->used += size;
+	if (a->used > a->peak)
+		a->peak = a->used;
+	a->nallocs++;
+
+	return (ptr);
+}
+
+int
+arena_owns(struct arena *a, void *ptr)
+{
+
+	return ((uint8_t *)ptr >= a->base &&
+	    (uint8_t *)ptr < a->base + a->size);
+}
+
+void
+arena_reset(struct arena *a)
+{
+
+	a->used = 0;
+}
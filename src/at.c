@@ -0,0 +1,437 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+#include <sys/mutex.h>
+
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+#include <nrfxlib/bsdlib/include/bsd.h>
+#include <nrfxlib/bsdlib/include/bsd_os.h>
+
+#include "at.h"
+#include "board.h"
+#include "cpu.h"
+#include "metrics.h"
+#include "stack.h"
+
+/*
+ * AT command engine.
+ *
+ * A single AT socket is shared by all the users. Commands are queued
+ * and sent one at a time. The AT thread blocks in nrf_recv() and
+ * either completes the command in flight or dispatches the
+ * unsolicited result codes to the subscribers.
+ *
+ * A synchronous command that times out while queued is simply
+ * dropped. One that times out in flight is abandoned: its response is
+ * still due, so the engine keeps the slot busy and discards the next
+ * final result code instead of crediting it to the next command.
+ */
+
+#define	AT_TIMEOUT_US		10000000
+#define	AT_RX_SIZE		512
+
+#define	AT_DEBUG
+#undef	AT_DEBUG
+
+#ifdef	AT_DEBUG
+#define	dprintf(fmt, ...)	printf(fmt, ##__VA_ARGS__)
+#else
+#define	dprintf(fmt, ...)
+#endif
+
+static struct mdx_mutex at_mtx;
+static struct entry at_queue;
+static struct entry at_urcs;
+static struct at_req *inflight;
+static int abandoned;		/* The command in flight has timed out */
+static char rxbuf[AT_RX_SIZE];
+static int at_fd;
+static struct cpu_acct at_acct = { .name = "at" };
+
+static uint32_t at_ncmds;
+static uint32_t at_nerrors;
+static uint32_t at_ntimeouts;
+static uint32_t at_nurcs;
+static uint32_t at_nstale;
+
+static const struct metric at_metrics[] = {
+	METRIC_U32("cmds", &at_ncmds),
+	METRIC_U32("errors", &at_nerrors),
+	METRIC_U32("timeouts", &at_ntimeouts),
+	METRIC_U32("urcs", &at_nurcs),
+	METRIC_U32("stale", &at_nstale),
+};
+
+static struct metrics_group at_group = {
+	.name = "at",
+	.metrics = at_metrics,
+	.nmetrics = nitems(at_metrics),
+};
+
+/*
+ * Find the final result code of a response.
+ * Returns AT_RESULT_NONE if buf has no final result code. Otherwise
+ * bodylen is set to the length of the response without it.
+ */
+int
+at_parse(const char *buf, int *error, int *bodylen)
+{
+	const char *line;
+	int len;
+	int end;
+
+	len = strlen(buf);
+
+	/* Strip the trailing line terminators. */
+	end = len;
+	while (end > 0 && (buf[end - 1] == '\r' || buf[end - 1] == '\n'))
+		end--;
+	if (end == 0)
+		return (AT_RESULT_NONE);
+
+	/* Find the last line. */
+	line = buf + end;
+	while (line > buf && line[-1] != '\n')
+		line--;
+
+	*error = 0;
+	*bodylen = line - buf;
+
+	if (strncmp(line, "OK", end - (line - buf)) == 0 &&
+	    end - (line - buf) == 2)
+		return (AT_RESULT_OK);
+
+	if (strncmp(line, "ERROR", 5) == 0)
+		return (AT_RESULT_ERROR);
+
+	if (strncmp(line, "+CME ERROR: ", 12) == 0) {
+		*error = atoi(line + 12);
+		return (AT_RESULT_CME_ERROR);
+	}
+
+	if (strncmp(line, "+CMS ERROR: ", 12) == 0) {
+		*error = atoi(line + 12);
+		return (AT_RESULT_CMS_ERROR);
+	}
+
+	return (AT_RESULT_NONE);
+}
+
+/*
+ * Copy the next comma-separated field with the quotes stripped.
+ */
+char *
+at_field(char **t, char *buf, int size)
+{
+	char *p;
+	int len;
+
+	p = strsep(t, ",");
+	if (p == NULL)
+		return (NULL);
+
+	if (*p == '"')
+		p++;
+	len = strlen(p);
+	if (len > 0 && p[len - 1] == '"')
+		len--;
+	if (len >= size)
+		len = size - 1;
+	memcpy(buf, p, len);
+	buf[len] = '\0';
+
+	return (buf);
+}
+
+static void
+at_dispatch(char *buf)
+{
+	struct at_urc *urc;
+	struct entry *e;
+	char *line;
+	char *t;
+
+	t = buf;
+
+	while ((line = strsep(&t, "\r\n")) != NULL) {
+		if (*line == '\0')
+			continue;
+
+		dprintf("%s: %s\n", __func__, line);
+
+		at_nurcs++;
+
+		for (e = at_urcs.next; e != &at_urcs; e = e->next) {
+			urc = CONTAINER_OF(e, struct at_urc, node);
+			if (strncmp(line, urc->prefix,
+			    strlen(urc->prefix)) == 0)
+				urc->cb(line, urc->arg);
+		}
+	}
+}
+
+static void
+at_complete(struct at_req *req)
+{
+
+	if (req->result != AT_RESULT_OK)
+		at_nerrors++;
+
+	if (req->cb != NULL)
+		req->cb(req);
+}
+
+/*
+ * Send the next queued command. Called with at_mtx held.
+ * Returns the request if it could not be sent.
+ */
+static struct at_req *
+at_start(void)
+{
+	struct at_req *req;
+	int len;
+
+	if (inflight != NULL || abandoned || list_empty(&at_queue))
+		return (NULL);
+
+	req = CONTAINER_OF(at_queue.next, struct at_req, node);
+	list_remove(&req->node);
+	req->state = AT_REQ_INFLIGHT;
+
+	dprintf("%s: %s\n", __func__, req->cmd);
+
+	at_ncmds++;
+
+	len = strlen(req->cmd);
+	if (nrf_send(at_fd, req->cmd, len, 0) != len) {
+		req->result = AT_RESULT_ERROR;
+		req->state = AT_REQ_DONE;
+		return (req);
+	}
+
+	inflight = req;
+
+	return (NULL);
+}
+
+static void
+at_run(void)
+{
+	struct at_req *req;
+
+	do {
+		mdx_mutex_lock(&at_mtx);
+		req = at_start();
+		mdx_mutex_unlock(&at_mtx);
+		if (req != NULL)
+			at_complete(req);
+	} while (req != NULL);
+}
+
+static void
+at_thread(void *arg)
+{
+	struct at_req *req;
+	int bodylen;
+	int result;
+	int error;
+	int len;
+
+	cpu_acct_enter(&at_acct);
+
+	while (1) {
+		cpu_acct_exit(&at_acct);
+		len = nrf_recv(at_fd, rxbuf, AT_RX_SIZE - 1, 0);
+		cpu_acct_enter(&at_acct);
+		if (len <= 0) {
+			printf("%s: recv failed, err %d\n", __func__, len);
+			mdx_usleep(100000);
+			continue;
+		}
+		rxbuf[len] = '\0';
+
+		result = at_parse(rxbuf, &error, &bodylen);
+		if (result == AT_RESULT_NONE) {
+			at_dispatch(rxbuf);
+			continue;
+		}
+
+		mdx_mutex_lock(&at_mtx);
+		req = inflight;
+		inflight = NULL;
+		if (req != NULL)
+			req->state = AT_REQ_DONE;
+		else if (abandoned) {
+			/* The response of a timed out command. */
+			abandoned = 0;
+			at_nstale++;
+		}
+		mdx_mutex_unlock(&at_mtx);
+
+		if (req == NULL) {
+			dprintf("%s: stray response %s\n", __func__, rxbuf);
+			at_run();
+			continue;
+		}
+
+		if (req->resp != NULL && req->resp_size > 0) {
+			if (bodylen >= req->resp_size)
+				bodylen = req->resp_size - 1;
+			memcpy(req->resp, rxbuf, bodylen);
+			req->resp[bodylen] = '\0';
+		}
+		req->result = result;
+		req->error = error;
+
+		at_complete(req);
+		at_run();
+	}
+}
+
+/*
+ * Queue a command. req->cb is called from the AT thread once the
+ * response is received.
+ */
+void
+at_cmd_async(struct at_req *req)
+{
+
+	req->result = AT_RESULT_TIMEOUT;
+	req->error = 0;
+	req->state = AT_REQ_QUEUED;
+
+	mdx_mutex_lock(&at_mtx);
+	list_append(&at_queue, &req->node);
+	mdx_mutex_unlock(&at_mtx);
+
+	at_run();
+}
+
+static void
+at_cmd_done(struct at_req *req)
+{
+
+	mdx_sem_post(&req->done);
+}
+
+/*
+ * Send a command and wait for the result.
+ * The response body, if any, is copied to resp.
+ */
+int
+at_cmd(const char *cmd, char *resp, int resp_size)
+{
+	struct at_req req;
+	int err;
+
+	req.cmd = cmd;
+	req.resp = resp;
+	req.resp_size = resp_size;
+	req.cb = at_cmd_done;
+	req.arg = NULL;
+	mdx_sem_init(&req.done, 0);
+
+	if (resp != NULL && resp_size > 0)
+		resp[0] = '\0';
+
+	at_cmd_async(&req);
+
+	err = mdx_sem_timedwait(&req.done, AT_TIMEOUT_US);
+	if (err == 0) {
+		mdx_mutex_lock(&at_mtx);
+		switch (req.state) {
+		case AT_REQ_QUEUED:
+			list_remove(&req.node);
+			/*
+			 * Stuck behind an abandoned command: the modem
+			 * has lost that response, don't wait for it.
+			 */
+			abandoned = 0;
+			err = 1;
+			break;
+		case AT_REQ_INFLIGHT:
+			/* Let the AT thread discard the late response. */
+			inflight = NULL;
+			abandoned = 1;
+			err = 1;
+			break;
+		}
+		mdx_mutex_unlock(&at_mtx);
+
+		if (err) {
+			/* Timed out. */
+			printf("%s: %s timed out\n", __func__, cmd);
+			at_ntimeouts++;
+			at_run();
+			return (AT_RESULT_TIMEOUT);
+		}
+
+		/* Completed in the meantime. */
+		mdx_sem_wait(&req.done);
+	}
+
+	if (req.result != AT_RESULT_OK)
+		printf("%s: %s failed, result %d error %d\n", __func__,
+		    cmd, req.result, req.error);
+
+	return (req.result);
+}
+
+void
+at_urc_register(struct at_urc *urc)
+{
+
+	mdx_mutex_lock(&at_mtx);
+	list_append(&at_urcs, &urc->node);
+	mdx_mutex_unlock(&at_mtx);
+}
+
+void
+at_init(void)
+{
+	struct thread *td;
+
+	mdx_mutex_init(&at_mtx);
+	list_init(&at_queue);
+	list_init(&at_urcs);
+	cpu_acct_register(&at_acct);
+
+	at_fd = nrf_socket(NRF_AF_LTE, NRF_SOCK_DGRAM, NRF_PROTO_AT);
+	if (at_fd < 0)
+		panic("failed to create AT socket\n");
+
+	td = mdx_thread_create("at", PRIO_NORMAL, 0, 2048, at_thread, NULL);
+	if (td == NULL)
+		panic("failed to create AT thread\n");
+	stack_watch(td);
+	mdx_sched_add(td);
+
+	metrics_register(&at_group);
+}
@@ -0,0 +1,77 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_AT_H_
+#define	_SRC_AT_H_
+
+#define	LC_MAX_READ_LENGTH	128
+
+/* Final result codes */
+#define	AT_RESULT_NONE		1	/* Not a response, i.e. a URC */
+#define	AT_RESULT_OK		0
+#define	AT_RESULT_ERROR		-1
+#define	AT_RESULT_CME_ERROR	-2
+#define	AT_RESULT_CMS_ERROR	-3
+#define	AT_RESULT_TIMEOUT	-4
+
+/* Request states, protected by the engine lock */
+#define	AT_REQ_QUEUED		0
+#define	AT_REQ_INFLIGHT		1
+#define	AT_REQ_DONE		2
+
+struct at_req {
+	struct entry	node;
+	int		state;
+	const char	*cmd;
+	char		*resp;		/* Response body, optional */
+	int		resp_size;
+	int		result;
+	int		error;		/* +CME/+CMS error code */
+	void		(*cb)(struct at_req *req);
+	void		*arg;
+	mdx_sem_t	done;
+};
+
+/*
+ * Unsolicited result code subscriber.
+ * The callback runs in the AT thread and must not issue AT commands
+ * synchronously.
+ */
+struct at_urc {
+	const char	*prefix;
+	void		(*cb)(const char *line, void *arg);
+	void		*arg;
+	struct entry	node;
+};
+
+void at_init(void);
+int at_cmd(const char *cmd, char *resp, int resp_size);
+void at_cmd_async(struct at_req *req);
+void at_urc_register(struct at_urc *urc);
+int at_parse(const char *buf, int *error, int *bodylen);
+char *at_field(char **t, char *buf, int size);
+
+#endif /* !_SRC_AT_H_ */
@@ -0,0 +1,531 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#ifndef BENCH_QEMU
+#include <arm/nordicsemi/nrf9160.h>
+#endif
+
+#include <dev/intc/intc.h>
+
+#include <mbedtls/certs.h>
+#include <mbedtls/cipher.h>
+#include <mbedtls/ecdh.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/pk.h>
+#include <mbedtls/sha256.h>
+
+#include "app.h"
+#include "bench.h"
+#include "board.h"
+#include "clock.h"
+#include "disk.h"
+#include "heap.h"
+#include "sensor.h"
+
+#ifndef BENCH_QEMU
+/*
+ * Flash versus SRAM execution, in CPU cycles.
+ *
+ * The same loop and the same interrupt handler are built once in
+ * flash and once with __ramfunc. The interrupt latency is measured
+ * from the EGU3 task trigger to the first instruction of the handler.
+ * SHA-256 runs from SRAM as placed by ldscript.
+ */
+
+#define	EGU3_BASE		0x4001e000	/* EGU3_NS */
+#define	EGU_TASKS_TRIGGER0	0x000
+#define	EGU_EVENTS_TRIGGERED0	0x100
+#define	EGU_INTENSET		0x304
+#define	EGU_INTENCLR		0x308
+#define	EGU_REG(reg)		(*(volatile uint32_t *)(EGU3_BASE + (reg)))
+
+#define	BENCH_WORDS		256
+#define	BENCH_IRQ_RUNS		16
+#define	BENCH_SHA_SIZE		1024
+
+static uint32_t bench_buf[BENCH_WORDS];
+static volatile uint32_t bench_isr_cycles;
+static volatile uint32_t bench_sink;	/* Keeps the loop results */
+
+static inline __attribute__((always_inline)) uint32_t
+bench_mix(const uint32_t *buf, int n)
+{
+	uint32_t h;
+	int i;
+
+	h = 0x811c9dc5;
+	for (i = 0; i < n; i++)
+		h = (h ^ buf[i]) * 0x01000193;
+
+	return (h);
+}
+
+static uint32_t __attribute__((noinline))
+bench_loop_flash(const uint32_t *buf, int n)
+{
+
+	return (bench_mix(buf, n));
+}
+
+static uint32_t __ramfunc
+bench_loop_ram(const uint32_t *buf, int n)
+{
+
+	return (bench_mix(buf, n));
+}
+
+static void
+bench_intr_flash(void *arg, int irq)
+{
+
+	bench_isr_cycles = clock_cycles();
+	EGU_REG(EGU_EVENTS_TRIGGERED0) = 0;
+}
+
+static void __ramfunc
+bench_intr_ram(void *arg, int irq)
+{
+
+	bench_isr_cycles = clock_cycles();
+	EGU_REG(EGU_EVENTS_TRIGGERED0) = 0;
+}
+
+static uint32_t
+bench_irq_latency(mdx_device_t nvic, void (*handler)(void *arg, int irq))
+{
+	uint32_t total;
+	uint32_t t0;
+	int timeout;
+	int i, n;
+
+	mdx_intc_setup(nvic, ID_EGU3, handler, NULL);
+	mdx_intc_set_prio(nvic, ID_EGU3, 0);
+	mdx_intc_enable(nvic, ID_EGU3);
+	EGU_REG(EGU_INTENSET) = 1;
+
+	total = 0;
+	n = 0;
+	for (i = 0; i < BENCH_IRQ_RUNS; i++) {
+		bench_isr_cycles = 0;
+		t0 = clock_cycles();
+		EGU_REG(EGU_TASKS_TRIGGER0) = 1;
+		for (timeout = 10000; bench_isr_cycles == 0 && timeout > 0;
+		    timeout--)
+			;
+		/* The handler did not run, don't count it. */
+		if (bench_isr_cycles == 0)
+			continue;
+		total += bench_isr_cycles - t0;
+		n++;
+	}
+
+	EGU_REG(EGU_INTENCLR) = 1;
+	mdx_intc_disable(nvic, ID_EGU3);
+
+	if (n == 0)
+		return (0);
+
+	return (total / n);
+}
+
+void
+bench_ramfunc(void)
+{
+	uint8_t digest[32];
+	uint32_t flash, ram;
+	mdx_device_t nvic;
+	uint32_t t0;
+	int i;
+
+	for (i = 0; i < BENCH_WORDS; i++)
+		bench_buf[i] = i * 0x9e3779b9;
+
+	t0 = clock_cycles();
+	bench_sink = bench_loop_flash(bench_buf, BENCH_WORDS);
+	flash = clock_cycles() - t0;
+
+	t0 = clock_cycles();
+	bench_sink = bench_loop_ram(bench_buf, BENCH_WORDS);
+	ram = clock_cycles() - t0;
+
+	printf("%s: loop of %d words: flash %u cycles, sram %u cycles\n",
+	    __func__, BENCH_WORDS, flash, ram);
+
+	nvic = board_device("nvic", 0);
+	if (nvic == NULL)
+		return;
+
+	flash = bench_irq_latency(nvic, bench_intr_flash);
+	ram = bench_irq_latency(nvic, bench_intr_ram);
+
+	printf("%s: irq latency: flash %u cycles, sram %u cycles\n",
+	    __func__, flash, ram);
+
+	t0 = clock_cycles();
+	mbedtls_sha256_ret((const uint8_t *)bench_buf, BENCH_SHA_SIZE,
+	    digest, 0);
+	printf("%s: sha256 of %d bytes: %u cycles\n", __func__,
+	    BENCH_SHA_SIZE, clock_cycles() - t0);
+}
+#endif /* !BENCH_QEMU */
+
+/*
+ * Benchmark suite of the hot paths, on fixed data. Each benchmark is
+ * run a number of times and reported in CPU cycles as one line
+ *
+ *	#B <name> <runs> <min> <avg> <max>
+ *
+ * and the suite ends with "#B end". The teardown of a benchmark runs
+ * after the runs, or after its setup has failed, in which case the
+ * benchmark is skipped. tools/bench.py collects the lines
+ * from the console of the board or of the QEMU image (mdepx-bench.conf)
+ * and compares them with a baseline.
+ *
+ * The record benchmark is the AEAD transform mbedtls_ssl_write()
+ * applies to each record: there is no server to complete a handshake
+ * with, and the library is built without the server side.
+ */
+
+#define	BENCH_FILE		"rootca.pem"
+#define	BENCH_FILE_SIZE		1200
+#define	BENCH_RECORD_SIZE	1024
+
+struct bench {
+	const char	*name;
+	int		(*setup)(void);
+	void		(*run)(void);
+	void		(*teardown)(void);
+	int		runs;
+};
+
+static uint32_t bench_seed;
+static struct ecompass_data bench_ecompass_data;
+static uint8_t bench_record[BENCH_RECORD_SIZE];
+static uint8_t bench_out[BENCH_RECORD_SIZE];
+static mbedtls_cipher_context_t bench_cipher;
+static mbedtls_ecp_group bench_grp;
+static mbedtls_entropy_context bench_entropy;
+#ifdef MBEDTLS_CERTS_C
+static mbedtls_pk_context bench_pk;
+static uint8_t bench_sig[512];
+static size_t bench_siglen;
+#endif
+
+/*
+ * Deterministic, so that the scalars and the blinding values, and with
+ * them the cycle counts, are the same from run to run.
+ */
+static int
+bench_rng(void *arg, unsigned char *buf, size_t len)
+{
+	uint32_t x;
+	size_t i;
+
+	x = bench_seed;
+	for (i = 0; i < len; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		buf[i] = x;
+	}
+	bench_seed = x;
+
+	return (0);
+}
+
+static void
+bench_ecompass(void)
+{
+
+	mc6470_ecompass(&bench_ecompass_data, -120, 80, 310, 150, -90, 4010);
+}
+
+static void
+bench_app(void)
+{
+	char *str;
+
+	str = app1();
+	app_release(str);
+}
+
+static int
+bench_read_file_setup(void)
+{
+#ifdef BENCH_QEMU
+	int err;
+	int i;
+
+	for (i = 0; i < BENCH_FILE_SIZE; i++)
+		bench_out[i % BENCH_RECORD_SIZE] = 'A' + i % 26;
+
+	err = disk_format();
+	if (err == 0)
+		err = write_file(BENCH_FILE, bench_out, BENCH_RECORD_SIZE);
+
+	return (err);
+#else
+	/* The certificate is on the disk of the board already. */
+	return (0);
+#endif
+}
+
+static void
+bench_read_file(void)
+{
+	uint32_t size;
+	void *addr;
+
+	if (read_file(BENCH_FILE, &addr, &size) == 0)
+		heap_free(addr);
+}
+
+static void
+bench_sha256(void)
+{
+
+	mbedtls_sha256_ret(bench_record, BENCH_RECORD_SIZE, bench_out, 0);
+}
+
+static int
+bench_record_setup(void)
+{
+	const mbedtls_cipher_info_t *info;
+	uint8_t key[16];
+
+	mbedtls_cipher_init(&bench_cipher);
+
+	bench_rng(NULL, key, sizeof(key));
+	bench_rng(NULL, bench_record, sizeof(bench_record));
+
+#if defined(MBEDTLS_GCM_C)
+	info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_GCM);
+#elif defined(MBEDTLS_CCM_C)
+	info = mbedtls_cipher_info_from_type(MBEDTLS_CIPHER_AES_128_CCM);
+#else
+	info = NULL;
+#endif
+	if (info == NULL)
+		return (-1);
+
+	if (mbedtls_cipher_setup(&bench_cipher, info) != 0)
+		return (-1);
+
+	return (mbedtls_cipher_setkey(&bench_cipher, key, 128,
+	    MBEDTLS_ENCRYPT));
+}
+
+static void
+bench_record_teardown(void)
+{
+
+	mbedtls_cipher_free(&bench_cipher);
+}
+
+static void
+bench_record_run(void)
+{
+	static const uint8_t iv[12];
+	uint8_t ad[13];
+	uint8_t tag[16];
+	size_t olen;
+
+	memset(ad, 0x17, sizeof(ad));
+	mbedtls_cipher_auth_encrypt(&bench_cipher, iv, sizeof(iv),
+	    ad, sizeof(ad), bench_record, BENCH_RECORD_SIZE,
+	    bench_out, &olen, tag, sizeof(tag));
+}
+
+static int
+bench_ecdh_setup(void)
+{
+
+	mbedtls_ecp_group_init(&bench_grp);
+
+	return (mbedtls_ecp_group_load(&bench_grp, MBEDTLS_ECP_DP_SECP256R1));
+}
+
+static void
+bench_ecdh_teardown(void)
+{
+
+	mbedtls_ecp_group_free(&bench_grp);
+}
+
+/*
+ * The client side of ECDHE: the ephemeral key and the shared secret.
+ */
+static void
+bench_ecdh(void)
+{
+	mbedtls_ecp_point q;
+	mbedtls_mpi d, z;
+
+	mbedtls_mpi_init(&d);
+	mbedtls_mpi_init(&z);
+	mbedtls_ecp_point_init(&q);
+
+	if (mbedtls_ecdh_gen_public(&bench_grp, &d, &q, bench_rng,
+	    NULL) == 0)
+		mbedtls_ecdh_compute_shared(&bench_grp, &z, &q, &d,
+		    bench_rng, NULL);
+
+	mbedtls_ecp_point_free(&q);
+	mbedtls_mpi_free(&z);
+	mbedtls_mpi_free(&d);
+}
+
+#ifdef MBEDTLS_CERTS_C
+static int
+bench_rsa_setup(void)
+{
+	int err;
+
+	mbedtls_pk_init(&bench_pk);
+	err = mbedtls_pk_parse_key(&bench_pk,
+	    (const uint8_t *)mbedtls_test_cli_key_rsa,
+	    mbedtls_test_cli_key_rsa_len, NULL, 0);
+	if (err)
+		return (err);
+
+	return (mbedtls_pk_sign(&bench_pk, MBEDTLS_MD_SHA256, bench_out, 32,
+	    bench_sig, &bench_siglen, bench_rng, NULL));
+}
+
+static void
+bench_rsa_teardown(void)
+{
+
+	mbedtls_pk_free(&bench_pk);
+}
+
+/* CertificateVerify of the client. */
+static void
+bench_rsa_sign(void)
+{
+
+	mbedtls_pk_sign(&bench_pk, MBEDTLS_MD_SHA256, bench_out, 32,
+	    bench_sig, &bench_siglen, bench_rng, NULL);
+}
+
+/* ServerKeyExchange and certificate signatures. */
+static void
+bench_rsa_verify(void)
+{
+
+	mbedtls_pk_verify(&bench_pk, MBEDTLS_MD_SHA256, bench_out, 32,
+	    bench_sig, bench_siglen);
+}
+#endif
+
+static int
+bench_entropy_setup(void)
+{
+
+	mbedtls_entropy_init(&bench_entropy);
+
+	return (0);
+}
+
+static void
+bench_entropy_teardown(void)
+{
+
+	mbedtls_entropy_free(&bench_entropy);
+}
+
+static void
+bench_entropy_run(void)
+{
+	uint8_t buf[32];
+
+	mbedtls_entropy_func(&bench_entropy, buf, sizeof(buf));
+}
+
+/* The RSA benchmarks set up the key each, verify needs the signature. */
+static const struct bench benches[] = {
+	{ "ecompass", NULL, bench_ecompass, NULL, 64 },
+	{ "app1", NULL, bench_app, NULL, 16 },
+	{ "read_file", bench_read_file_setup, bench_read_file, NULL, 16 },
+	{ "sha256_1k", NULL, bench_sha256, NULL, 32 },
+	{ "record_1k", bench_record_setup, bench_record_run,
+	    bench_record_teardown, 32 },
+	{ "ecdh_p256", bench_ecdh_setup, bench_ecdh, bench_ecdh_teardown, 4 },
+#ifdef MBEDTLS_CERTS_C
+	{ "rsa_sign", bench_rsa_setup, bench_rsa_sign, bench_rsa_teardown, 2 },
+	{ "rsa_verify", bench_rsa_setup, bench_rsa_verify,
+	    bench_rsa_teardown, 16 },
+#endif
+	{ "entropy", bench_entropy_setup, bench_entropy_run,
+	    bench_entropy_teardown, 16 },
+};
+
+void
+bench_suite(void)
+{
+	const struct bench *b;
+	uint32_t min, max;
+	uint64_t total;
+	uint32_t t;
+	int i, j;
+
+	bench_seed = 0x2545f491;
+
+	for (i = 0; i < nitems(benches); i++) {
+		b = &benches[i];
+		if (b->setup != NULL && b->setup() != 0) {
+			if (b->teardown != NULL)
+				b->teardown();
+			printf("#B %s failed\n", b->name);
+			continue;
+		}
+
+		min = 0xffffffff;
+		max = 0;
+		total = 0;
+		for (j = 0; j < b->runs; j++) {
+			t = clock_cycles();
+			b->run();
+			t = clock_cycles() - t;
+			if (t < min)
+				min = t;
+			if (t > max)
+				max = t;
+			total += t;
+		}
+
+		if (b->teardown != NULL)
+			b->teardown();
+
+		printf("#B %s %d %u %u %u\n", b->name, b->runs, min,
+		    (uint32_t)(total / b->runs), max);
+	}
+
+	printf("#B end\n");
+}
@@ -39,30 +39,97 @@
 #include <dev/uart/uart.h>
 
 #include "board.h"
+#include "clock.h"
+#include "devtab.h"
+#include "heap.h"
+#include "metrics.h"
 #include "sensor.h"
 
+#define	BOARD_CYCLES_PER_US	64
+
+/*
+ * The cost of bringing up the devices, with the DTB or the static
+ * device table: attach_us is the time spent and attach_heap the heap
+ * consumed by the device structures and softc.
+ */
+static uint32_t board_attach_us;
+static uint32_t board_attach_heap;
+
+static const struct metric board_metrics[] = {
+	METRIC_U32("attach_us", &board_attach_us),
+	METRIC_U32("attach_heap", &board_attach_heap),
+};
+
+static struct metrics_group board_group = {
+	.name = "board",
+	.metrics = board_metrics,
+	.nmetrics = nitems(board_metrics),
+};
+
+mdx_device_t
+board_device(const char *name, int unit)
+{
+#ifdef BOARD_DEVTAB
+	const struct devtab_entry *ent;
+	int i;
+
+	for (i = 0; i < devtab_ndevs; i++) {
+		ent = &devtab[i];
+		if (ent->unit == unit && strcmp(ent->name, name) == 0)
+			return (ent->dev);
+	}
+
+	return (NULL);
+#else
+	return (mdx_device_lookup_by_name(name, unit));
+#endif
+}
+
+void
+board_metrics_init(void)
+{
+
+	metrics_register(&board_group);
+}
+
 void
 board_init(void)
 {
 	struct nrf_gpiote_conf gconf;
 	mdx_device_t dev;
+	uint32_t avail;
 
 	/* Add some memory so OF could allocate devices and their softc. */
+#ifdef MALLOC_TLSF
+	heap_add_region((void *)0x20004000, 0x0c000);
+	heap_add_region((void *)0x20030000, 0x10000);
+#else
 	mdx_fl_init();
 	mdx_fl_add_region((void *)0x20004000, 0x0c000);
 	mdx_fl_add_region((void *)0x20030000, 0x10000);
+#endif
 
+	avail = heap_free_space();
+	clock_cycles_start();
+
+#ifdef BOARD_DEVTAB
+	devtab_attach();
+#else
 	mdx_of_install_dtbp((void *)0xf8000);
 	mdx_of_probe_devices();
+#endif
+
+	board_attach_us = clock_cycles() / BOARD_CYCLES_PER_US;
+	board_attach_heap = avail - heap_free_space();
 
-	dev = mdx_device_lookup_by_name("nrf_gpio", 0);
+	dev = board_device("nrf_gpio", 0);
 	if (!dev)
 		panic("gpio dev not found");
 	nrf_gpio_pincfg(dev, PIN_MC_INTA, 0);
 	mdx_gpio_configure(dev, PIN_MC_INTA, MDX_GPIO_INPUT);
 
 	/* Configure GPIOTE for mc6470. */
-	dev = mdx_device_lookup_by_name("nrf_gpiote", 0);
+	dev = board_device("nrf_gpiote", 0);
 	if (!dev)
 		panic("gpiote dev not found");
 	gconf.pol = GPIOTE_POLARITY_HITOLO;
@@ -71,10 +138,11 @@ board_init(void)
 	nrf_gpiote_config(dev, MC6470_GPIOTE_CFG_ID, &gconf);
 
 	/* Enable the instruction cache. */
-	dev = mdx_device_lookup_by_name("nrf_nvmc", 0);
+	dev = board_device("nrf_nvmc", 0);
 	if (!dev)
 		panic("nvmc dev not found");
 	nrf_nvmc_icache_control(dev, true);
 
-	printf("mdepx initialized\n");
+	printf("mdepx initialized, devices in %u us, %u bytes of heap\n",
+	    board_attach_us, board_attach_heap);
 }
@@ -31,6 +31,8 @@
 #define	UART_PIN_RX		15
 #define	UART_BAUDRATE		115200
 
+#define	PIN_TRACE_TX		17	/* Modem trace, UARTE2 */
+
 #define	PIN_LED1		30
 #define	PIN_LED2		31
 #define	PIN_SW1_CTL		27
@@ -45,7 +47,43 @@
 
 #define	MC6470_GPIOTE_CFG_ID	0
 
+/*
+ * Thread priorities, the higher value runs first (nprio in mdepx.conf).
+ * The background threads get the CPU only when the others are idle.
+ */
+#define	PRIO_BACKGROUND		1	/* Shell, log drain */
+#define	PRIO_NORMAL		2
+
+/*
+ * Place a function in SRAM, see ldscript. The calls to and from flash
+ * are out of the BL range, hence long_call.
+ */
+#define	__ramfunc	__attribute__((section(".ramfunc"), noinline, long_call))
+
+/* Static device table instead of probing the DTB, see devtab.c. */
+#define	BOARD_DEVTAB
+#undef	BOARD_DEVTAB
+
+/* TLSF application heap instead of fl, see heap.c. */
+#define	MALLOC_TLSF
+#undef	MALLOC_TLSF
+
+mdx_device_t board_device(const char *name, int unit);
+void board_metrics_init(void);
+
+/*
+ * Run-time state records, see disk.c: the flash page below the DTB,
+ * which is below the disk. QEMU has no DTB. See ldscript.
+ */
+#ifdef BENCH_QEMU
+/* mps2-an505: top of SSRAM1, secure alias. See ldscript-qemu. */
+#define	DISK_ADDRESS		0x103fc000
+#define	STATE_ADDRESS		(DISK_ADDRESS - 0x1000)
+#else
 #define	DISK_ADDRESS		0xfc000
+#define	STATE_ADDRESS		(DISK_ADDRESS - 0x4000 - 0x1000)
+#endif
 #define	DISK_SIZE		0x4000
+#define	STATE_SIZE		0x1000
 
 #endif /* !_SRC_BOARD_H_ */
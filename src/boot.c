@@ -0,0 +1,185 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include "board.h"
+#include "boot.h"
+#include "clock.h"
+#include "log.h"
+#include "metrics.h"
+#include "stack.h"
+
+/*
+ * Boot orchestrator.
+ *
+ * Each step runs on one of the lanes and starts once the steps it
+ * depends on are complete, so the independent steps of different lanes
+ * overlap. Lane 0 is the caller of boot_run(), the others get their
+ * own thread, which exits when its steps are done. A step that fails
+ * still completes: its dependents run and handle the error.
+ *
+ * The times are clock_ms(), i.e. since the RTC was started at boot.
+ */
+
+#define	BOOT_STACK_SIZE		8192
+
+static struct boot_step *boot_steps;
+static int boot_nsteps;
+static volatile uint32_t boot_done;
+static mdx_sem_t boot_sems[BOOT_NLANES];
+
+static uint32_t boot_ms;
+static uint32_t boot_first_publish_ms;
+
+static const struct metric boot_metrics[] = {
+	METRIC_U32("boot_ms", &boot_ms),
+	METRIC_U32("first_publish_ms", &boot_first_publish_ms),
+};
+
+static struct metrics_group boot_group = {
+	.name = "boot",
+	.metrics = boot_metrics,
+	.nmetrics = nitems(boot_metrics),
+};
+
+static void
+boot_wait(int lane, uint32_t mask)
+{
+
+	while ((boot_done & mask) != mask)
+		mdx_sem_wait(&boot_sems[lane]);
+}
+
+static void
+boot_complete(int step)
+{
+	int lane;
+
+	critical_enter();
+	boot_done |= BOOT_DEP(step);
+	critical_exit();
+
+	for (lane = 0; lane < BOOT_NLANES; lane++)
+		mdx_sem_post(&boot_sems[lane]);
+}
+
+static void
+boot_lane(int lane)
+{
+	struct boot_step *s;
+	int i;
+
+	for (i = 0; i < boot_nsteps; i++) {
+		s = &boot_steps[i];
+		if (s->lane != lane)
+			continue;
+
+		boot_wait(lane, s->deps);
+
+		s->start = clock_ms();
+		s->error = s->fn();
+		s->end = clock_ms();
+		if (s->error)
+			log_err("%s: %s failed, error %d\n", __func__,
+			    s->name, s->error);
+
+		boot_complete(i);
+	}
+}
+
+static void
+boot_thread(void *arg)
+{
+
+	boot_lane((uintptr_t)arg);
+
+	/* The thread exits. */
+	stack_unwatch(curthread);
+}
+
+void
+boot_run(struct boot_step *steps, int nsteps)
+{
+	struct thread *td;
+	int lane;
+
+	boot_steps = steps;
+	boot_nsteps = nsteps;
+	boot_done = 0;
+
+	for (lane = 0; lane < BOOT_NLANES; lane++)
+		mdx_sem_init(&boot_sems[lane], 0);
+
+	for (lane = 1; lane < BOOT_NLANES; lane++) {
+		td = mdx_thread_create("boot", PRIO_NORMAL, 0, BOOT_STACK_SIZE,
+		    boot_thread, (void *)(uintptr_t)lane);
+		if (td == NULL)
+			panic("failed to create boot thread\n");
+		stack_watch(td);
+		mdx_sched_add(td);
+	}
+
+	boot_lane(0);
+	boot_wait(0, BOOT_DEP(nsteps) - 1);
+
+	boot_ms = clock_ms();
+
+	metrics_register(&boot_group);
+
+	boot_stats();
+}
+
+void
+boot_first_publish(void)
+{
+
+	if (boot_first_publish_ms != 0)
+		return;
+
+	boot_first_publish_ms = clock_ms();
+	log_info("%s: first publish at %u ms\n", __func__,
+	    boot_first_publish_ms);
+}
+
+void
+boot_stats(void)
+{
+	struct boot_step *s;
+	int i;
+
+	for (i = 0; i < boot_nsteps; i++) {
+		s = &boot_steps[i];
+		printf("boot: %-8s lane %d %6u .. %6u ms (%u ms)%s\n",
+		    s->name, s->lane, s->start, s->end, s->end - s->start,
+		    s->error ? " failed" : "");
+	}
+	printf("boot: done at %u ms, first publish at %u ms\n",
+	    boot_ms, boot_first_publish_ms);
+}
@@ -25,6 +25,9 @@
  */
 
 #include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
 #include <sys/mutex.h>
 
 #include <arm/arm/nvic.h>
@@ -46,50 +49,50 @@
 #endif
 
 #include "board.h"
+#include "metrics.h"
+#include "mtrace.h"
+#include "trace.h"
+
+/*
+ * The RPC interrupt does not tell which context it concerns, so it
+ * wakes every sleeper. Each sleeper is dequeued as it is woken:
+ * interrupts that arrive before the thread runs do not post its
+ * semaphore again.
+ */
 
 void IPC_IRQHandler(void);
 
 struct sleeping_thread {
 	struct entry node;
 	mdx_sem_t sem;
+	int woken;
 };
 
 static struct mdx_mutex bsdos_mtx;
 static struct entry sleeping_thread_list;
 static mdx_device_t nvic;
 
-static struct sleeping_thread *
-td_first(void)
-{
-	struct sleeping_thread *td;
-
-	if (list_empty(&sleeping_thread_list))
-		return (NULL);
-
-	td = CONTAINER_OF(sleeping_thread_list.next,
-	    struct sleeping_thread, node);
-
-	return (td);
-}
-
-static struct sleeping_thread *
-td_next(struct sleeping_thread *td0)
-{
-	struct sleeping_thread *td;
+static uint32_t bsd_irqs;
+static uint32_t bsd_wakeups;
 
-	if (td0->node.next == &sleeping_thread_list)
-		return (NULL);
-
-	td = CONTAINER_OF(td0->node.next, struct sleeping_thread, node);
+static const struct metric bsd_os_metrics[] = {
+	METRIC_U32("irqs", &bsd_irqs),
+	METRIC_U32("wakeups", &bsd_wakeups),
+};
 
-	return (td);
-}
+static struct metrics_group bsd_os_group = {
+	.name = "bsd_os",
+	.metrics = bsd_os_metrics,
+	.nmetrics = nitems(bsd_os_metrics),
+};
 
-static void
+static void __ramfunc
 ipc_proxy_intr(void *arg, int irq)
 {
 
+	trace_intr_enter(irq);
 	IPC_IRQHandler();
+	trace_intr_exit(irq);
 }
 
 void
@@ -99,24 +102,37 @@ bsd_recoverable_error_handler(uint32_t error)
 	printf("%s: error %d\n", __func__, error);
 }
 
-static void
+static void __ramfunc
 trace_proxy_intr(void *arg, int irq)
 {
 
+	trace_intr_enter(irq);
 	bsd_os_trace_irq_handler();
+	trace_intr_exit(irq);
 }
 
-static void
+static void __ramfunc
 rpc_proxy_intr(void *arg, int irq)
 {
 	struct sleeping_thread *td;
 
 	dprintf(",");
 
+	trace_intr_enter(irq);
 	bsd_os_application_irq_handler();
 
-	for (td = td_first(); td != NULL; td = td_next(td))
+	critical_enter();
+	bsd_irqs++;
+	while (!list_empty(&sleeping_thread_list)) {
+		td = CONTAINER_OF(sleeping_thread_list.next,
+		    struct sleeping_thread, node);
+		list_remove(&td->node);
+		td->woken = 1;
 		mdx_sem_post(&td->sem);
+		bsd_wakeups++;
+	}
+	critical_exit();
+	trace_intr_exit(irq);
 }
 
 void
@@ -128,7 +144,7 @@ bsd_os_init(void)
 	mdx_mutex_init(&bsdos_mtx);
 	list_init(&sleeping_thread_list);
 
-	nvic = mdx_device_lookup_by_name("nvic", 0);
+	nvic = board_device("nvic", 0);
 	if (!nvic)
 		panic("could not find nvic device\n");
 
@@ -142,6 +158,8 @@ bsd_os_init(void)
 
 	mdx_intc_setup(nvic, ID_IPC,  ipc_proxy_intr, NULL);
 	mdx_intc_set_prio(nvic, ID_IPC, 6);
+
+	metrics_register(&bsd_os_group);
 }
 
 int32_t
@@ -169,6 +187,7 @@ bsd_os_timedwait(uint32_t context, int32_t * p_timeout)
 		tmout = val * 1000;
 
 	mdx_sem_init(&td.sem, 0);
+	td.woken = 0;
 
 	critical_enter();
 	list_append(&sleeping_thread_list, &td.node);
@@ -179,7 +198,8 @@ bsd_os_timedwait(uint32_t context, int32_t * p_timeout)
 	err = mdx_sem_timedwait(&td.sem, tmout);
 
 	critical_enter();
-	list_remove(&td.node);
+	if (td.woken == 0)
+		list_remove(&td.node);
 	critical_exit();
 
 	if (err == 0) {
@@ -235,7 +255,7 @@ int32_t
 bsd_os_trace_put(const uint8_t * const p_buffer, uint32_t buf_len)
 {
 
-	dprintf("%s\n", __func__);
+	mtrace_put(p_buffer, buf_len);
 
 	return (0);
 }
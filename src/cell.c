@@ -0,0 +1,343 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/sem.h>
+#include <sys/mutex.h>
+
+#include "at.h"
+#include "cell.h"
+#include "clock.h"
+#include "disk.h"
+#include "lte.h"
+#include "metrics.h"
+
+/*
+ * Serving cell cache.
+ *
+ * The band, PLMN and cell of the last registration are stored in the
+ * run-time state page. The next attach is locked to the cached band
+ * first. If the modem does not register in time, the lock is widened
+ * to the default band set and then removed.
+ *
+ * The record is written only when the serving cell or band changes.
+ * The registration counters ride along with those writes, so after a
+ * reset they may lag behind.
+ */
+
+#define	CELL_STATE		"cell"
+#define	CELL_MAGIC		0x63656c31	/* cel1 */
+#define	CELL_ATTACH_MS		60000	/* Attach time before widening */
+#define	CELL_BAND_MAX		88
+
+#define	CELL_STAGE_CACHED	0	/* The cached band only */
+#define	CELL_STAGE_DEFAULT	1	/* The default band set */
+#define	CELL_STAGE_ANY		2	/* No band lock */
+
+#define	CELL_DEBUG
+#undef	CELL_DEBUG
+
+#ifdef	CELL_DEBUG
+#define	dprintf(fmt, ...)	printf(fmt, ##__VA_ARGS__)
+#else
+#define	dprintf(fmt, ...)
+#endif
+
+/* Bands 3,4,13,20. */
+static const uint8_t cell_bands[] = { 3, 4, 13, 20 };
+
+struct cell_cache {
+	uint32_t	magic;
+	uint32_t	band;		/* Zero if not known */
+	char		plmn[8];
+	char		tac[8];
+	char		cell_id[12];
+	uint32_t	pci;
+	uint32_t	earfcn;
+	uint32_t	regs;		/* Registrations, all the runs */
+	uint32_t	reg_total_ms;
+	uint32_t	reg_cached;	/* ... on the cached band */
+};
+
+static struct mdx_mutex cell_mtx;
+static struct cell_cache cache;
+static int stage;		/* Lock applied */
+static int want;		/* Lock requested */
+static int registered;
+static int attaching;
+static uint32_t attach_start;
+static uint32_t reg_ms;
+static uint32_t widens;
+static uint32_t saved_regs;	/* cache.regs last persisted */
+
+static const struct metric cell_metrics[] = {
+	METRIC_U32("band", &cache.band),
+	METRIC_U32("pci", &cache.pci),
+	METRIC_U32("earfcn", &cache.earfcn),
+	METRIC_U32("reg_ms", &reg_ms),
+	METRIC_U32("regs", &cache.regs),
+	METRIC_U32("reg_total_ms", &cache.reg_total_ms),
+	METRIC_U32("reg_cached", &cache.reg_cached),
+	METRIC_U32("widens", &widens),
+};
+
+static struct metrics_group cell_group = {
+	.name = "cell",
+	.metrics = cell_metrics,
+	.nmetrics = nitems(cell_metrics),
+};
+
+/*
+ * %XBANDLOCK=2,<bitmask>, the rightmost bit is band 1.
+ */
+static void
+cell_bandlock(int s)
+{
+	char cmd[CELL_BAND_MAX + 24];
+	char *p;
+	int nbands;
+	int len;
+	int i;
+
+	if (s == CELL_STAGE_ANY) {
+		printf("%s: any band\n", __func__);
+		at_cmd("AT%XBANDLOCK=0", NULL, 0);
+		return;
+	}
+
+	len = 0;
+	if (s == CELL_STAGE_CACHED)
+		len = cache.band;
+	else
+		for (i = 0; i < nitems(cell_bands); i++)
+			if (cell_bands[i] > len)
+				len = cell_bands[i];
+
+	p = cmd + sprintf(cmd, "AT%%XBANDLOCK=2,\"");
+	memset(p, '0', len);
+	if (s == CELL_STAGE_CACHED)
+		p[len - cache.band] = '1';
+	else
+		for (i = 0; i < nitems(cell_bands); i++)
+			p[len - cell_bands[i]] = '1';
+	p[len] = '"';
+	p[len + 1] = '\0';
+
+	nbands = s == CELL_STAGE_CACHED ? 1 : nitems(cell_bands);
+	printf("%s: %d band(s)\n", __func__, nbands);
+
+	at_cmd(cmd, NULL, 0);
+}
+
+/*
+ * Lock to the cached band and start an attach.
+ * The LTE part must be off.
+ */
+void
+cell_lock(void)
+{
+	int s;
+
+	mdx_mutex_lock(&cell_mtx);
+	s = cache.band ? CELL_STAGE_CACHED : CELL_STAGE_DEFAULT;
+	stage = want = s;
+	attaching = 1;
+	attach_start = clock_ms();
+	mdx_mutex_unlock(&cell_mtx);
+
+	cell_bandlock(s);
+}
+
+/*
+ * Track the registration. Called from the AT thread.
+ */
+void
+cell_cereg(const char *line)
+{
+	uint32_t ms;
+	int val;
+
+	val = lte_cereg(line);
+
+	mdx_mutex_lock(&cell_mtx);
+	if (val == CEREG_HOME || val == CEREG_ROAMING) {
+		if (attaching) {
+			attaching = 0;
+			ms = clock_ms() - attach_start;
+			reg_ms = ms;
+			cache.regs++;
+			cache.reg_total_ms += ms;
+			if (stage == CELL_STAGE_CACHED)
+				cache.reg_cached++;
+		}
+		registered = 1;
+	} else if (val == CEREG_NOT_REGISTERED || val == CEREG_SEARCHING) {
+		if (registered) {
+			/* Coverage lost, search the cached band first. */
+			attaching = 1;
+			attach_start = clock_ms();
+			want = cache.band ? CELL_STAGE_CACHED :
+			    CELL_STAGE_DEFAULT;
+		}
+		registered = 0;
+	}
+	mdx_mutex_unlock(&cell_mtx);
+}
+
+/*
+ * Time until the band lock has to change, ms.
+ */
+int32_t
+cell_next(void)
+{
+	int32_t next;
+
+	mdx_mutex_lock(&cell_mtx);
+	if (!attaching)
+		next = INT32_MAX;
+	else if (want != stage)
+		next = 0;
+	else if (stage == CELL_STAGE_ANY)
+		next = INT32_MAX;
+	else
+		next = attach_start + CELL_ATTACH_MS - clock_ms();
+	mdx_mutex_unlock(&cell_mtx);
+
+	return (next);
+}
+
+/*
+ * Apply the requested lock, or widen it if the attach takes too long.
+ * The modem is taken off LTE meanwhile.
+ */
+void
+cell_step(void)
+{
+	int s;
+
+	mdx_mutex_lock(&cell_mtx);
+	if (want == stage) {
+		want++;
+		widens++;
+	}
+	s = want;
+	mdx_mutex_unlock(&cell_mtx);
+
+	at_cmd("AT+CFUN=20", NULL, 0);
+	cell_bandlock(s);
+	at_cmd("AT+CFUN=21", NULL, 0);
+
+	mdx_mutex_lock(&cell_mtx);
+	stage = s;
+	attach_start = clock_ms();
+	mdx_mutex_unlock(&cell_mtx);
+}
+
+/*
+ * %XMONITOR: <reg_status>[,<full_name>,<short_name>,<plmn>,<tac>,<AcT>,
+ *     <band>,<cell_id>,<phys_cell_id>,<EARFCN>,...]
+ * Record the serving cell and the registration counters. Called once
+ * registered.
+ */
+void
+cell_update(void)
+{
+	char resp[LC_MAX_READ_LENGTH * 2];
+	struct cell_cache tmp;
+	char field[16];
+	bool changed;
+	char *t;
+
+	if (at_cmd("AT%XMONITOR", resp, sizeof(resp)) != AT_RESULT_OK ||
+	    strncmp(resp, "%XMONITOR: ", 11) != 0)
+		return;
+
+	mdx_mutex_lock(&cell_mtx);
+	tmp = cache;
+	mdx_mutex_unlock(&cell_mtx);
+
+	t = resp;
+	strsep(&t, ",");	/* reg_status */
+	strsep(&t, ",");	/* full_name */
+	strsep(&t, ",");	/* short_name */
+	if (at_field(&t, tmp.plmn, sizeof(tmp.plmn)) == NULL ||
+	    at_field(&t, tmp.tac, sizeof(tmp.tac)) == NULL ||
+	    at_field(&t, field, sizeof(field)) == NULL ||	/* AcT */
+	    at_field(&t, field, sizeof(field)) == NULL)
+		return;
+	tmp.band = atoi(field);
+	if (tmp.band > CELL_BAND_MAX)
+		tmp.band = 0;
+	if (at_field(&t, tmp.cell_id, sizeof(tmp.cell_id)) == NULL ||
+	    at_field(&t, field, sizeof(field)) == NULL)
+		return;
+	tmp.pci = atoi(field);
+	if (at_field(&t, field, sizeof(field)) == NULL)
+		return;
+	tmp.earfcn = atoi(field);
+
+	printf("%s: plmn %s tac %s cell %s band %u earfcn %u\n", __func__,
+	    tmp.plmn, tmp.tac, tmp.cell_id, tmp.band, tmp.earfcn);
+
+	mdx_mutex_lock(&cell_mtx);
+	changed = tmp.band != cache.band || tmp.pci != cache.pci ||
+	    tmp.earfcn != cache.earfcn ||
+	    strcmp(tmp.plmn, cache.plmn) != 0 ||
+	    strcmp(tmp.tac, cache.tac) != 0 ||
+	    strcmp(tmp.cell_id, cache.cell_id) != 0 ||
+	    cache.regs != saved_regs;
+	saved_regs = cache.regs;
+	tmp.regs = cache.regs;
+	tmp.reg_total_ms = cache.reg_total_ms;
+	tmp.reg_cached = cache.reg_cached;
+	cache = tmp;
+	mdx_mutex_unlock(&cell_mtx);
+
+	if (changed)
+		save_state(CELL_STATE, &tmp, sizeof(struct cell_cache));
+}
+
+void
+cell_init(void)
+{
+	struct cell_cache tmp;
+
+	mdx_mutex_init(&cell_mtx);
+
+	cache.magic = CELL_MAGIC;
+
+	if (load_state(CELL_STATE, &tmp, sizeof(tmp)) == 0 &&
+	    tmp.magic == CELL_MAGIC) {
+		cache = tmp;
+		saved_regs = cache.regs;
+		printf("%s: plmn %s band %u, %u registrations avg %u ms\n",
+		    __func__, cache.plmn, cache.band, cache.regs,
+		    cache.regs ? cache.reg_total_ms / cache.regs : 0);
+	}
+
+	metrics_register(&cell_group);
+}
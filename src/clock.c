@@ -0,0 +1,178 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include <arm/arm/nvic.h>
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <dev/intc/intc.h>
+
+#include "board.h"
+#include "clock.h"
+#include "trace.h"
+
+/*
+ * Wall-clock time base for the application.
+ *
+ * The kernel timer (timer0) is stopped together with the HFCLK when
+ * the CPU sleeps, and so is the DWT cycle counter. RTC1 runs from the
+ * 32768 Hz LFCLK and keeps counting while the CPU is idle, so it is
+ * used for millisecond timestamps. The 24-bit counter overflows every
+ * 512 seconds; overflows are accumulated in the interrupt handler.
+ */
+
+#define	CLOCK_BASE		0x40005000	/* CLOCK_NS */
+#define	CLOCK_TASKS_LFCLKSTART	0x008
+#define	CLOCK_EVENTS_LFCLKSTARTED 0x104
+#define	CLOCK_LFCLKSTAT		0x418
+#define	 LFCLKSTAT_STATE	(1 << 16)
+#define	CLOCK_LFCLKSRC		0x518
+#define	 LFCLKSRC_LFRC		1
+
+#define	RTC_BASE		0x40015000	/* RTC1_NS */
+#define	RTC_TASKS_START		0x000
+#define	RTC_TASKS_CLEAR		0x008
+#define	RTC_EVENTS_OVRFLW	0x104
+#define	RTC_INTENSET		0x304
+#define	 RTC_INT_OVRFLW		(1 << 1)
+#define	RTC_COUNTER		0x504
+#define	RTC_PRESCALER		0x508
+#define	RTC_FREQ		32768
+#define	RTC_COUNTER_BITS	24
+
+#define	DWT_CTRL		0xe0001000
+#define	 DWT_CTRL_CYCCNTENA	(1 << 0)
+#define	DWT_CYCCNT		0xe0001004
+#define	DEMCR			0xe000edfc
+#define	 DEMCR_TRCENA		(1 << 24)
+
+#define	REG(addr)		(*(volatile uint32_t *)(addr))
+#define	CLOCK_REG(reg)		REG(CLOCK_BASE + (reg))
+#define	RTC_REG(reg)		REG(RTC_BASE + (reg))
+
+static volatile uint32_t overflows;
+
+static void
+clock_intr(void *arg, int irq)
+{
+
+	trace_intr_enter(irq);
+	if (RTC_REG(RTC_EVENTS_OVRFLW)) {
+		RTC_REG(RTC_EVENTS_OVRFLW) = 0;
+		overflows++;
+	}
+	trace_intr_exit(irq);
+}
+
+static uint64_t
+clock_ticks(void)
+{
+	uint32_t ovf;
+	uint32_t cnt;
+
+	critical_enter();
+	ovf = overflows;
+	cnt = RTC_REG(RTC_COUNTER);
+
+	/*
+	 * The counter could wrap after the interrupts were disabled.
+	 * In that case the event is still pending and the counter value
+	 * is small.
+	 */
+	if (RTC_REG(RTC_EVENTS_OVRFLW) && cnt < (1 << (RTC_COUNTER_BITS - 1)))
+		ovf++;
+	critical_exit();
+
+	return (((uint64_t)ovf << RTC_COUNTER_BITS) | cnt);
+}
+
+uint64_t
+clock_usec(void)
+{
+
+	/* 1000000 / 32768 == 15625 / 512 */
+	return (clock_ticks() * 15625 / 512);
+}
+
+uint32_t
+clock_ms(void)
+{
+
+	return (clock_ticks() * 1000 / RTC_FREQ);
+}
+
+uint32_t
+clock_cycles(void)
+{
+
+	return (REG(DWT_CYCCNT));
+}
+
+/*
+ * Also called from board_init(), before the clock is initialized.
+ */
+void
+clock_cycles_start(void)
+{
+
+	REG(DEMCR) |= DEMCR_TRCENA;
+	REG(DWT_CYCCNT) = 0;
+	REG(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+}
+
+void
+clock_init(void)
+{
+	mdx_device_t nvic;
+
+	/* Cycle counter for the benchmarks. */
+	clock_cycles_start();
+
+	if ((CLOCK_REG(CLOCK_LFCLKSTAT) & LFCLKSTAT_STATE) == 0) {
+		CLOCK_REG(CLOCK_LFCLKSRC) = LFCLKSRC_LFRC;
+		CLOCK_REG(CLOCK_EVENTS_LFCLKSTARTED) = 0;
+		CLOCK_REG(CLOCK_TASKS_LFCLKSTART) = 1;
+		while (CLOCK_REG(CLOCK_EVENTS_LFCLKSTARTED) == 0)
+			;
+	}
+
+	nvic = board_device("nvic", 0);
+	if (!nvic)
+		panic("could not find nvic device\n");
+
+	RTC_REG(RTC_PRESCALER) = 0;
+	RTC_REG(RTC_TASKS_CLEAR) = 1;
+	RTC_REG(RTC_EVENTS_OVRFLW) = 0;
+	RTC_REG(RTC_INTENSET) = RTC_INT_OVRFLW;
+
+	mdx_intc_setup(nvic, ID_RTC1, clock_intr, NULL);
+	mdx_intc_set_prio(nvic, ID_RTC1, 6);
+	mdx_intc_enable(nvic, ID_RTC1);
+
+	RTC_REG(RTC_TASKS_START) = 1;
+}
@@ -0,0 +1,218 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+
+#include "clock.h"
+#include "cpu.h"
+#include "metrics.h"
+#include "trace.h"
+#include "workq.h"
+
+/*
+ * CPU run time accounting.
+ *
+ * The DWT cycle counter runs from the CPU clock, which is gated while
+ * the CPU sleeps in the idle thread, so the cycles elapsed are the
+ * busy time and the rest of the RTC time is idle. With a debugger
+ * attached the clock keeps running and everything reads as busy.
+ *
+ * The 32-bit counter wraps every 67 seconds at 64 MHz; a periodic work
+ * item folds it into the 64-bit total well before that.
+ *
+ * The scheduler has no switch hook, so the threads account their own
+ * run time between the blocking calls with cpu_acct_enter/exit. The
+ * time not claimed by any of them is reported as "other".
+ */
+
+#define	CPU_FREQ		64000000
+#define	CPU_SAMPLE_MS		55000
+#define	CPU_SAMPLE_SLACK_MS	5000
+
+/* Static, the threads may register before cpu_init(). */
+static struct entry cpu_accts = { .next = &cpu_accts, .prev = &cpu_accts };
+static struct work cpu_work;
+
+static uint64_t cpu_cycles;	/* Busy cycles since boot */
+static uint32_t cpu_last_cycles;
+static uint32_t cpu_last_ms;
+static uint32_t cpu_start_ms;
+
+/* Previous cpu_duty() call. */
+static uint64_t cpu_duty_cycles;
+static uint32_t cpu_duty_ms;
+
+static uint32_t cpu_busy_ms;
+static uint32_t cpu_idle_ms;
+uint32_t cpu_duty_permille;	/* Over the last reporting interval */
+
+static const struct metric cpu_metrics[] = {
+	METRIC_U32("busy_ms", &cpu_busy_ms),
+	METRIC_U32("idle_ms", &cpu_idle_ms),
+	METRIC_U32("duty_permille", &cpu_duty_permille),
+};
+
+static struct metrics_group cpu_group = {
+	.name = "cpu",
+	.metrics = cpu_metrics,
+	.nmetrics = nitems(cpu_metrics),
+};
+
+static void
+cpu_sample(void)
+{
+	uint32_t cycles;
+	uint32_t now;
+
+	critical_enter();
+	cycles = clock_cycles();
+	now = clock_ms();
+	cpu_cycles += cycles - cpu_last_cycles;
+	cpu_last_cycles = cycles;
+	cpu_last_ms = now;
+	critical_exit();
+
+	cpu_busy_ms = cpu_cycles / (CPU_FREQ / 1000);
+	cpu_idle_ms = now - cpu_start_ms - cpu_busy_ms;
+}
+
+static void
+cpu_sample_work(struct work *w)
+{
+
+	cpu_sample();
+}
+
+void
+cpu_acct_register(struct cpu_acct *a)
+{
+
+	a->cycles = 0;
+
+	critical_enter();
+	list_append(&cpu_accts, &a->node);
+	critical_exit();
+}
+
+void
+cpu_acct_enter(struct cpu_acct *a)
+{
+
+	trace_begin(TRACE_RUN, a->name);
+	a->start = clock_cycles();
+}
+
+void
+cpu_acct_exit(struct cpu_acct *a)
+{
+
+	a->cycles += clock_cycles() - a->start;
+	trace_end(TRACE_RUN, a->name);
+}
+
+/*
+ * Busy time in permille since the previous call, which closes the
+ * reporting interval. The publisher calls it once per report, the
+ * others read cpu_duty_permille.
+ */
+uint32_t
+cpu_duty(void)
+{
+	uint64_t cycles;
+	uint32_t ms;
+
+	cpu_sample();
+
+	cycles = cpu_cycles - cpu_duty_cycles;
+	ms = cpu_last_ms - cpu_duty_ms;
+	cpu_duty_cycles = cpu_cycles;
+	cpu_duty_ms = cpu_last_ms;
+
+	if (ms == 0)
+		return (cpu_duty_permille);
+
+	cpu_duty_permille = cycles / (CPU_FREQ / 1000000) / ms;
+
+	return (cpu_duty_permille);
+}
+
+/*
+ * Busy time since cpu_init(), ms.
+ */
+uint32_t
+cpu_busy(void)
+{
+
+	cpu_sample();
+
+	return (cpu_busy_ms);
+}
+
+void
+cpu_stats(void)
+{
+	struct cpu_acct *a;
+	struct entry *e;
+	uint64_t other;
+	uint32_t ms;
+
+	cpu_sample();
+
+	printf("cpu: duty %u permille over the last report interval\n",
+	    cpu_duty_permille);
+	printf("cpu: busy %u ms, idle %u ms\n", cpu_busy_ms, cpu_idle_ms);
+
+	other = cpu_cycles;
+	for (e = cpu_accts.next; e != &cpu_accts; e = e->next) {
+		a = CONTAINER_OF(e, struct cpu_acct, node);
+		ms = a->cycles / (CPU_FREQ / 1000);
+		printf("cpu: %-8s %u ms\n", a->name, ms);
+		if (other > a->cycles)
+			other -= a->cycles;
+		else
+			other = 0;
+	}
+
+	ms = other / (CPU_FREQ / 1000);
+	printf("cpu: %-8s %u ms\n", "other", ms);
+}
+
+void
+cpu_init(void)
+{
+
+	cpu_last_cycles = clock_cycles();
+	cpu_start_ms = clock_ms();
+	cpu_last_ms = cpu_start_ms;
+	cpu_duty_ms = cpu_start_ms;
+
+	work_init(&cpu_work, "cpu", WORK_PRIO_LOW, cpu_sample_work, NULL);
+	work_periodic(&cpu_work, CPU_SAMPLE_MS, CPU_SAMPLE_SLACK_MS);
+
+	metrics_register(&cpu_group);
+}
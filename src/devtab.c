@@ -0,0 +1,92 @@
+/*
+ * Generated by tools/dts2c.py from md009.dts, do not edit.
+ * Regenerate with 'make devtab' after changing the device tree.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/console.h>
+
+#include <arm/arm/nvic.h>
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <dev/intc/intc.h>
+#include <dev/uart/uart.h>
+
+#include "board.h"
+
+#ifdef BOARD_DEVTAB
+
+#include "devtab.h"
+
+/* /cpus/cpu@0/interrupt-controller@e000e100 */
+static struct arm_nvic_softc nvic0_sc;
+static struct mdx_device nvic0_dev = { .sc = &nvic0_sc };
+
+/* /soc/peripheral@40000000/flash-controller@39000 */
+static struct nrf_nvmc_softc nrf_nvmc0_sc;
+static struct mdx_device nrf_nvmc0_dev = { .sc = &nrf_nvmc0_sc };
+
+/* /soc/peripheral@40000000/uart@8000 */
+static struct nrf_uarte_softc nrf_uarte0_sc;
+static struct mdx_device nrf_uarte0_dev = { .sc = &nrf_uarte0_sc };
+
+/* /soc/peripheral@40000000/i2c@9000 */
+static struct nrf_twim_softc nrf_twim0_sc;
+static struct mdx_device nrf_twim0_dev = { .sc = &nrf_twim0_sc };
+
+/* /soc/peripheral@40000000/timer@f000 */
+static struct nrf_timer_softc nrf_timer0_sc;
+static struct mdx_device nrf_timer0_dev = { .sc = &nrf_timer0_sc };
+
+/* /soc/peripheral@40000000/gpiote@31000 */
+static struct nrf_gpiote_softc nrf_gpiote0_sc;
+static struct mdx_device nrf_gpiote0_dev = { .sc = &nrf_gpiote0_sc };
+
+/* /soc/peripheral@40000000/gpio@842500 */
+static struct nrf_gpio_softc nrf_gpio0_sc;
+static struct mdx_device nrf_gpio0_dev = { .sc = &nrf_gpio0_sc };
+
+const struct devtab_entry devtab[] = {
+	{ "nvic", 0, &nvic0_dev },
+	{ "nrf_nvmc", 0, &nrf_nvmc0_dev },
+	{ "nrf_uarte", 0, &nrf_uarte0_dev },
+	{ "nrf_twim", 0, &nrf_twim0_dev },
+	{ "nrf_timer", 0, &nrf_timer0_dev },
+	{ "nrf_gpiote", 0, &nrf_gpiote0_dev },
+	{ "nrf_gpio", 0, &nrf_gpio0_dev },
+};
+
+const int devtab_ndevs = nitems(devtab);
+
+void
+devtab_attach(void)
+{
+
+	arm_nvic_init(&nvic0_dev, 0xe000e100);
+
+	nrf_nvmc_init(&nrf_nvmc0_dev, 0x40039000);
+
+	nrf_uarte_init(&nrf_uarte0_dev, 0x40008000, 16, 15);
+	mdx_uart_setup(&nrf_uarte0_dev, 115200, UART_DATABITS_8,
+	    UART_STOPBITS_1, UART_PARITY_NONE);
+	mdx_intc_setup(&nvic0_dev, 8, nrf_uarte_intr, &nrf_uarte0_dev);
+	mdx_intc_enable(&nvic0_dev, 8);
+	mdx_console_register_uart(&nrf_uarte0_dev);
+
+	nrf_twim_init(&nrf_twim0_dev, 0x40009000, 2, 4);
+	mdx_intc_setup(&nvic0_dev, 9, nrf_twim_intr, &nrf_twim0_dev);
+	mdx_intc_enable(&nvic0_dev, 9);
+
+	nrf_timer_init(&nrf_timer0_dev, 0x4000f000, 1000000);
+	mdx_intc_setup(&nvic0_dev, 15, nrf_timer_intr, &nrf_timer0_dev);
+	mdx_intc_enable(&nvic0_dev, 15);
+
+	nrf_gpiote_init(&nrf_gpiote0_dev, 0x40031000);
+	mdx_intc_setup(&nvic0_dev, 49, nrf_gpiote_intr, &nrf_gpiote0_dev);
+	mdx_intc_enable(&nvic0_dev, 49);
+
+	nrf_gpio_init(&nrf_gpio0_dev, 0x40842500);
+}
+
+#endif /* BOARD_DEVTAB */
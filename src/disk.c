@@ -0,0 +1,549 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/malloc.h>
+#include <sys/mutex.h>
+
+#include <littlefs/lfs.h>
+
+#include "board.h"
+#include "disk.h"
+#include "heap.h"
+#include "log.h"
+
+/*
+ * LittleFS on the internal flash at DISK_ADDRESS.
+ *
+ * The file system is made with 512 byte blocks while the nRF9160
+ * flash page is 4 KB, so a block erase is a read-modify-write of the
+ * whole page. A power loss during the erase could damage the
+ * neighbouring blocks, which hold the credentials, so the file system
+ * is for provisioned data only.
+ *
+ * The small records that change at run time (antenna selection, PSM
+ * profile, serving cell) live in a page of their own at STATE_ADDRESS.
+ * They are appended, the last record of a name wins, and a record is
+ * written only if it differs from the stored one. A full page is
+ * compacted: erased and rewritten with the live records. A power loss
+ * then may lose the state, which is a cache, but never the files.
+ */
+
+#define	FLASH_PAGE_SIZE		4096
+
+#define	STATE_MAGIC		0x53544154	/* "STAT" */
+#define	STATE_NAMELEN		8
+#define	STATE_MAX_SIZE		256
+#define	STATE_RECLEN(size)	\
+	(sizeof(struct state_hdr) + (((size) + 3) & ~3))
+
+struct state_hdr {
+	uint32_t	magic;
+	char		name[STATE_NAMELEN];
+	uint16_t	size;		/* Payload size */
+	uint16_t	sum;		/* Payload checksum */
+};
+
+#define	NVMC_BASE		0x40039000	/* NVMC_NS */
+#define	NVMC_READY		0x400
+#define	NVMC_CONFIGNS		0x584
+#define	 CONFIGNS_REN		0
+#define	 CONFIGNS_WEN		1
+#define	 CONFIGNS_EEN		2
+
+#ifdef BENCH_QEMU
+/* The flash of the QEMU machine is RAM, written directly. */
+static uint32_t nvmc_regs[NVMC_CONFIGNS / 4 + 1] = { [NVMC_READY / 4] = 1 };
+#define	NVMC_REG(reg)		(nvmc_regs[(reg) / 4])
+#else
+#define	NVMC_REG(reg)		(*(volatile uint32_t *)(NVMC_BASE + (reg)))
+#endif
+
+static struct mdx_mutex disk_mtx;
+static lfs_t lfs;
+
+/* Record being written, protected by disk_mtx. */
+static uint32_t state_rec[STATE_RECLEN(STATE_MAX_SIZE) / sizeof(uint32_t)];
+
+static void
+nvmc_wait(void)
+{
+
+	while (NVMC_REG(NVMC_READY) == 0)
+		;
+}
+
+static void
+nvmc_write(uint32_t addr, const uint32_t *data, int nwords)
+{
+	volatile uint32_t *dst;
+	int i;
+
+	dst = (volatile uint32_t *)addr;
+
+	NVMC_REG(NVMC_CONFIGNS) = CONFIGNS_WEN;
+	for (i = 0; i < nwords; i++) {
+		if (data[i] == 0xffffffff)
+			continue;
+		dst[i] = data[i];
+		nvmc_wait();
+	}
+	NVMC_REG(NVMC_CONFIGNS) = CONFIGNS_REN;
+}
+
+static void
+nvmc_erase(uint32_t addr)
+{
+
+	NVMC_REG(NVMC_CONFIGNS) = CONFIGNS_EEN;
+#ifdef BENCH_QEMU
+	memset((void *)addr, 0xff, FLASH_PAGE_SIZE);
+#else
+	*(volatile uint32_t *)addr = 0xffffffff;
+#endif
+	nvmc_wait();
+	NVMC_REG(NVMC_CONFIGNS) = CONFIGNS_REN;
+}
+
+static int
+disk_read(const struct lfs_config *c, lfs_block_t block,
+    lfs_off_t off, void *buffer, lfs_size_t size)
+{
+	void *addr;
+
+	addr = (void *)(DISK_ADDRESS + block * c->block_size + off);
+
+#if 0
+	printf("%s: block %d off %x size %d, address %p\n",
+	    __func__, block, off, size, addr);
+	printf("word %x\n", *(uint32_t *)addr);
+#endif
+
+	memcpy(buffer, addr, size);
+
+	return (0);
+}
+
+static int
+disk_prog(const struct lfs_config *c, lfs_block_t block,
+    lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+	uint32_t addr;
+
+	addr = DISK_ADDRESS + block * c->block_size + off;
+
+	nvmc_write(addr, buffer, size / sizeof(uint32_t));
+
+	return (0);
+}
+
+static int
+disk_erase(const struct lfs_config *c, lfs_block_t block)
+{
+	uint32_t page;
+	uint32_t addr;
+	uint8_t *buf;
+
+	addr = DISK_ADDRESS + block * c->block_size;
+	page = addr & ~(FLASH_PAGE_SIZE - 1);
+
+	buf = heap_alloc(HEAP_TAG_DISK, FLASH_PAGE_SIZE);
+	if (buf == NULL) {
+		log_err("%s: could not allocate page buffer\n", __func__);
+		return (-1);
+	}
+
+	memcpy(buf, (void *)page, FLASH_PAGE_SIZE);
+	memset(buf + (addr - page), 0xff, c->block_size);
+
+	nvmc_erase(page);
+	nvmc_write(page, (uint32_t *)buf, FLASH_PAGE_SIZE / sizeof(uint32_t));
+
+	heap_free(buf);
+
+	return (0);
+}
+
+static int
+disk_sync(const struct lfs_config *c)
+{
+
+	return (0);
+}
+
+static const struct lfs_config cfg = {
+	/* block device operations */
+	.read  = disk_read,
+	.prog  = disk_prog,
+	.erase = disk_erase,
+	.sync  = disk_sync,
+
+	/* block device configuration */
+	.read_size = 16,
+	.prog_size = 16,
+	.block_size = 512,
+	.block_count = 32,
+	.cache_size = 16,
+	.lookahead_size = 16,
+	.block_cycles = 500,
+};
+
+static int
+disk_open(lfs_file_t *file, const char *filename, int flags)
+{
+	int err;
+
+	mdx_mutex_lock(&disk_mtx);
+
+	err = lfs_mount(&lfs, &cfg);
+	if (err) {
+		printf("%s: could not mount\n", __func__);
+		mdx_mutex_unlock(&disk_mtx);
+		return (err);
+	}
+
+	err = lfs_file_open(&lfs, file, filename, flags);
+	if (err) {
+		if (err != LFS_ERR_NOENT)
+			printf("%s: could not open file %s, err %d\n",
+			    __func__, filename, err);
+		lfs_unmount(&lfs);
+		mdx_mutex_unlock(&disk_mtx);
+		return (err);
+	}
+
+	return (0);
+}
+
+static void
+disk_close(lfs_file_t *file)
+{
+	int err;
+
+	err = lfs_file_close(&lfs, file);
+	if (err)
+		printf("%s: cant close the file\n", __func__);
+
+	err = lfs_unmount(&lfs);
+	if (err)
+		printf("%s: could not unmount\n", __func__);
+
+	mdx_mutex_unlock(&disk_mtx);
+}
+
+/*
+ * Read the whole file into a buffer allocated with heap_alloc().
+ * The buffer is NUL-terminated to make mbedtls happy.
+ */
+int
+read_file(const char *filename, void **addr, uint32_t *size)
+{
+	static lfs_file_t file;
+	uint8_t *ptr;
+	int err;
+
+	err = disk_open(&file, filename, LFS_O_RDONLY);
+	if (err)
+		return (err);
+
+	ptr = heap_alloc(HEAP_TAG_DISK, file.ctz.size + 1);
+	if (ptr == NULL) {
+		printf("%s: could not allocate %d bytes\n",
+		    __func__, file.ctz.size + 1);
+		disk_close(&file);
+		return (-1);
+	}
+
+	err = lfs_file_read(&lfs, &file, ptr, file.ctz.size);
+	if (err != file.ctz.size) {
+		printf("%s: could not read file, err %d\n", __func__, err);
+		heap_free(ptr);
+		disk_close(&file);
+		return (err < 0 ? err : -1);
+	}
+
+	ptr[file.ctz.size] = '\0';
+
+	*size = file.ctz.size + 1;
+	*addr = ptr;
+
+	disk_close(&file);
+
+	return (0);
+}
+
+/*
+ * Read a fixed size record.
+ */
+int
+load_file(const char *filename, void *buf, uint32_t size)
+{
+	static lfs_file_t file;
+	int err;
+
+	err = disk_open(&file, filename, LFS_O_RDONLY);
+	if (err)
+		return (err);
+
+	err = lfs_file_read(&lfs, &file, buf, size);
+
+	disk_close(&file);
+
+	if (err != size)
+		return (-1);
+
+	return (0);
+}
+
+int
+write_file(const char *filename, const void *buf, uint32_t size)
+{
+	static lfs_file_t file;
+	int err;
+
+	err = disk_open(&file, filename,
+	    LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+	if (err)
+		return (err);
+
+	err = lfs_file_write(&lfs, &file, buf, size);
+
+	disk_close(&file);
+
+	if (err != size) {
+		printf("%s: could not write %s, err %d\n",
+		    __func__, filename, err);
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Append to a file. Returns the file size or a negative error.
+ */
+int
+append_file(const char *filename, const void *buf, uint32_t size)
+{
+	static lfs_file_t file;
+	int err;
+
+	err = disk_open(&file, filename,
+	    LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+	if (err)
+		return (err);
+
+	err = lfs_file_write(&lfs, &file, buf, size);
+	if (err == size)
+		err = lfs_file_size(&lfs, &file);
+
+	disk_close(&file);
+
+	if (err < 0)
+		printf("%s: could not write %s, err %d\n",
+		    __func__, filename, err);
+
+	return (err);
+}
+
+static uint16_t
+state_sum(const uint8_t *data, int size)
+{
+	uint16_t sum;
+	int i;
+
+	sum = 0;
+	for (i = 0; i < size; i++)
+		sum = (sum << 1 | sum >> 15) + data[i];
+
+	return (sum);
+}
+
+/*
+ * Find the last valid record of a name. Returns the offset of the free
+ * space, or STATE_SIZE if the page has to be compacted first.
+ */
+static uint32_t
+state_find(const char *name, const struct state_hdr **found)
+{
+	const struct state_hdr *h;
+	uint32_t off;
+
+	*found = NULL;
+
+	for (off = 0; off + sizeof(*h) <= STATE_SIZE;
+	    off += STATE_RECLEN(h->size)) {
+		h = (const struct state_hdr *)(STATE_ADDRESS + off);
+		if (h->magic == 0xffffffff)
+			return (off);
+		/* A torn header or garbage: nothing past it is usable. */
+		if (h->magic != STATE_MAGIC || h->size > STATE_MAX_SIZE ||
+		    off + STATE_RECLEN(h->size) > STATE_SIZE)
+			break;
+		/* A torn payload has a bad checksum and is skipped. */
+		if (strncmp(h->name, name, STATE_NAMELEN) == 0 &&
+		    state_sum((const uint8_t *)(h + 1), h->size) == h->sum)
+			*found = h;
+	}
+
+	return (STATE_SIZE);
+}
+
+/*
+ * Rewrite the page with the live records except the one of name.
+ * Returns the offset of the free space.
+ */
+static uint32_t
+state_compact(const char *name)
+{
+	const struct state_hdr *h, *last;
+	uint32_t off, len;
+	uint8_t *buf;
+
+	buf = heap_alloc(HEAP_TAG_DISK, STATE_SIZE);
+	if (buf == NULL) {
+		log_err("%s: could not allocate page buffer\n", __func__);
+		return (STATE_SIZE);
+	}
+	memset(buf, 0xff, STATE_SIZE);
+
+	len = 0;
+	for (off = 0; off + sizeof(*h) <= STATE_SIZE;
+	    off += STATE_RECLEN(h->size)) {
+		h = (const struct state_hdr *)(STATE_ADDRESS + off);
+		if (h->magic != STATE_MAGIC || h->size > STATE_MAX_SIZE ||
+		    off + STATE_RECLEN(h->size) > STATE_SIZE)
+			break;
+		if (strncmp(h->name, name, STATE_NAMELEN) == 0)
+			continue;
+		state_find(h->name, &last);
+		if (last != h)
+			continue;
+		memcpy(buf + len, h, STATE_RECLEN(h->size));
+		len += STATE_RECLEN(h->size);
+	}
+
+	nvmc_erase(STATE_ADDRESS);
+	nvmc_write(STATE_ADDRESS, (uint32_t *)buf, len / sizeof(uint32_t));
+
+	heap_free(buf);
+
+	return (len);
+}
+
+/*
+ * Read the record of a name. Fails if there is none of this size.
+ */
+int
+load_state(const char *name, void *buf, uint32_t size)
+{
+	const struct state_hdr *h;
+	int err;
+
+	err = -1;
+
+	mdx_mutex_lock(&disk_mtx);
+	state_find(name, &h);
+	if (h != NULL && h->size == size) {
+		memcpy(buf, h + 1, size);
+		err = 0;
+	}
+	mdx_mutex_unlock(&disk_mtx);
+
+	return (err);
+}
+
+/*
+ * Store a record, unless it is the same as the stored one.
+ */
+int
+save_state(const char *name, const void *buf, uint32_t size)
+{
+	const struct state_hdr *h;
+	struct state_hdr *hdr;
+	uint32_t off;
+
+	if (size > STATE_MAX_SIZE)
+		return (-1);
+
+	mdx_mutex_lock(&disk_mtx);
+
+	off = state_find(name, &h);
+	if (h != NULL && h->size == size && memcmp(h + 1, buf, size) == 0) {
+		mdx_mutex_unlock(&disk_mtx);
+		return (0);
+	}
+
+	if (off + STATE_RECLEN(size) > STATE_SIZE) {
+		off = state_compact(name);
+		if (off + STATE_RECLEN(size) > STATE_SIZE) {
+			mdx_mutex_unlock(&disk_mtx);
+			log_err("%s: no space for %s\n", __func__, name);
+			return (-1);
+		}
+	}
+
+	memset(state_rec, 0xff, sizeof(state_rec));
+	hdr = (struct state_hdr *)state_rec;
+	hdr->magic = STATE_MAGIC;
+	strncpy(hdr->name, name, STATE_NAMELEN);
+	hdr->size = size;
+	hdr->sum = state_sum(buf, size);
+	memcpy(hdr + 1, buf, size);
+
+	nvmc_write(STATE_ADDRESS + off, state_rec,
+	    STATE_RECLEN(size) / sizeof(uint32_t));
+
+	mdx_mutex_unlock(&disk_mtx);
+
+	return (0);
+}
+
+/*
+ * Make an empty file system.
+ */
+int
+disk_format(void)
+{
+	int err;
+
+	mdx_mutex_lock(&disk_mtx);
+	err = lfs_format(&lfs, &cfg);
+	mdx_mutex_unlock(&disk_mtx);
+
+	if (err)
+		log_err("%s: could not format, err %d\n", __func__, err);
+
+	return (err);
+}
+
+void
+disk_init(void)
+{
+
+	mdx_mutex_init(&disk_mtx);
+}
@@ -0,0 +1,66 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+
+#include "sensor.h"
+
+#include <lib/msun/src/math.h>
+
+/*
+ * Tilt-compensated heading from one MC6470 sample. Kept apart from the
+ * driver code so that it builds in the benchmark image without I2C.
+ */
+
+void
+mc6470_ecompass(struct ecompass_data *data,
+    int16_t mag_x, int16_t mag_y, int16_t mag_z,
+    int16_t acc_x, int16_t acc_y, int16_t acc_z)
+{
+	double pitch, roll, azimuth;
+	double X_h, Y_h;
+
+	/* Calculate pitch and roll, in the range (-pi, pi). */
+	pitch = atan2((double) - acc_x,
+	    sqrt((long)acc_z * (long)acc_z + (long)acc_y * (long)acc_y));
+	roll = atan2((double)acc_y,
+	    sqrt((long)acc_z * (long)acc_z + (long)acc_x * (long)acc_x));
+
+	X_h = (double)mag_x * cos(pitch) +
+	    (double)mag_y * sin(roll) * sin(pitch) +
+	    (double)mag_z * cos(roll) * sin(pitch);
+
+	Y_h = (double)mag_y * cos(roll) -
+	    (double)mag_z * sin(roll);
+
+	azimuth = atan2(Y_h, X_h);
+	if(azimuth < 0)	/* Convert Azimuth in the range (0, 2pi) */
+		azimuth = 2 * M_PI + azimuth;
+
+	data->azimuth = (int16_t)(azimuth * 180.0 / M_PI);
+	data->pitch = (int16_t)(pitch * 180.0 / M_PI);
+	data->roll = (int16_t)(roll * 180.0 / M_PI);
+}
@@ -0,0 +1,323 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include "clock.h"
+#include "cpu.h"
+#include "energy.h"
+#include "metrics.h"
+#include "workq.h"
+
+/*
+ * Energy accounting.
+ *
+ * The drivers report the state transitions of the power consumers:
+ * the LTE part of the modem from the RRC and modem sleep URCs, GNSS
+ * from its start and the PVT frames, and the GPS amplifier from the
+ * antenna switches. The time in each state is multiplied by the
+ * current from the table below, which is a model of the board and
+ * can be changed at run time. The CPU split between run and sleep
+ * comes from the cycle counter accounting in cpu.c.
+ *
+ * The result is reported as the average current, which is also the
+ * charge in uAh per hour, and as the charge per published message.
+ * The core takes the time as an argument, so the host build can
+ * replay scripted state sequences (md009-host -e).
+ */
+
+#define	ENERGY_UPDATE_MS	60000
+#define	ENERGY_UPDATE_SLACK_MS	10000
+#define	ENERGY_MAX_STATES	4
+
+struct energy_state {
+	const char	*name;
+	uint32_t	ua;		/* Average current, uA */
+	uint64_t	ms;		/* Time spent in the state */
+};
+
+struct energy_comp {
+	int		state;
+	uint32_t	since;		/* clock_ms() of the last change */
+	int		nstates;
+	struct energy_state states[ENERGY_MAX_STATES];
+};
+
+/*
+ * nRF9160 and board figures at 3.7 V. The LTE states are averages
+ * over the state, including the paging cycles.
+ */
+static struct energy_comp comps[ENERGY_NCOMPS] = {
+	[ENERGY_LTE] = { .nstates = 4, .states = {
+		[ENERGY_OFF] = { "lte_off", 0 },
+		[ENERGY_LTE_SLEEP] = { "lte_sleep", 5 },
+		[ENERGY_LTE_IDLE] = { "lte_idle", 900 },
+		[ENERGY_LTE_CONNECTED] = { "lte_connected", 40000 },
+	}},
+	[ENERGY_GNSS] = { .nstates = 3, .states = {
+		[ENERGY_OFF] = { "gnss_off", 0 },
+		[ENERGY_GNSS_WAIT] = { "gnss_wait", 0 },
+		[ENERGY_GNSS_ON] = { "gnss_on", 42000 },
+	}},
+	[ENERGY_AMP] = { .nstates = 2, .states = {
+		[ENERGY_OFF] = { "amp_off", 0 },
+		[ENERGY_ON] = { "amp_on", 5000 },
+	}},
+	[ENERGY_CPU] = { .nstates = 2, .states = {
+		[ENERGY_OFF] = { "cpu_sleep", 3 },
+		[ENERGY_ON] = { "cpu_run", 2600 },
+	}},
+};
+
+static uint32_t energy_start;
+static uint32_t energy_msgs;
+static uint32_t energy_busy_base;
+static struct work energy_work;
+
+static uint32_t energy_uah;
+static uint32_t energy_ua_avg;
+static uint32_t energy_nah_msg;
+
+static const struct metric energy_metrics[] = {
+	METRIC_U32("uah", &energy_uah),
+	METRIC_U32("ua_avg", &energy_ua_avg),
+	METRIC_U32("nah_per_msg", &energy_nah_msg),
+	METRIC_U32("msgs", &energy_msgs),
+};
+
+static struct metrics_group energy_group = {
+	.name = "energy",
+	.metrics = energy_metrics,
+	.nmetrics = nitems(energy_metrics),
+};
+
+/*
+ * Charge for ms at ua, nAh.
+ */
+static uint64_t
+energy_nah(uint64_t ms, uint32_t ua)
+{
+
+	return (ms * ua / 3600);
+}
+
+void
+energy_reset(uint32_t now)
+{
+	int i, j;
+
+	critical_enter();
+	for (i = 0; i < ENERGY_NCOMPS; i++) {
+		comps[i].state = ENERGY_OFF;
+		comps[i].since = now;
+		for (j = 0; j < comps[i].nstates; j++)
+			comps[i].states[j].ms = 0;
+	}
+	energy_start = now;
+	energy_msgs = 0;
+	critical_exit();
+}
+
+void
+energy_set_at(int comp, int state, uint32_t now)
+{
+	struct energy_comp *c;
+
+	if (comp < 0 || comp >= ENERGY_NCOMPS)
+		return;
+	c = &comps[comp];
+	if (state < 0 || state >= c->nstates)
+		return;
+
+	critical_enter();
+	c->states[c->state].ms += now - c->since;
+	c->since = now;
+	c->state = state;
+	critical_exit();
+}
+
+void
+energy_set(int comp, int state)
+{
+
+	energy_set_at(comp, state, clock_ms());
+}
+
+void
+energy_message(void)
+{
+
+	critical_enter();
+	energy_msgs++;
+	critical_exit();
+}
+
+int
+energy_lookup(const char *name, int *comp, int *state)
+{
+	int i, j;
+
+	for (i = 0; i < ENERGY_NCOMPS; i++)
+		for (j = 0; j < comps[i].nstates; j++)
+			if (strcmp(comps[i].states[j].name, name) == 0) {
+				*comp = i;
+				*state = j;
+				return (0);
+			}
+
+	return (-1);
+}
+
+int
+energy_set_current(const char *name, uint32_t ua)
+{
+	int comp, state;
+
+	if (energy_lookup(name, &comp, &state) != 0)
+		return (-1);
+
+	comps[comp].states[state].ua = ua;
+
+	return (0);
+}
+
+/*
+ * The times up to now, the CPU split given by its busy time over the
+ * same period.
+ */
+static void
+energy_times(uint64_t ms[ENERGY_NCOMPS][ENERGY_MAX_STATES], uint32_t now,
+    uint32_t busy_ms)
+{
+	struct energy_comp *c;
+	uint32_t elapsed;
+	int i, j;
+
+	critical_enter();
+	elapsed = now - energy_start;
+	for (i = 0; i < ENERGY_NCOMPS; i++) {
+		c = &comps[i];
+		for (j = 0; j < c->nstates; j++)
+			ms[i][j] = c->states[j].ms;
+		ms[i][c->state] += now - c->since;
+	}
+	critical_exit();
+
+	if (busy_ms > elapsed)
+		busy_ms = elapsed;
+	ms[ENERGY_CPU][ENERGY_ON] = busy_ms;
+	ms[ENERGY_CPU][ENERGY_OFF] = elapsed - busy_ms;
+}
+
+void
+energy_get(struct energy_report *r, uint32_t now, uint32_t busy_ms)
+{
+	uint64_t ms[ENERGY_NCOMPS][ENERGY_MAX_STATES];
+	struct energy_comp *c;
+	int i, j;
+
+	energy_times(ms, now, busy_ms);
+
+	r->ms = now - energy_start;
+	r->msgs = energy_msgs;
+	r->nah = 0;
+	for (i = 0; i < ENERGY_NCOMPS; i++) {
+		c = &comps[i];
+		for (j = 0; j < c->nstates; j++)
+			r->nah += energy_nah(ms[i][j], c->states[j].ua);
+	}
+
+	r->ua_avg = 0;
+	if (r->ms)
+		r->ua_avg = r->nah * 3600 / r->ms;
+	r->nah_msg = 0;
+	if (r->msgs)
+		r->nah_msg = r->nah / r->msgs;
+}
+
+void
+energy_print(uint32_t now, uint32_t busy_ms)
+{
+	uint64_t ms[ENERGY_NCOMPS][ENERGY_MAX_STATES];
+	struct energy_state *s;
+	struct energy_report r;
+	uint64_t nah;
+	int i, j;
+
+	energy_times(ms, now, busy_ms);
+	energy_get(&r, now, busy_ms);
+
+	printf("energy: %u ms, %u messages\n", r.ms, r.msgs);
+	for (i = 0; i < ENERGY_NCOMPS; i++)
+		for (j = 0; j < comps[i].nstates; j++) {
+			s = &comps[i].states[j];
+			if (ms[i][j] == 0)
+				continue;
+			nah = energy_nah(ms[i][j], s->ua);
+			printf("energy: %-14s %6u uA %10u ms %8u.%03u uAh\n",
+			    s->name, s->ua, (uint32_t)ms[i][j],
+			    (uint32_t)(nah / 1000), (uint32_t)(nah % 1000));
+		}
+	printf("energy: total %u.%03u uAh, %u uAh/h, %u.%03u uAh/msg\n",
+	    (uint32_t)(r.nah / 1000), (uint32_t)(r.nah % 1000), r.ua_avg,
+	    r.nah_msg / 1000, r.nah_msg % 1000);
+}
+
+static void
+energy_update(struct work *w)
+{
+	struct energy_report r;
+
+	energy_get(&r, clock_ms(), cpu_busy() - energy_busy_base);
+
+	energy_uah = r.nah / 1000;
+	energy_ua_avg = r.ua_avg;
+	energy_nah_msg = r.nah_msg;
+}
+
+void
+energy_stats(void)
+{
+
+	energy_print(clock_ms(), cpu_busy() - energy_busy_base);
+}
+
+/*
+ * After cpu_init() and before the drivers report any state.
+ */
+void
+energy_init(void)
+{
+
+	energy_reset(clock_ms());
+	energy_busy_base = cpu_busy();
+
+	work_init(&energy_work, "energy", WORK_PRIO_LOW, energy_update, NULL);
+	work_periodic(&energy_work, ENERGY_UPDATE_MS, ENERGY_UPDATE_SLACK_MS);
+
+	metrics_register(&energy_group);
+}
@@ -0,0 +1,65 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_ENERGY_H_
+#define	_SRC_ENERGY_H_
+
+/* Components */
+#define	ENERGY_LTE		0
+#define	ENERGY_GNSS		1
+#define	ENERGY_AMP		2	/* GPS amplifier */
+#define	ENERGY_CPU		3
+#define	ENERGY_NCOMPS		4
+
+/* States, per component */
+#define	ENERGY_OFF		0
+#define	ENERGY_ON		1
+#define	ENERGY_LTE_SLEEP	1	/* PSM or eDRX sleep */
+#define	ENERGY_LTE_IDLE		2	/* RRC idle */
+#define	ENERGY_LTE_CONNECTED	3	/* RRC connected */
+#define	ENERGY_GNSS_WAIT	1	/* Started, no window from LTE */
+#define	ENERGY_GNSS_ON		2
+
+struct energy_report {
+	uint32_t	ms;		/* Time covered */
+	uint32_t	msgs;		/* Messages published */
+	uint64_t	nah;		/* Charge, nAh */
+	uint32_t	ua_avg;		/* Average current, or uAh per hour */
+	uint32_t	nah_msg;	/* Charge per message, nAh */
+};
+
+void energy_init(void);
+void energy_reset(uint32_t now);
+void energy_set(int comp, int state);
+void energy_set_at(int comp, int state, uint32_t now);
+void energy_message(void);
+int energy_lookup(const char *name, int *comp, int *state);
+int energy_set_current(const char *name, uint32_t ua);
+void energy_get(struct energy_report *r, uint32_t now, uint32_t busy_ms);
+void energy_print(uint32_t now, uint32_t busy_ms);
+void energy_stats(void);
+
+#endif /* !_SRC_ENERGY_H_ */
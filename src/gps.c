@@ -45,7 +45,13 @@
 #include <nrfxlib/bsdlib/include/bsd.h>
 #include <nrfxlib/bsdlib/include/bsd_os.h>
 
+#define	LOG_MODULE	LOG_MOD_GPS
+
+#include "antenna.h"
+#include "energy.h"
 #include "gps.h"
+#include "log.h"
+#include "radio.h"
 
 static int socket;
 
@@ -69,14 +75,14 @@ print_stats(nrf_gnss_pvt_data_frame_t *pvt)
 		sv = &pvt->sv[i];
 
 		if (sv->sv > 0 && sv->sv <= 32) {
-			printf("sv %d signal %d cn0 %d elev %d az %d flag %x\n",
+			log_debug("sv %d signal %d cn0 %d elev %d az %d flag %x\n",
 			    sv->sv, sv->signal, sv->cn0, sv->elevation,
 			    sv->azimuth, sv->flags);
 
 			if (pvt->sv[i].flags & NRF_GNSS_SV_FLAG_USED_IN_FIX)
-			    printf("sat in fix %d\n", pvt->sv[i].sv);
+			    log_debug("sat in fix %d\n", pvt->sv[i].sv);
                         if (pvt->sv[i].flags & NRF_GNSS_SV_FLAG_UNHEALTHY)
-			    printf("sat unhealthy %d\n", pvt->sv[i].sv);
+			    log_debug("sat unhealthy %d\n", pvt->sv[i].sv);
 		}
 
 	}
@@ -217,6 +223,8 @@ gps_init(void)
 		return (-1);
 	}
 
+	energy_set(ENERGY_GNSS, ENERGY_GNSS_ON);
+
 	return (0);
 }
 
@@ -244,16 +252,18 @@ gps_test(void)
 		case NRF_GNSS_PVT_DATA_ID:
 			pvt = &raw_gps_data.pvt;
 			print_stats(pvt);
+			radio_gnss_pvt(pvt->flags);
+			antenna_gnss_pvt(pvt);
 			if (pvt->flags &
 			    NRF_GNSS_PVT_FLAG_NOT_ENOUGH_WINDOW_TIME) {
 				blocked = true;
-				printf("GPS blocked\n");
+				log_info("GPS blocked\n");
 				break;
 			}
 			blocked = false;
 
 			if (pvt->flags & NRF_GNSS_PVT_FLAG_DEADLINE_MISSED) {
-				printf("pvt deadline missed\n");
+				log_info("pvt deadline missed\n");
 				break;
 			}
 
@@ -273,13 +283,15 @@ gps_test(void)
 			}
 			break;
 		case NRF_GNSS_AGPS_DATA_ID:
-			printf("agps data id\n");
+			log_info("agps data id\n");
 			break;
 		default:
-			printf("unknown id %d\n", raw_gps_data.data_id);
+			log_warn("unknown id %d\n", raw_gps_data.data_id);
 			break;
 		}
 	}
 
+	energy_set(ENERGY_GNSS, ENERGY_OFF);
+
 	return (0);
 }
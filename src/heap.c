@@ -0,0 +1,410 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/malloc.h>
+
+#include <mbedtls/platform.h>
+
+#include "board.h"
+#include "heap.h"
+#include "metrics.h"
+#include "tlsf.h"
+#include "workq.h"
+
+/*
+ * Heap accounting.
+ *
+ * Every tagged allocation carries a small header with its size and
+ * tag, so the current and the peak usage is known per subsystem. The
+ * untagged allocations (the kernel, the thread stacks, the libraries
+ * calling malloc() directly) are not counted.
+ *
+ * With MALLOC_TLSF defined (board.h) the application heap is a TLSF
+ * allocator and malloc() and friends are provided here; remove the
+ * fl_wrapper option from mdepx.conf in that case. TLSF reports its
+ * free blocks directly.
+ *
+ * The fl allocator does not report its free space, so heap_probe() finds
+ * it by allocating the largest possible blocks until the heap is
+ * exhausted, then releases them. This runs in a critical section so no
+ * one else sees the heap empty. The block sizes are found to within
+ * 1/HEAP_PROBE_PREC and the allocator is called at most HEAP_PROBE_CALLS
+ * times in the search, which bounds the time spent with the interrupts
+ * off. On a heap fragmented beyond that the free space reported is a
+ * lower bound: the largest blocks only.
+ */
+
+#define	HEAP_MAGIC		0x4850
+#define	HEAP_PROBE_MAX		8	/* Blocks */
+#define	HEAP_PROBE_CALLS	48	/* malloc() calls per probe */
+#define	HEAP_PROBE_PREC		16
+#define	HEAP_PROBE_MIN		16	/* Bytes */
+#define	HEAP_PROBE_HI		(256 * 1024)
+#define	HEAP_PROBE_MS		60000
+#define	HEAP_PROBE_SLACK_MS	10000
+
+/* Print "#H" records of the tagged calls, for tools/heapreplay.c. */
+#define	HEAP_TRACE
+#undef	HEAP_TRACE
+
+struct heap_hdr {
+	uint32_t	size;
+	uint16_t	tag;
+	uint16_t	magic;
+};
+
+static const char *heap_tag_names[HEAP_NTAGS] = {
+	[HEAP_TAG_OTHER] = "other",
+	[HEAP_TAG_TLS] = "tls",
+	[HEAP_TAG_JSON] = "json",
+	[HEAP_TAG_DISK] = "disk",
+};
+
+static uint32_t heap_cur[HEAP_NTAGS];
+static uint32_t heap_peak[HEAP_NTAGS];
+static uint32_t heap_total;
+uint32_t heap_total_peak;
+static uint32_t heap_fails;
+static uint32_t heap_free_bytes;
+uint32_t heap_largest_free;
+uint32_t heap_frag;		/* permille */
+
+static struct work heap_work;
+
+#ifdef MALLOC_TLSF
+static struct tlsf heap_tlsf;
+static uint32_t heap_nfree;
+#endif
+
+static const struct metric heap_metrics[] = {
+	METRIC_U32("tls_cur", &heap_cur[HEAP_TAG_TLS]),
+	METRIC_U32("tls_peak", &heap_peak[HEAP_TAG_TLS]),
+	METRIC_U32("json_cur", &heap_cur[HEAP_TAG_JSON]),
+	METRIC_U32("json_peak", &heap_peak[HEAP_TAG_JSON]),
+	METRIC_U32("disk_cur", &heap_cur[HEAP_TAG_DISK]),
+	METRIC_U32("disk_peak", &heap_peak[HEAP_TAG_DISK]),
+	METRIC_U32("total_peak", &heap_total_peak),
+	METRIC_U32("fails", &heap_fails),
+	METRIC_U32("free", &heap_free_bytes),
+	METRIC_U32("largest_free", &heap_largest_free),
+	METRIC_U32("frag_permille", &heap_frag),
+#ifdef MALLOC_TLSF
+	METRIC_U32("free_blocks", &heap_nfree),
+#endif
+};
+
+static struct metrics_group heap_group = {
+	.name = "heap",
+	.metrics = heap_metrics,
+	.nmetrics = nitems(heap_metrics),
+};
+
+void *
+heap_alloc(int tag, size_t size)
+{
+	struct heap_hdr *h;
+
+	h = malloc(sizeof(struct heap_hdr) + size);
+	if (h == NULL) {
+		heap_fails++;
+		return (NULL);
+	}
+
+	h->size = size;
+	h->tag = tag;
+	h->magic = HEAP_MAGIC;
+
+#ifdef HEAP_TRACE
+	printf("#H a %x %u\n", (uint32_t)h, size);
+#endif
+
+	critical_enter();
+	heap_cur[tag] += size;
+	if (heap_cur[tag] > heap_peak[tag])
+		heap_peak[tag] = heap_cur[tag];
+	heap_total += size;
+	if (heap_total > heap_total_peak)
+		heap_total_peak = heap_total;
+	critical_exit();
+
+	return (h + 1);
+}
+
+void *
+heap_calloc(int tag, size_t n, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && n > (size_t)-1 / size)
+		return (NULL);
+
+	ptr = heap_alloc(tag, n * size);
+	if (ptr != NULL)
+		memset(ptr, 0, n * size);
+
+	return (ptr);
+}
+
+void
+heap_free(void *ptr)
+{
+	struct heap_hdr *h;
+
+	if (ptr == NULL)
+		return;
+
+	h = (struct heap_hdr *)ptr - 1;
+	if (h->magic != HEAP_MAGIC || h->tag >= HEAP_NTAGS)
+		panic("%s: bad pointer %p\n", __func__, ptr);
+	h->magic = 0;
+
+#ifdef HEAP_TRACE
+	printf("#H f %x\n", (uint32_t)h);
+#endif
+
+	critical_enter();
+	heap_cur[h->tag] -= h->size;
+	heap_total -= h->size;
+	critical_exit();
+
+	free(h);
+}
+
+static void *
+heap_tls_calloc(size_t n, size_t size)
+{
+
+	return (heap_calloc(HEAP_TAG_TLS, n, size));
+}
+
+#ifdef MALLOC_TLSF
+void
+heap_add_region(void *base, uint32_t size)
+{
+
+	critical_enter();
+	tlsf_add_region(&heap_tlsf, base, size);
+	critical_exit();
+}
+
+void *
+malloc(size_t size)
+{
+	void *ptr;
+
+	critical_enter();
+	ptr = tlsf_malloc(&heap_tlsf, size);
+	critical_exit();
+
+	return (ptr);
+}
+
+void
+free(void *ptr)
+{
+
+	critical_enter();
+	tlsf_free(&heap_tlsf, ptr);
+	critical_exit();
+}
+
+void *
+calloc(size_t n, size_t size)
+{
+	void *ptr;
+
+	if (size != 0 && n > (size_t)-1 / size)
+		return (NULL);
+
+	ptr = malloc(n * size);
+	if (ptr != NULL)
+		memset(ptr, 0, n * size);
+
+	return (ptr);
+}
+
+void *
+realloc(void *ptr, size_t size)
+{
+	uint32_t old;
+	void *new;
+
+	if (ptr == NULL)
+		return (malloc(size));
+
+	old = tlsf_usable_size(ptr);
+	if (size <= old)
+		return (ptr);
+
+	new = malloc(size);
+	if (new == NULL)
+		return (NULL);
+	memcpy(new, ptr, old);
+	free(ptr);
+
+	return (new);
+}
+
+void
+heap_probe(void)
+{
+	struct tlsf_stats s;
+
+	critical_enter();
+	tlsf_get_stats(&heap_tlsf, &s);
+	critical_exit();
+
+	heap_free_bytes = s.free;
+	heap_largest_free = s.largest;
+	heap_nfree = s.nfree;
+	heap_frag = 0;
+	if (s.free > 0)
+		heap_frag = 1000 - (uint64_t)s.largest * 1000 / s.free;
+}
+#else
+/*
+ * Largest block that can be allocated now, found by bisection. Stops
+ * early when the probe runs out of calls.
+ */
+static void *
+heap_probe_largest(uint32_t hi, uint32_t *size, int *calls)
+{
+	uint32_t lo, mid;
+	void *ptr;
+
+	lo = 0;
+	while (hi - lo > HEAP_PROBE_MIN && hi - lo > hi / HEAP_PROBE_PREC &&
+	    *calls < HEAP_PROBE_CALLS) {
+		mid = lo + (hi - lo) / 2;
+		ptr = malloc(mid);
+		(*calls)++;
+		if (ptr != NULL) {
+			free(ptr);
+			lo = mid;
+		} else
+			hi = mid;
+	}
+
+	*size = lo;
+	if (lo < HEAP_PROBE_MIN)
+		return (NULL);
+
+	return (malloc(lo));
+}
+
+void
+heap_probe(void)
+{
+	void *blocks[HEAP_PROBE_MAX];
+	uint32_t largest;
+	uint32_t total;
+	uint32_t size;
+	uint32_t hi;
+	int calls;
+	int n;
+
+	largest = 0;
+	total = 0;
+	calls = 0;
+	hi = HEAP_PROBE_HI;
+
+	critical_enter();
+	for (n = 0; n < HEAP_PROBE_MAX && calls < HEAP_PROBE_CALLS; n++) {
+		blocks[n] = heap_probe_largest(hi, &size, &calls);
+		if (blocks[n] == NULL)
+			break;
+		if (largest == 0)
+			largest = size;
+		total += size;
+		hi = size + HEAP_PROBE_MIN;
+	}
+	while (n-- > 0)
+		free(blocks[n]);
+	critical_exit();
+
+	heap_free_bytes = total;
+	heap_largest_free = largest;
+	heap_frag = 0;
+	if (total > 0)
+		heap_frag = 1000 - (uint64_t)largest * 1000 / total;
+}
+#endif
+
+void
+heap_usage(int tag, uint32_t *cur, uint32_t *peak)
+{
+
+	critical_enter();
+	*cur = heap_cur[tag];
+	*peak = heap_peak[tag];
+	critical_exit();
+}
+
+uint32_t
+heap_free_space(void)
+{
+
+	heap_probe();
+
+	return (heap_free_bytes);
+}
+
+static void
+heap_probe_work(struct work *w)
+{
+
+	heap_probe();
+}
+
+void
+heap_stats(void)
+{
+	int i;
+
+	heap_probe();
+
+	for (i = 0; i < HEAP_NTAGS; i++)
+		printf("heap: %-6s cur %u peak %u\n", heap_tag_names[i],
+		    heap_cur[i], heap_peak[i]);
+	printf("heap: tagged %u peak %u, %u failures\n",
+	    heap_total, heap_total_peak, heap_fails);
+	printf("heap: free %u, largest block %u, fragmentation %u%%\n",
+	    heap_free_bytes, heap_largest_free, heap_frag / 10);
+}
+
+void
+heap_init(void)
+{
+
+	mbedtls_platform_set_calloc_free(heap_tls_calloc, heap_free);
+
+	work_init(&heap_work, "heap", WORK_PRIO_LOW, heap_probe_work, NULL);
+	work_periodic(&heap_work, HEAP_PROBE_MS, HEAP_PROBE_SLACK_MS);
+
+	metrics_register(&heap_group);
+}
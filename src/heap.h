@@ -0,0 +1,50 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_HEAP_H_
+#define	_SRC_HEAP_H_
+
+#define	HEAP_TAG_OTHER		0
+#define	HEAP_TAG_TLS		1	/* mbedTLS */
+#define	HEAP_TAG_JSON		2	/* cJSON */
+#define	HEAP_TAG_DISK		3	/* LittleFS buffers, read_file() */
+#define	HEAP_NTAGS		4
+
+void heap_init(void);
+void heap_add_region(void *base, uint32_t size);
+void *heap_alloc(int tag, size_t size);
+void *heap_calloc(int tag, size_t n, size_t size);
+void heap_free(void *ptr);
+void heap_probe(void);
+void heap_usage(int tag, uint32_t *cur, uint32_t *peak);
+uint32_t heap_free_space(void);
+void heap_stats(void);
+
+extern uint32_t heap_total_peak;
+extern uint32_t heap_largest_free;
+extern uint32_t heap_frag;
+
+#endif /* !_SRC_HEAP_H_ */
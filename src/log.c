@@ -0,0 +1,248 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include <stdarg.h>
+
+#include "board.h"
+#include "clock.h"
+#include "cpu.h"
+#include "log.h"
+#include "metrics.h"
+#include "ring.h"
+#include "stack.h"
+
+/*
+ * Record: format address, meta (nargs << 16 | module << 8 | level),
+ * timestamp in ms, then the arguments. The format address and each
+ * argument are one word on the device and two in the 64-bit host
+ * build, where a %s argument would not fit in 32 bits.
+ *
+ * With LOG_BINARY defined the records are not formatted on the device
+ * but printed as "#L" lines of hex words, which tools/logdecode.py
+ * turns back into text using the ELF image.
+ */
+
+#define	LOG_RING_SIZE		4096
+#define	LOG_FMT_WORDS		(sizeof(const char *) / 4)
+#define	LOG_ARG_WORDS		(sizeof(uintptr_t) / 4)
+#define	LOG_HDR_WORDS		(LOG_FMT_WORDS + 2)
+#define	LOG_REC_WORDS		(LOG_HDR_WORDS + LOG_MAXARGS * LOG_ARG_WORDS)
+#define	LOG_REC_META		LOG_FMT_WORDS
+#define	LOG_REC_TIME		(LOG_FMT_WORDS + 1)
+#define	LOG_BENCH_N		64
+#define	LOG_STACK_SIZE		2048	/* printf(), see "stack" */
+
+#define	LOG_BINARY
+#undef	LOG_BINARY
+
+uint8_t log_levels[LOG_NMODULES] = {
+	[0 ... LOG_NMODULES - 1] = LOG_LEVEL,
+};
+
+static uint8_t log_buf[LOG_RING_SIZE];
+static struct ring log_ring;
+static mdx_sem_t log_sem;
+static struct cpu_acct log_acct = { .name = "log" };
+
+static uint32_t log_records;
+static uint32_t log_drops;
+static uint32_t log_call_cycles;
+static uint32_t log_filtered_cycles;
+static uint32_t log_printf_cycles;
+
+static const struct metric log_metrics[] = {
+	METRIC_U32("records", &log_records),
+	METRIC_U32("drops", &log_drops),
+	METRIC_U32("call_cycles", &log_call_cycles),
+	METRIC_U32("filtered_cycles", &log_filtered_cycles),
+	METRIC_U32("printf_cycles", &log_printf_cycles),
+};
+
+static struct metrics_group log_group = {
+	.name = "log",
+	.metrics = log_metrics,
+	.nmetrics = nitems(log_metrics),
+};
+
+void
+log_write(uint32_t meta, const char *fmt, ...)
+{
+	uint32_t rec[LOG_REC_WORDS];
+	uintptr_t arg;
+	uint32_t used;
+	va_list ap;
+	int nargs;
+	int err;
+	int i;
+
+	nargs = meta >> 16;
+
+	memcpy(rec, &fmt, sizeof(fmt));
+	rec[LOG_REC_META] = meta;
+	rec[LOG_REC_TIME] = clock_ms();
+
+	va_start(ap, fmt);
+	for (i = 0; i < nargs; i++) {
+		arg = va_arg(ap, uintptr_t);
+		memcpy(&rec[LOG_HDR_WORDS + i * LOG_ARG_WORDS], &arg,
+		    sizeof(arg));
+	}
+	va_end(ap);
+
+	/* Any thread or interrupt may log. */
+	critical_enter();
+	used = ring_used(&log_ring);
+	err = ring_put(&log_ring, rec,
+	    (LOG_HDR_WORDS + nargs * LOG_ARG_WORDS) * 4);
+	if (err)
+		log_drops++;
+	else
+		log_records++;
+	critical_exit();
+
+	if (err == 0 && used == 0)
+		mdx_sem_post(&log_sem);
+}
+
+void
+log_set_level(int module, int level)
+{
+
+	if (module >= 0 && module < LOG_NMODULES)
+		log_levels[module] = level;
+}
+
+#ifdef LOG_BINARY
+static void
+log_print(uint32_t *rec, int nwords)
+{
+	int i;
+
+	printf("#L");
+	for (i = 0; i < nwords; i++)
+		printf(" %08x", rec[i]);
+	printf("\n");
+}
+#else
+static void
+log_print(uint32_t *rec, int nwords)
+{
+	static const char levels[] = "EWID";
+	uintptr_t a[LOG_MAXARGS];
+	const char *fmt;
+
+	memcpy(&fmt, rec, sizeof(fmt));
+	memset(a, 0, sizeof(a));
+	memcpy(a, &rec[LOG_HDR_WORDS], (nwords - LOG_HDR_WORDS) * 4);
+
+	printf("[%u.%03u] %c ", rec[LOG_REC_TIME] / 1000,
+	    rec[LOG_REC_TIME] % 1000, levels[rec[LOG_REC_META] & 0x3]);
+	printf(fmt, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+}
+#endif
+
+static void
+log_thread(void *arg)
+{
+	uint32_t rec[LOG_REC_WORDS];
+	int nwords;
+
+	while (1) {
+		if (ring_used(&log_ring) == 0) {
+			mdx_sem_wait(&log_sem);
+			continue;
+		}
+
+		ring_get(&log_ring, rec, LOG_HDR_WORDS * 4);
+		nwords = (rec[LOG_REC_META] >> 16) * LOG_ARG_WORDS;
+		ring_get(&log_ring, &rec[LOG_HDR_WORDS], nwords * 4);
+
+		cpu_acct_enter(&log_acct);
+		log_print(rec, LOG_HDR_WORDS + nwords);
+		cpu_acct_exit(&log_acct);
+	}
+}
+
+/*
+ * Measure the cost of a log call, in CPU cycles.
+ */
+void
+log_bench(void)
+{
+	uint32_t t0, t1;
+	int level;
+	int i;
+
+	t0 = clock_cycles();
+	for (i = 0; i < LOG_BENCH_N; i++)
+		log_info("bench %d of %d\n", i, LOG_BENCH_N);
+	t1 = clock_cycles();
+	log_call_cycles = (t1 - t0) / LOG_BENCH_N;
+
+	/* Filtered out at run time. */
+	level = log_levels[LOG_MODULE];
+	log_levels[LOG_MODULE] = LOG_WARN;
+	t0 = clock_cycles();
+	for (i = 0; i < LOG_BENCH_N; i++)
+		log_info("bench %d of %d\n", i, LOG_BENCH_N);
+	t1 = clock_cycles();
+	log_levels[LOG_MODULE] = level;
+	log_filtered_cycles = (t1 - t0) / LOG_BENCH_N;
+
+	t0 = clock_cycles();
+	printf("bench %d of %d\n", 0, LOG_BENCH_N);
+	t1 = clock_cycles();
+	log_printf_cycles = t1 - t0;
+
+	printf("%s: log call %u cycles, filtered %u, printf %u\n",
+	    __func__, log_call_cycles, log_filtered_cycles,
+	    log_printf_cycles);
+}
+
+void
+log_init(void)
+{
+	struct thread *td;
+
+	ring_init(&log_ring, log_buf, LOG_RING_SIZE);
+	mdx_sem_init(&log_sem, 0);
+	cpu_acct_register(&log_acct);
+
+	/* Drained when nothing else runs, the ring absorbs the bursts. */
+	td = mdx_thread_create("log", PRIO_BACKGROUND, 0, LOG_STACK_SIZE,
+	    log_thread, NULL);
+	if (td == NULL)
+		panic("failed to create log thread\n");
+	stack_watch(td);
+	mdx_sched_add(td);
+
+	metrics_register(&log_group);
+}
@@ -0,0 +1,94 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_LOG_H_
+#define	_SRC_LOG_H_
+
+/*
+ * Deferred logging.
+ *
+ * A log call stores the format string address and up to eight
+ * pointer-sized arguments into a RAM ring; a background thread formats
+ * and prints them later. The format string must stay in flash, and so
+ * must the %s arguments: strings on the stack or in a buffer are gone
+ * by the time the record is printed, use printf() for them. 64-bit and
+ * floating point arguments are not supported.
+ *
+ * Define LOG_MODULE (and optionally LOG_LEVEL) before including.
+ */
+
+#define	LOG_ERR		0
+#define	LOG_WARN	1
+#define	LOG_INFO	2
+#define	LOG_DEBUG	3
+
+#define	LOG_MOD_MAIN	0
+#define	LOG_MOD_RADIO	1
+#define	LOG_MOD_AT	2
+#define	LOG_MOD_GPS	3
+#define	LOG_MOD_TLS	4
+#define	LOG_MOD_MQTT	5
+#define	LOG_MOD_MBEDTLS	6
+#define	LOG_MOD_SENSOR	7
+#define	LOG_NMODULES	8
+
+#define	LOG_MAXARGS	8
+
+/* Compile time filter */
+#ifndef	LOG_LEVEL
+#define	LOG_LEVEL	LOG_INFO
+#endif
+
+#ifndef	LOG_MODULE
+#define	LOG_MODULE	LOG_MOD_MAIN
+#endif
+
+#define	LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...)	n
+#define	LOG_NARGS(...)							\
+	LOG_NARGS_(_0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+#define	LOG_META(lvl, n)	((n) << 16 | LOG_MODULE << 8 | (lvl))
+
+#define	log_printf(lvl, fmt, ...)	do {				\
+	if ((lvl) <= LOG_LEVEL && (lvl) <= log_levels[LOG_MODULE])	\
+		log_write(LOG_META(lvl, LOG_NARGS(__VA_ARGS__)),	\
+		    fmt, ##__VA_ARGS__);				\
+} while (0)
+
+#define	log_err(fmt, ...)	log_printf(LOG_ERR, fmt, ##__VA_ARGS__)
+#define	log_warn(fmt, ...)	log_printf(LOG_WARN, fmt, ##__VA_ARGS__)
+#define	log_info(fmt, ...)	log_printf(LOG_INFO, fmt, ##__VA_ARGS__)
+#define	log_debug(fmt, ...)	log_printf(LOG_DEBUG, fmt, ##__VA_ARGS__)
+
+/* Run time filter */
+extern uint8_t log_levels[LOG_NMODULES];
+
+void log_init(void);
+void log_write(uint32_t meta, const char *fmt, ...);
+void log_set_level(int module, int level);
+void log_bench(void);
+
+#endif /* !_SRC_LOG_H_ */
@@ -0,0 +1,171 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/sem.h>
+
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+#include <nrfxlib/bsdlib/include/bsd.h>
+#include <nrfxlib/bsdlib/include/bsd_os.h>
+
+#include "at.h"
+#include "cell.h"
+#include "lte.h"
+#include "psm.h"
+
+static const char cind[] __unused = "AT+CIND?";
+static const char subscribe[] = "AT+CEREG=5";
+static const char cscon_subscribe[] = "AT+CSCON=1";
+static const char cgact[] __unused = "AT+CGACT=1,1";
+static const char cgatt[] __unused = "AT+CGATT=1";
+static const char cgdcont[] __unused = "AT+CGDCONT?";
+static const char cgdcont_req[] __unused =
+    "AT+CGDCONT=1,\"IP\",\"ibasis.iot\"";
+static const char cgpaddr[] __unused = "AT+CGPADDR";
+static const char cesq[] __unused = "AT+CESQ";
+static const char cpsms[] __unused = "AT+CPSMS=";
+
+/*
+ * Read the extended signal quality.
+ * Returns -1 if the modem has no measurement (e.g. in PSM).
+ */
+int
+lte_cesq(int *rsrp, int *rsrq)
+{
+	char buf[LC_MAX_READ_LENGTH];
+	int val;
+	char *t, *p;
+
+	if (at_cmd(cesq, buf, LC_MAX_READ_LENGTH) != AT_RESULT_OK)
+		return (-1);
+
+	if (strncmp(buf, "+CESQ: ", 7) != 0)
+		return (-1);
+
+	t = (char *)buf;
+
+	p = strsep(&t, ",");	/* +CESQ: rxlev */
+	p = strsep(&t, ",");	/* ber */
+	p = strsep(&t, ",");	/* rscp */
+	p = strsep(&t, ",");	/* echo */
+	p = strsep(&t, ",");	/* rsrq */
+	if (p == NULL || (val = atoi(p)) == 255)
+		return (-1);
+	*rsrq = val / 2 - 20;
+
+	p = strsep(&t, ",");	/* rsrp */
+	if (p == NULL || (val = atoi(p)) == 255)
+		return (-1);
+	*rsrp = val - 141;
+
+	return (0);
+}
+
+static int __unused
+check_ipaddr(char *buf)
+{
+	char *t;
+	char *p;
+
+	t = (char *)buf;
+
+	printf("%s: %s\n", __func__, buf);
+
+	p = strsep(&t, ",");
+	if (p == NULL || strcmp(p, "+CGDCONT: 0") != 0)
+		return (0);
+
+	p = strsep(&t, ",");
+	if (p == NULL || strcmp(p, "\"IP\"") != 0)
+		return (0);
+
+	p = strsep(&t, ",");
+	if (p == NULL || strcmp(p, "\"\"") == 0)
+		return (0);
+
+	printf("APN: %s\n", p);
+
+	p = strsep(&t, ",");
+	if (p == NULL || strcmp(p, "\"\"") == 0)
+		return (0);
+
+	printf("IP: %s\n", p);
+
+	/* Success */
+
+	return (1);
+}
+
+/*
+ * Parse the +CEREG notification.
+ * Returns the registration status or -1 if buf is not a +CEREG.
+ */
+int
+lte_cereg(const char *buf)
+{
+
+	if (strncmp(buf, "+CEREG: ", 8) != 0)
+		return (-1);
+
+	return (atoi(buf + 8));
+}
+
+/*
+ * Parse the +CSCON notification.
+ * Returns 1 if RRC is connected, 0 if idle or -1 if buf is not a +CSCON.
+ */
+int
+lte_cscon(const char *buf)
+{
+
+	if (strncmp(buf, "+CSCON: ", 8) != 0)
+		return (-1);
+
+	return (atoi(buf + 8));
+}
+
+/*
+ * Configure the LTE link while the modem is in the flight mode.
+ */
+int
+lte_configure(void)
+{
+
+	/* Switch to power saving mode as required for GPS to operate. */
+	psm_request();
+
+	at_cmd(cind, NULL, 0);
+
+	/* Lock to the cached band, or bands 3,4,13,20. */
+	cell_lock();
+
+	/* Subscribe for events. */
+	at_cmd(subscribe, NULL, 0);
+	at_cmd(cscon_subscribe, NULL, 0);
+
+	return (0);
+}
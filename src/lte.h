@@ -27,6 +27,17 @@
 #ifndef _SRC_LTE_H_
 #define	_SRC_LTE_H_
 
-int lte_connect(void);
+/* +CEREG <stat> */
+#define	CEREG_NOT_REGISTERED	0
+#define	CEREG_HOME		1
+#define	CEREG_SEARCHING		2
+#define	CEREG_DENIED		3
+#define	CEREG_UNKNOWN		4
+#define	CEREG_ROAMING		5
+
+int lte_configure(void);
+int lte_cereg(const char *buf);
+int lte_cscon(const char *buf);
+int lte_cesq(int *rsrp, int *rsrq);
 
 #endif /* !_SRC_LTE_H_ */
@@ -30,6 +30,10 @@
 #include <mbedtls/entropy_poll.h>
 #include <mbedtls/platform_util.h>
 
+#define	LOG_MODULE	LOG_MOD_MBEDTLS
+
+#include "log.h"
+
 int get_random_number(uint8_t *out, int size);
 
 void
@@ -48,7 +52,7 @@ mbedtls_platform_entropy_poll( void *data,
 
 	size = len > 48 ? 48 : len;
 
-	printf("%s: len %d\n", __func__, len);
+	log_debug("%s: len %d\n", __func__, len);
 
 	err = get_random_number(output, size);
 	if (err)
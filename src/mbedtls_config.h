@@ -29,6 +29,16 @@
 #ifndef MBEDTLS_CONFIG_H
 #define MBEDTLS_CONFIG_H
 
+/*
+ * Configuration profiles, selected with -DMBEDTLS_PROFILE_<name>.
+ * The full profile below is the default. Compare them with
+ * 'make footprint-profiles', see tools/footprint.py.
+ */
+#if defined(MBEDTLS_PROFILE_MIN)
+#include "mbedtls_config_min.h"
+#elif defined(MBEDTLS_PROFILE_TLS12)
+#include "mbedtls_config_tls12.h"
+#else
 #define MBEDTLS_CIPHER_MODE_CBC
 #define MBEDTLS_CIPHER_MODE_CFB
 #define MBEDTLS_CIPHER_MODE_CTR
@@ -68,6 +78,7 @@
 #define MBEDTLS_PK_PARSE_EC_EXTENDED
 #define MBEDTLS_PKCS1_V15
 #define MBEDTLS_PKCS1_V21
+#define MBEDTLS_PLATFORM_MEMORY
 #define MBEDTLS_SSL_ALL_ALERT_MESSAGES
 #define MBEDTLS_SSL_RECORD_CHECKING
 #define MBEDTLS_SSL_CONTEXT_SERIALIZATION
@@ -124,6 +135,7 @@
 #define MBEDTLS_PK_PARSE_C
 #define MBEDTLS_PKCS5_C
 #define MBEDTLS_PKCS12_C
+#define MBEDTLS_PLATFORM_C
 #define MBEDTLS_POLY1305_C
 #define MBEDTLS_RIPEMD160_C
 #define MBEDTLS_RSA_C
@@ -140,5 +152,6 @@
 #define MBEDTLS_X509_CRL_PARSE_C
 #define MBEDTLS_X509_CSR_PARSE_C
 #define MBEDTLS_TLS_DEFAULT_ALLOW_SHA1_IN_KEY_EXCHANGE
+#endif
 
 #endif /* MBEDTLS_CONFIG_H */
@@ -0,0 +1,111 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include "metrics.h"
+
+/*
+ * A registry of the counters exported by the subsystems.
+ * The values are read without locking: a metric is a single
+ * aligned word and is good enough for the reporting.
+ */
+
+static struct entry groups;
+
+void
+metrics_register(struct metrics_group *group)
+{
+
+	critical_enter();
+	list_append(&groups, &group->node);
+	critical_exit();
+}
+
+static void
+metrics_dump_group(struct metrics_group *group)
+{
+	const struct metric *m;
+	int i;
+
+	for (i = 0; i < group->nmetrics; i++) {
+		m = &group->metrics[i];
+		if (m->type == METRIC_TYPE_I32)
+			printf("%s.%s %d\n", group->name, m->name,
+			    *(const volatile int32_t *)m->ptr);
+		else
+			printf("%s.%s %u\n", group->name, m->name,
+			    *(const volatile uint32_t *)m->ptr);
+	}
+}
+
+void
+metrics_dump(void)
+{
+	struct metrics_group *group;
+	struct entry *e;
+
+	for (e = groups.next; e != &groups; e = e->next) {
+		group = CONTAINER_OF(e, struct metrics_group, node);
+		metrics_dump_group(group);
+	}
+}
+
+/*
+ * Read one metric, e.g. for a test. The signed ones are returned as
+ * the same word.
+ */
+int
+metrics_read(const char *group_name, const char *name, uint32_t *val)
+{
+	struct metrics_group *group;
+	const struct metric *m;
+	struct entry *e;
+	int i;
+
+	for (e = groups.next; e != &groups; e = e->next) {
+		group = CONTAINER_OF(e, struct metrics_group, node);
+		if (strcmp(group->name, group_name) != 0)
+			continue;
+		for (i = 0; i < group->nmetrics; i++) {
+			m = &group->metrics[i];
+			if (strcmp(m->name, name) == 0) {
+				*val = *(const volatile uint32_t *)m->ptr;
+				return (0);
+			}
+		}
+	}
+
+	return (-1);
+}
+
+void
+metrics_init(void)
+{
+
+	list_init(&groups);
+}
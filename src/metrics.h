@@ -0,0 +1,54 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_METRICS_H_
+#define	_SRC_METRICS_H_
+
+#define	METRIC_TYPE_U32	0
+#define	METRIC_TYPE_I32	1
+
+struct metric {
+	const char		*name;
+	const volatile void	*ptr;
+	int			type;
+};
+
+#define	METRIC_U32(n, p)	{ (n), (p), METRIC_TYPE_U32 }
+#define	METRIC_I32(n, p)	{ (n), (p), METRIC_TYPE_I32 }
+
+struct metrics_group {
+	const char		*name;
+	const struct metric	*metrics;
+	int			nmetrics;
+	struct entry		node;
+};
+
+void metrics_init(void);
+void metrics_register(struct metrics_group *group);
+void metrics_dump(void);
+int metrics_read(const char *group_name, const char *name, uint32_t *val);
+
+#endif /* !_SRC_METRICS_H_ */
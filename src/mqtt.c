@@ -27,6 +27,7 @@
 #include <sys/cdefs.h>
 #include <sys/systm.h>
 #include <sys/malloc.h>
+#include <sys/thread.h>
 
 #include <nrfxlib/bsdlib/include/nrf_socket.h>
 #include <nrfxlib/bsdlib/include/bsd.h>
@@ -40,19 +41,35 @@
 #include <mbedtls/error.h>
 #include <mbedtls/debug.h>
 
-#include <littlefs/lfs.h>
-
 #include <cJSON/cJSON.h>
 #include <mqtt/mqtt.h>
+
+#define	LOG_MODULE	LOG_MOD_MQTT
+
 #include "app.h"
+#include "boot.h"
+#include "clock.h"
+#include "cpu.h"
+#include "energy.h"
+#include "metrics.h"
 #include "mqtt.h"
-#include "lte.h"
+#include "psm.h"
+#include "radio.h"
 #include "board.h"
+#include "disk.h"
+#include "heap.h"
+#include "log.h"
+#include "stack.h"
+#include "trace.h"
 
 #define	TCP_HOST	"akc28iu7dn5ra-ats.iot.eu-west-2.amazonaws.com"
 #define	TCP_PORT	8883
 
 #define	IOT_SSL_READ_TIMEOUT	10
+
+/* Publication interval and the downlink latency target, for psm.c. */
+#define	MQTT_REPORT_S		1
+#define	MQTT_DL_LATENCY_S	60
 #define	DEBUG_LEVEL		4
 #define MBEDTLS_DEBUG
 #undef	MBEDTLS_DEBUG
@@ -73,6 +90,24 @@ static mbedtls_ctr_drbg_context ctr_drbg;
 static mbedtls_x509_crt cacert, clicert;
 static mbedtls_pk_context pkey;
 static mbedtls_ssl_config ssl_conf;
+static int tls_ready;
+
+/* Handshake cost, to compare the mbedTLS configuration profiles. */
+static uint32_t mqtt_handshakes;
+static uint32_t mqtt_handshake_ms;
+static uint32_t mqtt_handshake_max_ms;
+
+static const struct metric mqtt_metrics[] = {
+	METRIC_U32("handshakes", &mqtt_handshakes),
+	METRIC_U32("handshake_ms", &mqtt_handshake_ms),
+	METRIC_U32("handshake_max_ms", &mqtt_handshake_max_ms),
+};
+
+static struct metrics_group mqtt_group = {
+	.name = "mqtt",
+	.metrics = mqtt_metrics,
+	.nmetrics = nitems(mqtt_metrics),
+};
 
 static void mqtt_event(struct mqtt_client *c,
     enum mqtt_connection_event ev);
@@ -82,97 +117,6 @@ static mdx_sem_t sem_reconn;
 /* Personalization string for the drbg. */
 static const char *DRBG_PERS = "mdep secure mqtt client";
 
-static lfs_t lfs;
-
-static int
-disk_read(const struct lfs_config *c, lfs_block_t block,
-    lfs_off_t off, void *buffer, lfs_size_t size)
-{
-	void *addr;
-
-	addr = (void *)(DISK_ADDRESS + block * c->block_size + off);
-
-#if 0
-	printf("%s: block %d off %x size %d, address %p\n",
-	    __func__, block, off, size, addr);
-	printf("word %x\n", *(uint32_t *)addr);
-#endif
-
-	memcpy(buffer, addr, size);
-
-	return (0);
-}
-
-const struct lfs_config cfg = {
-	/* block device operations */
-	.read  = disk_read,
-#if 0
-	.prog  = disk_prog,
-	.erase = disk_erase,
-	.sync  = disk_sync,
-#endif
-
-	/* block device configuration */
-	.read_size = 16,
-	.prog_size = 16,
-	.block_size = 512,
-	.block_count = 32,
-	.cache_size = 16,
-	.lookahead_size = 16,
-	.block_cycles = 500,
-};
-
-static int
-read_file(const char *filename, void **addr, uint32_t *size)
-{
-	static lfs_file_t file;
-	uint8_t *ptr;
-	int err;
-
-	err = lfs_mount(&lfs, &cfg);
-	if (err) {
-		printf("%s: could not mount\n", __func__);
-		return (err);
-	}
-
-	err = lfs_file_open(&lfs, &file, filename, LFS_O_RDONLY);
-	if (err) {
-		printf("%s: could not open file, err %d\n", __func__, err);
-		return (err);
-	}
-
-	ptr = malloc(file.ctz.size + 1);
-	if (ptr == NULL) {
-		printf("%s: could not allocate %d bytes\n",
-		    __func__, file.ctz.size + 1);
-		return (-1);
-	}
-
-	err = lfs_file_read(&lfs, &file, ptr, file.ctz.size);
-	if (err != file.ctz.size) {
-		printf("%s: could not read file, err %d\n", __func__, err);
-		return (err);
-	}
-
-	err = lfs_file_close(&lfs, &file);
-	if (err) {
-		/* Memory leak ? */
-		printf("%s: cant close the file\n", __func__);
-	}
-
-	err = lfs_unmount(&lfs);
-	if (err)
-		printf("%s: could not unmount\n", __func__);
-
-	/* Make mbedtls happy. */
-	ptr[file.ctz.size] = '\0';
-
-	*size = file.ctz.size + 1;
-	*addr = ptr;
-
-	return (0);
-}
-
 static void
 nrf_close1(int fd)
 {
@@ -247,6 +191,8 @@ net_read(struct mqtt_network *net, uint8_t *buf, int len)
 	dprintf("%s: len %d\n", __func__, len);
 	err = mbedtls_ssl_read(&ssl, (unsigned char *)buf, len); //sizeof(buf));
 	dprintf("%s: err %d\n", __func__, err);
+	if ((int)err > 0)
+		trace_event(TRACE_MQTT_RX, buf[0] << 16 | err);
 
 	if (err == MBEDTLS_ERR_SSL_TIMEOUT)
 		err = -1;
@@ -260,6 +206,7 @@ net_write(struct mqtt_network *net, uint8_t *buf, int len)
 	size_t err;
 
 	dprintf("%s: len %d\n", __func__, len);
+	trace_event(TRACE_MQTT_TX, (buf[0] >> 4) << 16 | len);
 	err = mbedtls_ssl_write(&ssl, (const unsigned char *)buf, len);
 
 #if 0
@@ -281,7 +228,9 @@ ssl_recv(void *arg, unsigned char *buf, size_t len)
 	fd = (int)arg;
 
 	dprintf("%s: len %d\n", __func__, len);
+	trace_begin(TRACE_RECV, len);
 	err = nrf_recv(fd, buf, len, 0); //NRF_MSG_DONTWAIT);
+	trace_end(TRACE_RECV, err);
 	dprintf("%s: err %d\n", __func__, err);
 
 	return (err);
@@ -303,7 +252,9 @@ ssl_recv_timeout(void *arg, unsigned char *buf, size_t len, uint32_t timeout)
 
 	dprintf("%s: len %d, timeout %d\n", __func__, len, timeout);
 
+	trace_begin(TRACE_POLL, timeout);
 	retval = nrf_poll(&fds, 1, timeout * 1000);
+	trace_end(TRACE_POLL, retval);
 
 	dprintf("%s: nrf_poll ret %d, returned %x\n", __func__,
 	    retval, fds.returned);
@@ -316,8 +267,11 @@ ssl_recv_timeout(void *arg, unsigned char *buf, size_t len, uint32_t timeout)
 
 	err = 0;
 
-	if (fds.revents & NRF_POLLIN)
+	if (fds.revents & NRF_POLLIN) {
+		trace_begin(TRACE_RECV, len);
 		err = nrf_recv(fd, buf, len, 0);
+		trace_end(TRACE_RECV, err);
+	}
 
 	return (err);
 }
@@ -331,7 +285,9 @@ ssl_send(void *arg, const unsigned char *buf, size_t len)
 	fd = (int)arg;
 
 	dprintf("%s: len %d\n", __func__, len);
+	trace_begin(TRACE_SEND, len);
 	err = nrf_send(fd, buf, len, 0);
+	trace_end(TRACE_SEND, err);
 	dprintf("%s: err %d\n", __func__, err);
 
 	return (err);
@@ -372,10 +328,13 @@ my_verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *flags)
 }
 #endif
 
+/*
+ * Seed the DRBG, parse the credentials and set up the TLS configuration.
+ * Done once, the configuration is kept across the reconnects.
+ */
 static int
-mqtt_handshake(int fd)
+mqtt_tls_setup(void)
 {
-	char cbuf[1024];
 	uint32_t size;
 	void *addr;
 	int err;
@@ -403,7 +362,7 @@ mqtt_handshake(int fd)
 		return (-1);
 	}
 	err = mbedtls_x509_crt_parse(&cacert, addr, size);
-	free(addr);
+	heap_free(addr);
 	if (err) {
 		printf("failed to parse cacert, err %d\n", err);
 		return (-1);
@@ -428,7 +387,7 @@ mqtt_handshake(int fd)
 		return (-1);
 	}
 	err = mbedtls_pk_parse_key(&pkey, addr, size, NULL, 0);
-	free(addr);
+	heap_free(addr);
 	if (err) {
 		printf("could not parse pk key, err %d\n", err);
 		return (-1);
@@ -441,7 +400,7 @@ mqtt_handshake(int fd)
 		return (-1);
 	}
 	err = mbedtls_x509_crt_parse(&clicert, addr, size);
-	free(addr);
+	heap_free(addr);
 	if (err) {
 		printf("could not read certificate, err %d\n", err);
 		return (-1);
@@ -470,6 +429,36 @@ mqtt_handshake(int fd)
 	mbedtls_ssl_conf_read_timeout(&ssl_conf, 10);
 	mbedtls_ssl_conf_handshake_timeout(&ssl_conf, 5, 15);
 
+	tls_ready = 1;
+
+	return (0);
+}
+
+static void
+mqtt_tls_free(void)
+{
+
+	mbedtls_entropy_free(&entropy);
+	mbedtls_ctr_drbg_free(&ctr_drbg);
+	mbedtls_x509_crt_free(&cacert);
+	mbedtls_x509_crt_free(&clicert);
+	mbedtls_ssl_free(&ssl);
+	mbedtls_ssl_config_free(&ssl_conf);
+	mbedtls_pk_free(&pkey);
+
+	tls_ready = 0;
+}
+
+static int
+mqtt_handshake(int fd)
+{
+	char cbuf[1024];
+	uint32_t start;
+	int err;
+
+	mbedtls_ssl_free(&ssl);
+	mbedtls_ssl_init(&ssl);
+
 	err = mbedtls_ssl_setup(&ssl, &ssl_conf);
 	if (err) {
 		printf("failed to setup ssl, err %d\n", err);
@@ -480,12 +469,26 @@ mqtt_handshake(int fd)
 	mbedtls_ssl_set_bio(&ssl, (void *)fd,
 	    ssl_send, ssl_recv, ssl_recv_timeout);
 
-	err = mbedtls_ssl_handshake(&ssl);
+	/* mbedtls_ssl_handshake(), one step at a time for the trace. */
+	start = clock_ms();
+	err = 0;
+	while (ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+		trace_begin(TRACE_HANDSHAKE, ssl.state);
+		err = mbedtls_ssl_handshake_step(&ssl);
+		trace_end(TRACE_HANDSHAKE, err);
+		if (err)
+			break;
+	}
 	if (err) {
 		printf("Failed to handshake, err %d\n", err);
 		return (-1);
 	}
 
+	mqtt_handshakes++;
+	mqtt_handshake_ms = clock_ms() - start;
+	if (mqtt_handshake_ms > mqtt_handshake_max_ms)
+		mqtt_handshake_max_ms = mqtt_handshake_ms;
+
 	err = mbedtls_ssl_get_record_expansion(&ssl);
 	if (err >= 0)
 		printf("Record expansion is %d\n", err);
@@ -615,16 +618,21 @@ mqtt_test_subscribe(void)
 }
 
 static int
-mqtt_test_publish(void)
+mqtt_test_publish(uint32_t *bytes)
 {
 	struct mqtt_request m;
 	char *str;
 	int err;
 
+	/* The report carries the CPU duty of the interval it closes. */
+	cpu_duty();
+
 	/* Get JSON file for sensor data */
 	str = app1();
-	if (str == NULL)
+	if (str == NULL) {
+		app_release(NULL);
 		return (0);
+	}
 
 	memset(&m, 0, sizeof(struct mqtt_request));
 	m.qos = 1;
@@ -634,14 +642,17 @@ mqtt_test_publish(void)
 	m.topic_len = 9;
 
 	err = mqtt_publish(&client, &m);
+	app_release(str);
 	if (err != 0) {
 		printf("%s: can't publish\n", __func__);
 		return (-1);
 	}
 
 	printf("%s: publish succeeded\n", __func__);
+	boot_first_publish();
+	energy_message();
 
-	free(str);
+	*bytes += m.data_len;
 
 	return (0);
 }
@@ -651,6 +662,7 @@ mqtt_thread(void *arg)
 {
 	struct mqtt_network *net;
 	struct mqtt_client *c;
+	uint32_t bytes;
 	int err;
 	int retry;
 
@@ -663,15 +675,27 @@ mqtt_thread(void *arg)
 		printf("%s: Waiting for a semaphore...\n", __func__);
 		mdx_sem_wait(&sem_reconn);
 
-		printf("%s: Freeing SSL configuration\n", __func__);
+		err = radio_uplink_begin(RADIO_UPLINK_NORMAL);
+		if (err) {
+			printf("%s: LTE is not available\n", __func__);
+			radio_uplink_end(0);
+			mdx_sem_post(&sem_reconn);
+			mdx_usleep(1000000);
+			continue;
+		}
 
-		mbedtls_entropy_free(&entropy);
-		mbedtls_ctr_drbg_free(&ctr_drbg);
-		mbedtls_x509_crt_free(&cacert);
-		mbedtls_x509_crt_free(&clicert);
-		mbedtls_ssl_free(&ssl);
-		mbedtls_ssl_config_free(&ssl_conf);
-		mbedtls_pk_free(&pkey);
+		if (tls_ready == 0) {
+			log_info("%s: Setting up SSL configuration\n",
+			    __func__);
+			mqtt_tls_free();
+			err = mqtt_tls_setup();
+			if (err) {
+				radio_uplink_end(0);
+				mdx_sem_post(&sem_reconn);
+				mdx_usleep(1000000);
+				continue;
+			}
+		}
 
 		printf("%s: trying to SSL connect\n", __func__);
 		err = mqtt_ssl_connect(net);
@@ -680,6 +704,7 @@ mqtt_thread(void *arg)
 			    __func__, err);
 
 			printf("can't connect, retry count %d\n", retry);
+			radio_uplink_end(0);
 			mdx_sem_post(&sem_reconn);
 			mdx_usleep(1000000);
 			continue;
@@ -692,6 +717,7 @@ mqtt_thread(void *arg)
 			printf("%s: can't connect to the MQTT broker\n",
 			    __func__);
 			nrf_close1(net->fd);
+			radio_uplink_end(0);
 			mdx_sem_post(&sem_reconn);
 			mdx_usleep(1000000);
 			continue;
@@ -702,24 +728,36 @@ mqtt_thread(void *arg)
 			printf("%s: can't subscribe\n",
 			    __func__);
 			nrf_close1(net->fd);
+			radio_uplink_end(0);
 			mdx_sem_post(&sem_reconn);
 			mdx_usleep(1000000);
 			continue;
 		}
 
+		/*
+		 * Release the radio between the publications so the
+		 * scheduler can batch them into LTE active periods.
+		 */
+		bytes = 0;
 		do {
-			err = mqtt_test_publish();
+			err = mqtt_test_publish(&bytes);
 			if (err)
 				break;
 			err = mqtt_poll(c);
 			if (err)
 				break;
-			mdx_usleep(1000000);
+			radio_uplink_end(bytes);
+			bytes = 0;
+			mdx_usleep(MQTT_REPORT_S * 1000000);
+			err = radio_uplink_begin(RADIO_UPLINK_NORMAL);
+			if (err)
+				break;
 			err = mqtt_poll(c);
 			if (err)
 				break;
 		} while (err == 0);
 
+		radio_uplink_end(bytes);
 		nrf_close1(net->fd);
 		mdx_sem_post(&sem_reconn);
 		mdx_usleep(1000000);
@@ -752,8 +790,12 @@ mqtt_cb(struct mqtt_client *c, struct mqtt_request *m)
 	printf(" data: %s\n", m->data);
 }
 
+/*
+ * The connection independent part: the client and the TLS
+ * configuration. May run before the network is up.
+ */
 int
-mqtt_test(void)
+mqtt_prepare(void)
 {
 	int err;
 
@@ -763,23 +805,47 @@ mqtt_test(void)
 		return (-3);
 	}
 
-	mdx_sem_init(&sem_reconn, 1);
+	metrics_register(&mqtt_group);
+
+	/* Before the attach if possible, see psm_set_targets(). */
+	psm_set_targets(MQTT_REPORT_S, MQTT_DL_LATENCY_S);
+
+	/* Missing credentials or no entropy: retrying would not help. */
+	err = mqtt_tls_setup();
+	if (err) {
+		log_err("%s: can't set up TLS\n", __func__);
+		mqtt_tls_free();
+		return (-4);
+	}
 
-	lte_connect();
+	return (0);
+}
+
+/*
+ * Start the MQTT thread. Depends on mqtt_prepare().
+ */
+int
+mqtt_start(void)
+{
+
+	if (tls_ready == 0) {
+		log_err("%s: TLS is not set up, MQTT is not started\n",
+		    __func__);
+		return (-4);
+	}
+
+	mdx_sem_init(&sem_reconn, 1);
 
 #if 1
 	struct thread *td;
-	td = mdx_thread_create("mqtt recv", 1, 0, 16384,
+	td = mdx_thread_create("mqtt recv", PRIO_NORMAL, 0, 16384,
 	    mqtt_thread, &client);
 	if (td == NULL) {
 		printf("Failed to create thread\n");
 		return (-2);
 	}
+	stack_watch(td);
 	mdx_sched_add(td);
-	while (1) {
-		mdx_usleep(1000000);
-		printf(".");
-	}
 #else
 	mqtt_thread(&client);
 #endif
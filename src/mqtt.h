@@ -27,6 +27,7 @@
 #ifndef _SRC_MQTT_H_
 #define	_SRC_MQTT_H_
 
-int mqtt_test(void);
+int mqtt_prepare(void);
+int mqtt_start(void);
 
 #endif /* !_SRC_MQTT_H_ */
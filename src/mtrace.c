@@ -0,0 +1,243 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <dev/gpio/gpio.h>
+
+#include "board.h"
+#include "disk.h"
+#include "metrics.h"
+#include "mtrace.h"
+#include "ring.h"
+#include "stack.h"
+
+/*
+ * Modem trace sink.
+ *
+ * bsdlib hands the trace chunks over in the trace interrupt. They are
+ * copied into a RAM ring, or dropped whole if it is full, and a
+ * background thread drains the ring to UARTE2 (1 Mbaud, TX only) for
+ * the Nordic trace tools. With MTRACE_FILE defined, the trace goes to
+ * a LittleFS file instead, up to MTRACE_FILE_MAX bytes.
+ */
+
+#define	MTRACE_RING_SIZE	16384
+#define	MTRACE_FILE_NAME	"mtrace"
+#define	MTRACE_FILE_MAX		4096	/* The disk is 16 KB only */
+#define	MTRACE_FILE_BATCH	512
+
+#define	MTRACE_FILE
+#undef	MTRACE_FILE
+
+#define	UARTE_BASE		0x4000a000	/* UARTE2_NS */
+#define	UARTE_TASKS_STARTTX	0x008
+#define	UARTE_EVENTS_ENDTX	0x120
+#define	UARTE_ENABLE		0x500
+#define	 ENABLE_UARTE		8
+#define	UARTE_PSEL_TXD		0x50c
+#define	UARTE_PSEL_RXD		0x514
+#define	UARTE_PSEL_RTS		0x508
+#define	UARTE_PSEL_CTS		0x510
+#define	 PSEL_DISCONNECT	(1U << 31)
+#define	UARTE_BAUDRATE		0x524
+#define	 BAUDRATE_1M		0x10000000
+#define	UARTE_TXD_PTR		0x544
+#define	UARTE_TXD_MAXCNT	0x548
+#define	UARTE_CONFIG		0x56c
+
+#define	UARTE_REG(reg)		(*(volatile uint32_t *)(UARTE_BASE + (reg)))
+
+/* EasyDMA can't transfer more at once. */
+#define	UARTE_MAXCNT		8191
+
+static uint8_t mtrace_buf[MTRACE_RING_SIZE];
+static struct ring mtrace_ring;
+static mdx_sem_t mtrace_sem;
+
+static uint32_t mtrace_chunks;
+static uint32_t mtrace_bytes;
+static uint32_t mtrace_drops;
+static uint32_t mtrace_drop_bytes;
+static uint32_t mtrace_drained;
+static uint32_t mtrace_peak;
+
+static const struct metric mtrace_metrics[] = {
+	METRIC_U32("chunks", &mtrace_chunks),
+	METRIC_U32("bytes", &mtrace_bytes),
+	METRIC_U32("drops", &mtrace_drops),
+	METRIC_U32("drop_bytes", &mtrace_drop_bytes),
+	METRIC_U32("drained", &mtrace_drained),
+	METRIC_U32("peak", &mtrace_peak),
+};
+
+static struct metrics_group mtrace_group = {
+	.name = "mtrace",
+	.metrics = mtrace_metrics,
+	.nmetrics = nitems(mtrace_metrics),
+};
+
+/*
+ * Queue a trace chunk. Called in the trace interrupt.
+ */
+void
+mtrace_put(const uint8_t *buf, uint32_t len)
+{
+	uint32_t used;
+
+	used = ring_used(&mtrace_ring);
+
+	if (ring_put(&mtrace_ring, buf, len) != 0) {
+		mtrace_drops++;
+		mtrace_drop_bytes += len;
+		return;
+	}
+
+	mtrace_chunks++;
+	mtrace_bytes += len;
+	if (used + len > mtrace_peak)
+		mtrace_peak = used + len;
+
+	/* The drain thread sleeps on an empty ring only. */
+	if (used == 0)
+		mdx_sem_post(&mtrace_sem);
+}
+
+#ifdef MTRACE_FILE
+static uint32_t
+mtrace_write(uint8_t *buf, uint32_t len)
+{
+	static uint32_t size;
+
+	if (size >= MTRACE_FILE_MAX)
+		return (len);	/* Full, discard. */
+
+	/* Let more collect before the flash write. */
+	if (ring_used(&mtrace_ring) < MTRACE_FILE_BATCH) {
+		mdx_usleep(1000000);
+		return (0);
+	}
+
+	if (len > MTRACE_FILE_MAX - size)
+		len = MTRACE_FILE_MAX - size;
+
+	if (append_file(MTRACE_FILE_NAME, buf, len) < 0)
+		return (len);
+
+	size += len;
+
+	return (len);
+}
+
+static void
+mtrace_sink_init(void)
+{
+
+}
+#else
+static uint32_t
+mtrace_write(uint8_t *buf, uint32_t len)
+{
+
+	if (len > UARTE_MAXCNT)
+		len = UARTE_MAXCNT;
+
+	UARTE_REG(UARTE_EVENTS_ENDTX) = 0;
+	UARTE_REG(UARTE_TXD_PTR) = (uint32_t)buf;
+	UARTE_REG(UARTE_TXD_MAXCNT) = len;
+	UARTE_REG(UARTE_TASKS_STARTTX) = 1;
+
+	/* 10 bits per byte at 1 Mbaud. */
+	mdx_usleep(len * 10);
+	while (UARTE_REG(UARTE_EVENTS_ENDTX) == 0)
+		mdx_usleep(100);
+
+	return (len);
+}
+
+static void
+mtrace_sink_init(void)
+{
+	mdx_device_t gpio;
+
+	gpio = board_device("nrf_gpio", 0);
+	if (!gpio)
+		panic("gpio dev not found");
+	mdx_gpio_set(gpio, PIN_TRACE_TX, 1);
+	nrf_gpio_pincfg(gpio, PIN_TRACE_TX, CNF_DIR_OUT);
+
+	UARTE_REG(UARTE_PSEL_TXD) = PIN_TRACE_TX;
+	UARTE_REG(UARTE_PSEL_RXD) = PSEL_DISCONNECT;
+	UARTE_REG(UARTE_PSEL_RTS) = PSEL_DISCONNECT;
+	UARTE_REG(UARTE_PSEL_CTS) = PSEL_DISCONNECT;
+	UARTE_REG(UARTE_BAUDRATE) = BAUDRATE_1M;
+	UARTE_REG(UARTE_CONFIG) = 0;
+	UARTE_REG(UARTE_ENABLE) = ENABLE_UARTE;
+}
+#endif
+
+static void
+mtrace_thread(void *arg)
+{
+	uint8_t *ptr;
+	uint32_t len;
+
+	while (1) {
+		len = ring_peek(&mtrace_ring, &ptr);
+		if (len == 0) {
+			mdx_sem_wait(&mtrace_sem);
+			continue;
+		}
+
+		len = mtrace_write(ptr, len);
+		ring_consume(&mtrace_ring, len);
+		mtrace_drained += len;
+	}
+}
+
+void
+mtrace_init(void)
+{
+	struct thread *td;
+
+	ring_init(&mtrace_ring, mtrace_buf, MTRACE_RING_SIZE);
+	mdx_sem_init(&mtrace_sem, 0);
+
+	mtrace_sink_init();
+
+	td = mdx_thread_create("mtrace", PRIO_NORMAL, 0, 1024, mtrace_thread, NULL);
+	if (td == NULL)
+		panic("failed to create mtrace thread\n");
+	stack_watch(td);
+	mdx_sched_add(td);
+
+	metrics_register(&mtrace_group);
+}
@@ -0,0 +1,280 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <dev/intc/intc.h>
+
+#include "board.h"
+#include "metrics.h"
+#include "prof.h"
+
+/*
+ * Statistical profiler.
+ *
+ * TIMER1 interrupts at the sampling rate and the handler counts the
+ * interrupted PC, with the name of the interrupted thread (or 0 for an
+ * interrupt handler), in a hash table. tools/profdecode.py symbolizes
+ * a dump ("#P" lines) into a flat profile and folded stacks for a
+ * flame graph. TIMER0 is the kernel timer.
+ *
+ * The PC is on the exception frame, which the kernel interrupt
+ * dispatch does not pass on to the handlers. So while profiling, the
+ * vector table is copied to RAM with the TIMER1 entry pointing to
+ * prof_vector, which finds the frame from EXC_RETURN. The timer runs
+ * at the highest priority, but code with the interrupts disabled is
+ * sampled at critical_exit(). The timer keeps the HFCLK running, so
+ * the CPU does not reach its lowest power state while profiling.
+ */
+
+#define	PROF_NSLOTS		256	/* Power of two */
+#define	PROF_PROBES		8
+#define	PROF_HZ			1000
+#define	PROF_TIMER_HZ		1000000
+#define	PROF_NVECTORS		128	/* 16 + the nRF9160 interrupts */
+
+#define	TIMER1_BASE		0x40010000	/* TIMER1_NS */
+#define	TIMER_TASKS_START	0x000
+#define	TIMER_TASKS_STOP	0x004
+#define	TIMER_TASKS_CLEAR	0x00c
+#define	TIMER_EVENTS_COMPARE0	0x140
+#define	TIMER_SHORTS		0x200
+#define	 SHORTS_COMPARE0_CLEAR	(1 << 0)
+#define	TIMER_INTENSET		0x304
+#define	TIMER_INTENCLR		0x308
+#define	 INT_COMPARE0		(1 << 16)
+#define	TIMER_MODE		0x504
+#define	TIMER_BITMODE		0x508
+#define	 BITMODE_32		3
+#define	TIMER_PRESCALER		0x510
+#define	TIMER_CC0		0x540
+#define	TIMER_REG(reg)		(*(volatile uint32_t *)(TIMER1_BASE + (reg)))
+
+#define	SCB_VTOR		0xe000ed08
+#define	REG32(addr)		(*(volatile uint32_t *)(addr))
+
+#define	EXC_RETURN_SPSEL	(1 << 2)	/* Frame on the PSP */
+#define	EXC_RETURN_MODE		(1 << 3)	/* Back to thread mode */
+#define	FRAME_PC		6
+
+struct prof_slot {
+	uint32_t	pc;
+	uint32_t	thread;
+	uint32_t	count;
+};
+
+static struct prof_slot prof_slots[PROF_NSLOTS];
+static uint32_t prof_vectors[PROF_NVECTORS]
+    __attribute__((aligned(512)));
+static uint32_t prof_saved_vtor;
+static uint32_t prof_hz;
+static int prof_running;
+
+static uint32_t prof_samples;
+static uint32_t prof_drops;
+
+static const struct metric prof_metrics[] = {
+	METRIC_U32("samples", &prof_samples),
+	METRIC_U32("drops", &prof_drops),
+};
+
+static struct metrics_group prof_group = {
+	.name = "prof",
+	.metrics = prof_metrics,
+	.nmetrics = nitems(prof_metrics),
+};
+
+static void __attribute__((used))
+prof_sample(uint32_t *frame, uint32_t exc_return)
+{
+	struct prof_slot *s;
+	uint32_t thread;
+	uint32_t pc;
+	uint32_t h;
+	int i;
+
+	TIMER_REG(TIMER_EVENTS_COMPARE0) = 0;
+	(void)TIMER_REG(TIMER_EVENTS_COMPARE0);
+
+	pc = frame[FRAME_PC];
+	if (exc_return & EXC_RETURN_MODE)
+		thread = (uint32_t)curthread->td_name;
+	else
+		thread = 0;
+
+	prof_samples++;
+
+	h = ((pc >> 1) ^ thread) * 2654435761u;
+	for (i = 0; i < PROF_PROBES; i++) {
+		s = &prof_slots[((h >> 24) + i) & (PROF_NSLOTS - 1)];
+		if (s->count == 0) {
+			s->pc = pc;
+			s->thread = thread;
+		} else if (s->pc != pc || s->thread != thread)
+			continue;
+		s->count++;
+		return;
+	}
+
+	prof_drops++;
+}
+
+/*
+ * The exception entry. The hardware frame is on the stack that was in
+ * use when the timer fired.
+ */
+static void __attribute__((naked))
+prof_vector(void)
+{
+
+	__asm __volatile(
+	    "mov	r1, lr\n"
+	    "tst	lr, %0\n"
+	    "ite	eq\n"
+	    "mrseq	r0, msp\n"
+	    "mrsne	r0, psp\n"
+	    "b	prof_sample\n"
+	    :: "i" (EXC_RETURN_SPSEL));
+}
+
+/*
+ * Start sampling at hz, or at the previous rate if 0.
+ */
+int
+prof_start(uint32_t hz)
+{
+	mdx_device_t nvic;
+
+	if (prof_running)
+		return (-1);
+	if (hz == 0)
+		hz = prof_hz;
+	if (hz > PROF_TIMER_HZ / 10)
+		return (-1);
+
+	nvic = board_device("nvic", 0);
+	if (nvic == NULL)
+		return (-1);
+
+	prof_hz = hz;
+
+	prof_saved_vtor = REG32(SCB_VTOR);
+	memcpy(prof_vectors, (void *)prof_saved_vtor, sizeof(prof_vectors));
+	prof_vectors[16 + ID_TIMER1] = (uint32_t)prof_vector;
+	__asm __volatile("dsb");
+	REG32(SCB_VTOR) = (uint32_t)prof_vectors;
+	__asm __volatile("dsb; isb");
+
+	TIMER_REG(TIMER_TASKS_STOP) = 1;
+	TIMER_REG(TIMER_MODE) = 0;
+	TIMER_REG(TIMER_BITMODE) = BITMODE_32;
+	TIMER_REG(TIMER_PRESCALER) = 4;	/* 16 MHz / 2^4 */
+	TIMER_REG(TIMER_CC0) = PROF_TIMER_HZ / hz;
+	TIMER_REG(TIMER_SHORTS) = SHORTS_COMPARE0_CLEAR;
+	TIMER_REG(TIMER_EVENTS_COMPARE0) = 0;
+	TIMER_REG(TIMER_INTENSET) = INT_COMPARE0;
+
+	mdx_intc_set_prio(nvic, ID_TIMER1, 0);
+	mdx_intc_enable(nvic, ID_TIMER1);
+
+	TIMER_REG(TIMER_TASKS_CLEAR) = 1;
+	TIMER_REG(TIMER_TASKS_START) = 1;
+	prof_running = 1;
+
+	return (0);
+}
+
+void
+prof_stop(void)
+{
+	mdx_device_t nvic;
+
+	if (prof_running == 0)
+		return;
+
+	TIMER_REG(TIMER_TASKS_STOP) = 1;
+	TIMER_REG(TIMER_INTENCLR) = INT_COMPARE0;
+	TIMER_REG(TIMER_EVENTS_COMPARE0) = 0;
+
+	nvic = board_device("nvic", 0);
+	mdx_intc_disable(nvic, ID_TIMER1);
+
+	REG32(SCB_VTOR) = prof_saved_vtor;
+	__asm __volatile("dsb; isb");
+
+	prof_running = 0;
+}
+
+void
+prof_reset(void)
+{
+
+	critical_enter();
+	memset(prof_slots, 0, sizeof(prof_slots));
+	prof_samples = 0;
+	prof_drops = 0;
+	critical_exit();
+}
+
+/*
+ * "#P <pc> <thread> <count>" per slot in use, in hex.
+ */
+void
+prof_dump(void)
+{
+	struct prof_slot *s;
+	int running;
+	int i;
+
+	running = prof_running;
+	prof_stop();
+
+	printf("prof: %u samples at %u Hz, %u dropped\n", prof_samples,
+	    prof_hz, prof_drops);
+	for (i = 0; i < PROF_NSLOTS; i++) {
+		s = &prof_slots[i];
+		if (s->count != 0)
+			printf("#P %08x %08x %08x\n", s->pc, s->thread,
+			    s->count);
+	}
+	printf("#P end\n");
+
+	if (running)
+		prof_start(prof_hz);
+}
+
+void
+prof_init(void)
+{
+
+	prof_hz = PROF_HZ;
+
+	metrics_register(&prof_group);
+}
@@ -0,0 +1,464 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/sem.h>
+#include <sys/mutex.h>
+
+#include "at.h"
+#include "clock.h"
+#include "disk.h"
+#include "lte.h"
+#include "metrics.h"
+#include "psm.h"
+
+/*
+ * Connectivity profile manager.
+ *
+ * The requested PSM and eDRX timers are derived from the reporting
+ * interval and the downlink latency target:
+ *  - The periodic TAU is twice the reporting interval, so the device
+ *    wakes up for the reports only, but not under PSM_TAU_MIN_S: the
+ *    uplinks wake the modem anyway, a short TAU only adds signalling.
+ *  - If the downlink may wait for the next report the active time is
+ *    zero and eDRX is off. Otherwise the device stays in idle between
+ *    the reports (active time equals the reporting interval, at least
+ *    PSM_ACTIVE_MIN_S) and the eDRX cycle bounds the downlink latency.
+ *
+ * The values granted by the network are read back from +CEREG (n=5)
+ * and +CEDRXRDP. The granted configuration is persisted and requested
+ * as is on the next boot, so the network has nothing to renegotiate.
+ * It is written only when it differs from the stored one, as the
+ * network normally grants the same timers on every registration.
+ */
+
+#define	PSM_STATE		"psm"
+#define	PSM_MAGIC		0x70736d32	/* psm2 */
+
+/* Until the application sets its targets. */
+#define	PSM_REPORT_S		1800
+#define	PSM_DL_LATENCY_S	3600
+
+/* The shortest timers requested, whatever the reporting interval. */
+#define	PSM_TAU_MIN_S		3600
+#define	PSM_ACTIVE_MIN_S	60
+
+#define	PSM_DEBUG
+#undef	PSM_DEBUG
+
+#ifdef	PSM_DEBUG
+#define	dprintf(fmt, ...)	printf(fmt, ##__VA_ARGS__)
+#else
+#define	dprintf(fmt, ...)
+#endif
+
+struct psm_unit {
+	uint8_t		bits;
+	uint32_t	sec;
+};
+
+/* GPRS Timer 3, 3GPP TS 24.008 10.5.7.4a. Ordered by the unit. */
+static const struct psm_unit tau_units[] = {
+	{ 3, 2 },
+	{ 4, 30 },
+	{ 5, 60 },
+	{ 0, 600 },
+	{ 1, 3600 },
+	{ 2, 36000 },
+	{ 6, 1152000 },
+};
+
+/* GPRS Timer 2, 3GPP TS 24.008 10.5.7.3 */
+static const struct psm_unit active_units[] = {
+	{ 0, 2 },
+	{ 1, 60 },
+	{ 2, 360 },
+};
+
+/* LTE-M eDRX cycles, 3GPP TS 24.008 10.5.5.32, in 10 ms units. */
+static const uint32_t edrx_cycles[] = {
+	512, 1024, 2048, 4096, 6144, 8192, 10240, 12288,
+	14336, 16384, 32768, 65536, 131072, 262144, 524288, 1048576,
+};
+
+struct psm_profile {
+	uint32_t	magic;
+	uint32_t	report_s;	/* Targets the request is made for */
+	uint32_t	dl_latency_s;
+	char		tau[9];		/* Requested timers */
+	char		active[9];
+	char		edrx[5];	/* Empty if eDRX is off */
+};
+
+static struct mdx_mutex psm_mtx;
+static struct psm_profile profile;
+static struct psm_profile stored;	/* Last persisted */
+static uint32_t report_s;
+static uint32_t dl_latency_s;
+static int requested;		/* The modem has been configured */
+
+/* Granted by the network, -1 if not */
+static int32_t tau_s = -1;
+static int32_t active_s = -1;
+static int32_t edrx_ms = -1;
+static char tau_granted[9];
+static char active_granted[9];
+static char edrx_granted[5];
+
+static int attaching;
+static uint32_t attach_start;
+static uint32_t attach_ms;
+static uint32_t attach_max_ms;
+static uint32_t attach_total_ms;
+static uint32_t attaches;
+
+static const struct metric psm_metrics[] = {
+	METRIC_U32("attach_ms", &attach_ms),
+	METRIC_U32("attach_max_ms", &attach_max_ms),
+	METRIC_U32("attach_total_ms", &attach_total_ms),
+	METRIC_U32("attaches", &attaches),
+	METRIC_I32("tau_s", &tau_s),
+	METRIC_I32("active_s", &active_s),
+	METRIC_I32("edrx_ms", &edrx_ms),
+};
+
+static struct metrics_group psm_group = {
+	.name = "psm",
+	.metrics = psm_metrics,
+	.nmetrics = nitems(psm_metrics),
+};
+
+static void
+psm_encode(char *buf, uint32_t sec, const struct psm_unit *units, int n)
+{
+	uint32_t val;
+	uint8_t code;
+	int i;
+
+	val = 0;
+
+	for (i = 0; i < n; i++) {
+		val = (sec + units[i].sec - 1) / units[i].sec;
+		if (val <= 31)
+			break;
+	}
+	if (i == n) {
+		i = n - 1;
+		val = 31;
+	}
+
+	code = (units[i].bits << 5) | val;
+	for (i = 0; i < 8; i++)
+		buf[i] = (code & (0x80 >> i)) ? '1' : '0';
+	buf[8] = '\0';
+}
+
+static int32_t
+psm_decode(const char *buf, const struct psm_unit *units, int n)
+{
+	uint8_t code;
+	int i;
+
+	if (strlen(buf) != 8)
+		return (-1);
+
+	code = 0;
+	for (i = 0; i < 8; i++)
+		code = (code << 1) | (buf[i] == '1');
+
+	for (i = 0; i < n; i++)
+		if (units[i].bits == (code >> 5))
+			return (units[i].sec * (code & 0x1f));
+
+	/* Deactivated */
+
+	return (-1);
+}
+
+static int32_t
+psm_edrx_decode(const char *buf)
+{
+	uint8_t code;
+	int i;
+
+	if (strlen(buf) != 4)
+		return (-1);
+
+	code = 0;
+	for (i = 0; i < 4; i++)
+		code = (code << 1) | (buf[i] == '1');
+
+	return (edrx_cycles[code] * 10);
+}
+
+static void
+psm_profile_build(struct psm_profile *p)
+{
+	uint32_t active;
+	uint32_t cycle;
+	uint32_t tau;
+	int i;
+
+	memset(p, 0, sizeof(struct psm_profile));
+	p->magic = PSM_MAGIC;
+	p->report_s = report_s;
+	p->dl_latency_s = dl_latency_s;
+
+	tau = report_s * 2;
+	if (tau < PSM_TAU_MIN_S)
+		tau = PSM_TAU_MIN_S;
+	psm_encode(p->tau, tau, tau_units, nitems(tau_units));
+
+	if (dl_latency_s >= report_s) {
+		psm_encode(p->active, 0, active_units, nitems(active_units));
+		return;
+	}
+
+	active = report_s;
+	if (active < PSM_ACTIVE_MIN_S)
+		active = PSM_ACTIVE_MIN_S;
+	psm_encode(p->active, active, active_units, nitems(active_units));
+
+	/* The longest cycle within the latency target. */
+	cycle = 0;
+	for (i = 0; i < nitems(edrx_cycles); i++)
+		if (edrx_cycles[i] <= dl_latency_s * 100)
+			cycle = i;
+	for (i = 0; i < 4; i++)
+		p->edrx[i] = (cycle & (0x8 >> i)) ? '1' : '0';
+	p->edrx[4] = '\0';
+}
+
+/*
+ * The profile to request for the current targets: the stored one if
+ * it was granted for the same targets. Called with psm_mtx held.
+ */
+static void
+psm_profile_select(struct psm_profile *p)
+{
+
+	if (stored.magic == PSM_MAGIC &&
+	    stored.report_s == report_s &&
+	    stored.dl_latency_s == dl_latency_s)
+		*p = stored;
+	else
+		psm_profile_build(p);
+}
+
+/*
+ * Send the requested timers to the modem.
+ */
+int
+psm_request(void)
+{
+	char cmd[64];
+	int err;
+
+	mdx_mutex_lock(&psm_mtx);
+	requested = 1;
+	snprintf(cmd, sizeof(cmd), "AT+CPSMS=1,,,\"%s\",\"%s\"",
+	    profile.tau, profile.active);
+	mdx_mutex_unlock(&psm_mtx);
+
+	err = at_cmd(cmd, NULL, 0);
+	if (err != AT_RESULT_OK)
+		return (-1);
+
+	mdx_mutex_lock(&psm_mtx);
+	if (profile.edrx[0] != '\0')
+		snprintf(cmd, sizeof(cmd), "AT+CEDRXS=1,4,\"%s\"",
+		    profile.edrx);
+	else
+		snprintf(cmd, sizeof(cmd), "AT+CEDRXS=3");
+	mdx_mutex_unlock(&psm_mtx);
+
+	err = at_cmd(cmd, NULL, 0);
+	if (err != AT_RESULT_OK)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * Adapt the requested timers to the application needs. The new timers
+ * are sent right away if the modem has been configured already,
+ * otherwise they are part of the first request.
+ */
+void
+psm_set_targets(uint32_t report, uint32_t dl_latency)
+{
+	struct psm_profile p;
+	bool send;
+
+	mdx_mutex_lock(&psm_mtx);
+	report_s = report;
+	dl_latency_s = dl_latency;
+	psm_profile_select(&p);
+	send = false;
+	if (memcmp(&p, &profile, sizeof(struct psm_profile)) != 0) {
+		profile = p;
+		send = requested;
+	}
+	mdx_mutex_unlock(&psm_mtx);
+
+	if (send)
+		psm_request();
+}
+
+void
+psm_attach_begin(void)
+{
+
+	mdx_mutex_lock(&psm_mtx);
+	attaching = 1;
+	attach_start = clock_ms();
+	mdx_mutex_unlock(&psm_mtx);
+}
+
+/*
+ * +CEREG: <stat>[,<tac>,<ci>,<AcT>[,<cause_type>,<reject_cause>
+ *     [,<Active-Time>,<Periodic-TAU>]]]
+ * Called from the AT thread.
+ */
+void
+psm_cereg(const char *line)
+{
+	char buf[LC_MAX_READ_LENGTH];
+	uint32_t ms;
+	char *t;
+	int stat;
+	int len;
+	int i;
+
+	stat = lte_cereg(line);
+	if (stat != CEREG_HOME && stat != CEREG_ROAMING)
+		return;
+
+	mdx_mutex_lock(&psm_mtx);
+	if (attaching) {
+		attaching = 0;
+		ms = clock_ms() - attach_start;
+		attach_ms = ms;
+		attach_total_ms += ms;
+		if (ms > attach_max_ms)
+			attach_max_ms = ms;
+		attaches++;
+		printf("%s: attached in %u ms\n", __func__, ms);
+	}
+
+	len = strlen(line);
+	if (len >= sizeof(buf))
+		len = sizeof(buf) - 1;
+	memcpy(buf, line, len);
+	buf[len] = '\0';
+
+	t = buf;
+	for (i = 0; i < 6; i++)
+		if (strsep(&t, ",") == NULL)
+			break;
+	if (i == 6 && at_field(&t, active_granted, 9) != NULL) {
+		active_s = psm_decode(active_granted, active_units,
+		    nitems(active_units));
+		if (at_field(&t, tau_granted, 9) != NULL)
+			tau_s = psm_decode(tau_granted, tau_units,
+			    nitems(tau_units));
+	}
+	mdx_mutex_unlock(&psm_mtx);
+}
+
+/*
+ * Read back the granted eDRX and persist the configuration.
+ * Called once registered.
+ */
+void
+psm_update(void)
+{
+	char resp[LC_MAX_READ_LENGTH];
+	struct psm_profile p;
+	char *t;
+
+	/* +CEDRXRDP: <AcT>[,<Requested>,<NW provided>,<PTW>] */
+	edrx_granted[0] = '\0';
+	if (at_cmd("AT+CEDRXRDP", resp, sizeof(resp)) == AT_RESULT_OK &&
+	    strncmp(resp, "+CEDRXRDP: ", 11) == 0) {
+		t = resp;
+		strsep(&t, ",");
+		strsep(&t, ",");
+		if (at_field(&t, edrx_granted, 5) == NULL)
+			edrx_granted[0] = '\0';
+	}
+
+	mdx_mutex_lock(&psm_mtx);
+	edrx_ms = psm_edrx_decode(edrx_granted);
+
+	printf("%s: granted tau %d s, active %d s, edrx %d ms\n",
+	    __func__, tau_s, active_s, edrx_ms);
+
+	if (tau_s < 0 || active_s < 0) {
+		/* PSM is not granted, nothing to persist. */
+		mdx_mutex_unlock(&psm_mtx);
+		return;
+	}
+
+	p = profile;
+	memcpy(p.tau, tau_granted, sizeof(p.tau));
+	memcpy(p.active, active_granted, sizeof(p.active));
+	if (p.edrx[0] != '\0' && edrx_granted[0] != '\0')
+		memcpy(p.edrx, edrx_granted, sizeof(p.edrx));
+	if (memcmp(&p, &stored, sizeof(struct psm_profile)) == 0) {
+		mdx_mutex_unlock(&psm_mtx);
+		return;
+	}
+	stored = p;
+	mdx_mutex_unlock(&psm_mtx);
+
+	save_state(PSM_STATE, &p, sizeof(struct psm_profile));
+}
+
+void
+psm_init(void)
+{
+	struct psm_profile tmp;
+
+	mdx_mutex_init(&psm_mtx);
+
+	report_s = PSM_REPORT_S;
+	dl_latency_s = PSM_DL_LATENCY_S;
+
+	/* Reuse the last granted configuration for the same targets. */
+	if (load_state(PSM_STATE, &tmp, sizeof(tmp)) == 0 &&
+	    tmp.magic == PSM_MAGIC) {
+		stored = tmp;
+		printf("%s: stored tau %s active %s edrx %s for %u/%u s\n",
+		    __func__, stored.tau, stored.active,
+		    stored.edrx[0] ? stored.edrx : "off",
+		    stored.report_s, stored.dl_latency_s);
+	}
+	psm_profile_select(&profile);
+
+	metrics_register(&psm_group);
+}
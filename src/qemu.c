@@ -0,0 +1,217 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/console.h>
+#include <sys/systm.h>
+#include <sys/malloc.h>
+
+#include "app.h"
+#include "bench.h"
+#include "board.h"
+#include "clock.h"
+#include "disk.h"
+#include "metrics.h"
+#include "sensor.h"
+
+/*
+ * Board glue of the benchmark image for QEMU mps2-an505 (Cortex-M33),
+ * see mdepx-bench.conf and ldscript-qemu. It runs bench_suite() once
+ * and exits QEMU through semihosting with the status of the run.
+ *
+ * QEMU does not model the DWT cycle counter, so the cycles are read
+ * from the CMSDK APB TIMER0, a 32-bit down counter clocked at 20 MHz.
+ * With -icount the count follows the number of instructions executed
+ * and does not change from run to run.
+ */
+
+#define	UART0_BASE		0x50200000	/* CMSDK UART0, secure */
+#define	UART_DATA		0x00
+#define	UART_STATE		0x04
+#define	 UART_STATE_TXFULL	(1 << 0)
+#define	UART_CTRL		0x08
+#define	 UART_CTRL_TXEN		(1 << 0)
+#define	UART_BAUDDIV		0x10
+#define	UART_REG(reg)		(*(volatile uint32_t *)(UART0_BASE + (reg)))
+
+#define	TIMER0_BASE		0x50000000	/* CMSDK TIMER0, secure */
+#define	TIMER_CTRL		0x00
+#define	 TIMER_CTRL_EN		(1 << 0)
+#define	TIMER_VALUE		0x04
+#define	TIMER_RELOAD		0x08
+#define	TIMER_REG(reg)		(*(volatile uint32_t *)(TIMER0_BASE + (reg)))
+
+#define	QEMU_CYCLES_PER_US	20
+
+#define	SYS_EXIT_EXTENDED	0x20
+#define	ADP_STOPPED_APPEXIT	0x20026
+
+/* mc6470 samples: mag x y z, acc x y z. */
+static const int16_t qemu_samples[][6] = {
+	{ -120,   80,  310,  150,  -90, 4010 },
+	{  260, -410,  -75, -700,  320, 3900 },
+	{   15,  530,  190, 1200, 1100, 3600 },
+	{ -480, -220,  400,   40, -980, 3850 },
+};
+static int qemu_sample;
+static uint32_t qemu_rand;
+
+static void
+qemu_putchar(int c, void *arg)
+{
+
+	while (UART_REG(UART_STATE) & UART_STATE_TXFULL)
+		;
+	UART_REG(UART_DATA) = c;
+}
+
+static void
+qemu_exit(int status)
+{
+	uint32_t block[2];
+
+	block[0] = ADP_STOPPED_APPEXIT;
+	block[1] = status;
+
+	__asm __volatile(
+	    "mov r0, %0\n"
+	    "mov r1, %1\n"
+	    "bkpt 0xab\n"
+	    :: "r" (SYS_EXIT_EXTENDED), "r" (block) : "r0", "r1", "memory");
+
+	for (;;)
+		;
+}
+
+void
+clock_cycles_start(void)
+{
+
+	TIMER_REG(TIMER_CTRL) = 0;
+	TIMER_REG(TIMER_RELOAD) = 0xffffffff;
+	TIMER_REG(TIMER_VALUE) = 0xffffffff;
+	TIMER_REG(TIMER_CTRL) = TIMER_CTRL_EN;
+}
+
+uint32_t
+clock_cycles(void)
+{
+
+	return (0xffffffff - TIMER_REG(TIMER_VALUE));
+}
+
+uint64_t
+clock_usec(void)
+{
+
+	return (clock_cycles() / QEMU_CYCLES_PER_US);
+}
+
+uint32_t
+clock_ms(void)
+{
+
+	return (clock_usec() / 1000);
+}
+
+void
+clock_init(void)
+{
+
+	clock_cycles_start();
+}
+
+mdx_device_t
+board_device(const char *name, int unit)
+{
+
+	return (NULL);
+}
+
+int
+mc6470_process(struct ecompass_data *data)
+{
+	const int16_t *s;
+
+	s = qemu_samples[qemu_sample++ % nitems(qemu_samples)];
+	mc6470_ecompass(data, s[0], s[1], s[2], s[3], s[4], s[5]);
+
+	return (0);
+}
+
+/*
+ * Entropy source for mbedtls. Deterministic so that the runs can be
+ * compared.
+ */
+int get_random_number(uint8_t *out, int size);
+
+int
+get_random_number(uint8_t *out, int size)
+{
+	uint32_t x;
+	int i;
+
+	x = qemu_rand;
+	for (i = 0; i < size; i++) {
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		out[i] = x;
+	}
+	qemu_rand = x;
+
+	return (0);
+}
+
+void
+board_init(void)
+{
+
+	/* SSRAM3, secure alias. */
+	mdx_fl_init();
+	mdx_fl_add_region((void *)0x38200000, 0x200000);
+
+	UART_REG(UART_BAUDDIV) = 16;
+	UART_REG(UART_CTRL) = UART_CTRL_TXEN;
+	mdx_console_register(qemu_putchar, NULL);
+
+	clock_init();
+	qemu_rand = 0x9e3779b9;
+}
+
+int
+main(void)
+{
+
+	metrics_init();
+	disk_init();
+	app_init();
+	bench_suite();
+
+	qemu_exit(0);
+
+	return (0);
+}
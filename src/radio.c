@@ -0,0 +1,753 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+#include <sys/mutex.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <nrfxlib/bsdlib/include/nrf_socket.h>
+#include <nrfxlib/bsdlib/include/bsd.h>
+#include <nrfxlib/bsdlib/include/bsd_os.h>
+
+#include "antenna.h"
+#include "at.h"
+#include "board.h"
+#include "cell.h"
+#include "clock.h"
+#include "cpu.h"
+#include "energy.h"
+#include "lte.h"
+#include "metrics.h"
+#include "psm.h"
+#include "radio.h"
+#include "stack.h"
+
+/*
+ * Radio scheduler.
+ *
+ * The nRF9160 can't receive GNSS while LTE is active. GNSS gets its
+ * time only when the LTE link sleeps (PSM/eDRX) or when LTE is switched
+ * off entirely. This module owns the modem functional mode and decides
+ * which radio the shared antenna is routed to. Uplinks are batched into
+ * LTE active periods so the GNSS receiver gets long sleep windows in
+ * between. If GNSS is starved for too long (e.g. the network did not
+ * grant PSM) the LTE part is switched off until a fix is obtained.
+ *
+ * Transmitting in poor coverage costs several times more energy per
+ * byte. Uplinks carry a class with a latency deadline: they are
+ * deferred until the RRC connection is already up, or the coverage is
+ * good and the batch window has passed, or the deadline is reached.
+ * Without a registration they wait, up to RADIO_UPLINK_WAIT_MS past
+ * the deadline, and then fail.
+ *
+ * The scheduler is event driven: it runs on modem URCs, uplink requests
+ * and GNSS frames, and otherwise sleeps until the nearest deadline.
+ */
+
+#define	RADIO_MAX_WAIT_MS	600000
+#define	RADIO_UPLINK_BATCH_MS	10000	/* Batch window in good coverage */
+#define	RADIO_UPLINK_WAIT_MS	300000	/* Max wait past the deadline */
+#define	RADIO_SIGNAL_AGE_MS	30000	/* Signal quality refresh period */
+#define	RADIO_RSRP_GOOD		-105	/* dBm */
+#define	RADIO_RSRP_INVALID	INT32_MIN
+#define	RADIO_GNSS_STARVE_MS	60000	/* Max GNSS blocked time */
+#define	RADIO_GNSS_WINDOW_MS	120000	/* Max LTE-off window for GNSS */
+
+static const char flight[] = "AT+CFUN=4";
+static const char normal[] = "AT+CFUN=1";
+static const char lte_enable[] = "AT+CFUN=21";
+static const char lte_disable[] = "AT+CFUN=20";
+static const char gps_enable[] = "AT+CFUN=31";
+
+/* Report modem sleeps longer than 500 ms. */
+static const char modem_sleep_subscribe[] = "AT%XMODEMSLEEP=1,500,10240";
+
+/*
+ * %XSYSTEMMODE=<M1_support>,<NB1_support>,<GNSS_support>,<LTE_preference>
+ */
+
+static const char systm_mode[] = "AT%XSYSTEMMODE?";
+static const char nbiot_gps[] __unused = "AT%XSYSTEMMODE=0,1,1,0";
+static const char catm1_gps[] = "AT%XSYSTEMMODE=1,0,1,0";
+
+/* Max uplink delay for each class, ms. */
+static const uint32_t radio_uplink_delay[] = {
+	[RADIO_UPLINK_URGENT] = 0,
+	[RADIO_UPLINK_NORMAL] = 60000,
+	[RADIO_UPLINK_BULK] = 900000,
+};
+
+struct radio_waiter {
+	struct entry	node;
+	mdx_sem_t	sem;
+	uint32_t	req;		/* Request time, ms */
+	uint32_t	deadline;
+	int		error;
+};
+
+struct radio_stats {
+	uint32_t	pvt;		/* PVT frames received */
+	uint32_t	pvt_blocked;	/* ... with not enough window time */
+	uint32_t	pvt_fix;	/* ... with a valid fix */
+	uint32_t	exclusive;	/* LTE-off windows given to GNSS */
+	uint32_t	exclusive_ms;
+	uint32_t	lte_active_ms;	/* Time with uplinks in progress */
+	uint32_t	uplinks;
+	uint32_t	uplink_lat_ms;	/* Total uplink latency */
+	uint32_t	uplink_lat_max;
+	uint32_t	modem_sleeps;	/* %XMODEMSLEEP notifications */
+	uint32_t	uplink_deadline; /* Batches forced by a deadline */
+	uint32_t	uplink_timeouts; /* Failed, not registered */
+	uint32_t	uplink_bytes;
+	uint32_t	uplink_bytes_poor; /* ... sent in poor coverage */
+	uint32_t	rrc_ms;		/* Time in RRC connected state */
+};
+
+static struct mdx_mutex radio_mtx;
+static mdx_sem_t radio_sem;
+static struct cpu_acct radio_acct = { .name = "radio" };
+static struct entry uplink_waiters;
+static struct radio_stats stats;
+static int32_t signal_rsrp = RADIO_RSRP_INVALID;
+
+static const struct metric radio_metrics[] = {
+	METRIC_U32("pvt", &stats.pvt),
+	METRIC_U32("pvt_blocked", &stats.pvt_blocked),
+	METRIC_U32("pvt_fix", &stats.pvt_fix),
+	METRIC_U32("lte_off_windows", &stats.exclusive),
+	METRIC_U32("lte_off_ms", &stats.exclusive_ms),
+	METRIC_U32("lte_active_ms", &stats.lte_active_ms),
+	METRIC_U32("uplinks", &stats.uplinks),
+	METRIC_U32("uplink_latency_ms", &stats.uplink_lat_ms),
+	METRIC_U32("uplink_latency_max_ms", &stats.uplink_lat_max),
+	METRIC_U32("modem_sleeps", &stats.modem_sleeps),
+	METRIC_U32("uplink_deadline", &stats.uplink_deadline),
+	METRIC_U32("uplink_timeouts", &stats.uplink_timeouts),
+	METRIC_U32("uplink_bytes", &stats.uplink_bytes),
+	METRIC_U32("uplink_bytes_poor", &stats.uplink_bytes_poor),
+	METRIC_U32("rrc_connected_ms", &stats.rrc_ms),
+	METRIC_I32("rsrp", &signal_rsrp),
+};
+
+static struct metrics_group radio_group = {
+	.name = "radio",
+	.metrics = radio_metrics,
+	.nmetrics = nitems(radio_metrics),
+};
+
+/* Protected by radio_mtx. */
+static int uplink_active;
+static int gnss_blocked;
+static int gnss_fix;
+static uint32_t gnss_blocked_since;
+static int registered;
+static int registered_new;
+static int rrc_connected;
+static uint32_t rrc_start;
+static int modem_sleep;
+static int lte_on;
+static uint32_t signal_time;
+
+/* Owned by the radio thread. */
+static int exclusive;
+static uint32_t exclusive_start;
+static uint32_t lte_active_start;
+
+/*
+ * Report the LTE power state. Called with radio_mtx held.
+ */
+static void
+radio_energy(void)
+{
+	int state;
+
+	if (lte_on == 0)
+		state = ENERGY_OFF;
+	else if (modem_sleep)
+		state = ENERGY_LTE_SLEEP;
+	else if (rrc_connected)
+		state = ENERGY_LTE_CONNECTED;
+	else
+		state = ENERGY_LTE_IDLE;
+
+	energy_set(ENERGY_LTE, state);
+}
+
+static void
+radio_cereg(const char *line, void *arg)
+{
+	int val;
+
+	val = lte_cereg(line);
+
+	psm_cereg(line);
+	cell_cereg(line);
+
+	switch (val) {
+	case CEREG_HOME:
+		printf("Registered, home network.\n");
+		break;
+	case CEREG_ROAMING:
+		printf("Registered, roaming.\n");
+		break;
+	case CEREG_DENIED:
+		printf("Registration denied\n");
+		break;
+	}
+
+	mdx_mutex_lock(&radio_mtx);
+	if (val == CEREG_HOME || val == CEREG_ROAMING) {
+		if (registered == 0)
+			registered_new = 1;
+		registered = 1;
+	} else {
+		registered = 0;
+		signal_rsrp = RADIO_RSRP_INVALID;
+	}
+	mdx_mutex_unlock(&radio_mtx);
+
+	mdx_sem_post(&radio_sem);
+}
+
+static void
+radio_cscon(const char *line, void *arg)
+{
+	int val;
+
+	val = lte_cscon(line);
+	if (val < 0)
+		return;
+
+	mdx_mutex_lock(&radio_mtx);
+	if (val && !rrc_connected)
+		rrc_start = clock_ms();
+	else if (!val && rrc_connected)
+		stats.rrc_ms += clock_ms() - rrc_start;
+	rrc_connected = val;
+	radio_energy();
+	mdx_mutex_unlock(&radio_mtx);
+
+	mdx_sem_post(&radio_sem);
+}
+
+/*
+ * %XMODEMSLEEP: <type>,<time>
+ * A zero time means the modem has woken up.
+ */
+static void
+radio_xmodemsleep(const char *line, void *arg)
+{
+	char *p;
+	int time;
+
+	p = strchr(line, ',');
+	if (p == NULL)
+		return;
+	time = atoi(p + 1);
+
+	mdx_mutex_lock(&radio_mtx);
+	modem_sleep = (time > 0);
+	if (modem_sleep)
+		stats.modem_sleeps++;
+	radio_energy();
+	mdx_mutex_unlock(&radio_mtx);
+
+	mdx_sem_post(&radio_sem);
+}
+
+static struct at_urc radio_urcs[] = {
+	{ .prefix = "+CEREG: ", .cb = radio_cereg },
+	{ .prefix = "+CSCON: ", .cb = radio_cscon },
+	{ .prefix = "%XMODEMSLEEP: ", .cb = radio_xmodemsleep },
+};
+
+/*
+ * Refresh the signal quality. Called from the radio thread only.
+ */
+static void
+radio_signal(void)
+{
+	int rsrq;
+	int rsrp;
+
+	if (lte_cesq(&rsrp, &rsrq) == 0)
+		printf("LTE signal quality: rsrq %d dB rsrp %d dBm\n",
+		    rsrq, rsrp);
+	else
+		rsrp = RADIO_RSRP_INVALID;
+
+	mdx_mutex_lock(&radio_mtx);
+	signal_rsrp = rsrp;
+	signal_time = clock_ms();
+	mdx_mutex_unlock(&radio_mtx);
+}
+
+static void
+radio_lte_onoff(bool enable)
+{
+	uint32_t now;
+
+	now = clock_ms();
+
+	if (enable) {
+		cell_lock();
+		psm_attach_begin();
+		at_cmd(lte_enable, NULL, 0);
+		exclusive = 0;
+		mdx_mutex_lock(&radio_mtx);
+		stats.exclusive_ms += now - exclusive_start;
+		lte_on = 1;
+		radio_energy();
+		mdx_mutex_unlock(&radio_mtx);
+	} else {
+		at_cmd(lte_disable, NULL, 0);
+		mdx_mutex_lock(&radio_mtx);
+		stats.exclusive++;
+		exclusive_start = now;
+		exclusive = 1;
+		registered = 0;
+		if (rrc_connected)
+			stats.rrc_ms += now - rrc_start;
+		rrc_connected = 0;
+		signal_rsrp = RADIO_RSRP_INVALID;
+		lte_on = 0;
+		radio_energy();
+		mdx_mutex_unlock(&radio_mtx);
+	}
+}
+
+static void
+radio_grant(uint32_t now)
+{
+	struct radio_waiter *w;
+	uint32_t lat;
+
+	while (!list_empty(&uplink_waiters)) {
+		w = CONTAINER_OF(uplink_waiters.next,
+		    struct radio_waiter, node);
+		list_remove(&w->node);
+
+		lat = now - w->req;
+		stats.uplinks++;
+		stats.uplink_lat_ms += lat;
+		if (lat > stats.uplink_lat_max)
+			stats.uplink_lat_max = lat;
+
+		if (uplink_active++ == 0)
+			lte_active_start = now;
+		w->error = 0;
+		mdx_sem_post(&w->sem);
+	}
+}
+
+static void
+radio_deadline(int32_t *wait, int32_t left)
+{
+
+	if (left < 0)
+		left = 0;
+	if (left < *wait)
+		*wait = left;
+}
+
+/*
+ * Fail the uplinks that waited RADIO_UPLINK_WAIT_MS past their deadline
+ * for a registration. Returns the time until the next one expires.
+ */
+static int32_t
+radio_expire(uint32_t now)
+{
+	struct radio_waiter *w;
+	struct entry *e, *next;
+	int32_t wait;
+	int32_t left;
+
+	wait = RADIO_MAX_WAIT_MS;
+
+	for (e = uplink_waiters.next; e != &uplink_waiters; e = next) {
+		next = e->next;
+		w = CONTAINER_OF(e, struct radio_waiter, node);
+		left = (int32_t)(w->deadline + RADIO_UPLINK_WAIT_MS - now);
+		if (left > 0) {
+			radio_deadline(&wait, left);
+			continue;
+		}
+
+		list_remove(&w->node);
+		stats.uplink_timeouts++;
+
+		/* Paired with radio_uplink_end() all the same. */
+		if (uplink_active++ == 0)
+			lte_active_start = now;
+		w->error = -1;
+		mdx_sem_post(&w->sem);
+	}
+
+	return (wait);
+}
+
+/*
+ * Run the scheduler. Returns the time to the nearest deadline, ms.
+ */
+static int32_t
+radio_schedule(void)
+{
+	struct radio_waiter *w;
+	struct entry *e;
+	int32_t wait;
+	uint32_t now;
+	bool batched;
+	bool pending;
+	bool starved;
+	bool good;
+	bool due;
+	bool lte;
+
+	now = clock_ms();
+	wait = RADIO_MAX_WAIT_MS;
+
+	mdx_mutex_lock(&radio_mtx);
+	if (registered_new) {
+		registered_new = 0;
+		mdx_mutex_unlock(&radio_mtx);
+		radio_signal();
+		psm_update();
+		cell_update();
+		mdx_mutex_lock(&radio_mtx);
+	}
+
+	/* Widen the band lock if the attach takes too long. */
+	if (!registered && !exclusive) {
+		mdx_mutex_unlock(&radio_mtx);
+		if (cell_next() <= 0)
+			cell_step();
+		mdx_mutex_lock(&radio_mtx);
+		radio_deadline(&wait, cell_next());
+	}
+
+	if (!registered)
+		radio_deadline(&wait, radio_expire(now));
+
+	pending = !list_empty(&uplink_waiters);
+
+	/*
+	 * Keep the signal quality fresh while uplinks are deferred or the
+	 * link is in use, the uplink bytes are accounted by coverage.
+	 */
+	if ((pending || rrc_connected || uplink_active) && registered &&
+	    !exclusive) {
+		if ((now - signal_time) >= RADIO_SIGNAL_AGE_MS) {
+			mdx_mutex_unlock(&radio_mtx);
+			radio_signal();
+			mdx_mutex_lock(&radio_mtx);
+		}
+		radio_deadline(&wait, signal_time + RADIO_SIGNAL_AGE_MS - now);
+	}
+	good = signal_rsrp != RADIO_RSRP_INVALID &&
+	    signal_rsrp >= RADIO_RSRP_GOOD;
+
+	due = false;
+	batched = false;
+	for (e = uplink_waiters.next; e != &uplink_waiters; e = e->next) {
+		w = CONTAINER_OF(e, struct radio_waiter, node);
+		if ((int32_t)(now - w->deadline) >= 0)
+			due = true;
+		else
+			radio_deadline(&wait, w->deadline - now);
+	}
+	if (pending) {
+		/* The oldest one opens the batch window. */
+		w = CONTAINER_OF(uplink_waiters.next,
+		    struct radio_waiter, node);
+		batched = (now - w->req) >= RADIO_UPLINK_BATCH_MS;
+		if (good && !batched)
+			radio_deadline(&wait,
+			    w->req + RADIO_UPLINK_BATCH_MS - now);
+	}
+	starved = gnss_blocked &&
+	    (now - gnss_blocked_since) >= RADIO_GNSS_STARVE_MS;
+
+	if (exclusive) {
+		/* GNSS owns the radio. */
+		if (gnss_fix || due ||
+		    (now - exclusive_start) >= RADIO_GNSS_WINDOW_MS) {
+			mdx_mutex_unlock(&radio_mtx);
+			radio_lte_onoff(true);
+			mdx_mutex_lock(&radio_mtx);
+		} else
+			radio_deadline(&wait,
+			    exclusive_start + RADIO_GNSS_WINDOW_MS - now);
+	} else if (pending) {
+		/*
+		 * Piggyback on an active RRC connection, otherwise
+		 * collect the uplinks until the coverage is good or
+		 * a deadline is reached.
+		 */
+		if (registered && (rrc_connected || uplink_active ||
+		    (good && batched) || due)) {
+			if (!rrc_connected && !uplink_active &&
+			    !(good && batched))
+				stats.uplink_deadline++;
+			antenna_lte_probe_abort();
+			antenna_route(false);
+			radio_grant(now);
+		}
+	} else if (uplink_active == 0 && registered &&
+	    antenna_lte_probe_next() <= 0) {
+		mdx_mutex_unlock(&radio_mtx);
+		antenna_route(false);
+		radio_deadline(&wait, antenna_lte_probe());
+		mdx_mutex_lock(&radio_mtx);
+	} else if (uplink_active == 0 && starved) {
+		mdx_mutex_unlock(&radio_mtx);
+		printf("%s: GNSS starved, switching LTE off\n", __func__);
+		radio_lte_onoff(false);
+		mdx_mutex_lock(&radio_mtx);
+		radio_deadline(&wait, RADIO_GNSS_WINDOW_MS);
+	} else {
+		/* An uplink end wakes the scheduler for an overdue probe. */
+		if (registered && uplink_active == 0)
+			radio_deadline(&wait, antenna_lte_probe_next());
+		if (gnss_blocked)
+			radio_deadline(&wait,
+			    gnss_blocked_since + RADIO_GNSS_STARVE_MS - now);
+	}
+
+	/*
+	 * The onboard antenna is shared. Route it to LTE while the link
+	 * is in use, searching for a network or probed, and to GNSS
+	 * otherwise (including when the modem sleeps after a failed
+	 * search).
+	 */
+	lte = !exclusive && (uplink_active > 0 || rrc_connected ||
+	    antenna_lte_probing() || (registered == 0 && modem_sleep == 0));
+	mdx_mutex_unlock(&radio_mtx);
+
+	antenna_route(!lte);
+
+	return (wait);
+}
+
+static void
+radio_thread(void *arg)
+{
+	int32_t wait;
+
+	while (1) {
+		cpu_acct_enter(&radio_acct);
+		wait = radio_schedule();
+		cpu_acct_exit(&radio_acct);
+		if (wait > 0)
+			mdx_sem_timedwait(&radio_sem, wait * 1000);
+	}
+}
+
+/*
+ * Wait for the next LTE active period. The class bounds the delay.
+ * Returns -1 if LTE is still not registered RADIO_UPLINK_WAIT_MS past
+ * it. Every call must be paired with radio_uplink_end().
+ */
+int
+radio_uplink_begin(int class)
+{
+	struct radio_waiter w;
+
+	if (class < 0 || class >= nitems(radio_uplink_delay))
+		class = RADIO_UPLINK_NORMAL;
+
+	mdx_sem_init(&w.sem, 0);
+	w.req = clock_ms();
+	w.deadline = w.req + radio_uplink_delay[class];
+	w.error = 0;
+
+	mdx_mutex_lock(&radio_mtx);
+	list_append(&uplink_waiters, &w.node);
+	mdx_mutex_unlock(&radio_mtx);
+
+	mdx_sem_post(&radio_sem);
+	mdx_sem_wait(&w.sem);
+
+	return (w.error);
+}
+
+/*
+ * Finish the uplink, accounting the bytes delivered.
+ */
+void
+radio_uplink_end(uint32_t bytes)
+{
+
+	mdx_mutex_lock(&radio_mtx);
+	stats.uplink_bytes += bytes;
+	if (signal_rsrp == RADIO_RSRP_INVALID ||
+	    signal_rsrp < RADIO_RSRP_GOOD)
+		stats.uplink_bytes_poor += bytes;
+	if (--uplink_active == 0)
+		stats.lte_active_ms += clock_ms() - lte_active_start;
+	mdx_mutex_unlock(&radio_mtx);
+
+	mdx_sem_post(&radio_sem);
+}
+
+/*
+ * Account a GNSS PVT frame.
+ */
+void
+radio_gnss_pvt(uint8_t flags)
+{
+	bool wakeup;
+
+	wakeup = false;
+
+	mdx_mutex_lock(&radio_mtx);
+	stats.pvt++;
+	if (flags & NRF_GNSS_PVT_FLAG_NOT_ENOUGH_WINDOW_TIME) {
+		stats.pvt_blocked++;
+		if (gnss_blocked == 0) {
+			gnss_blocked = 1;
+			gnss_blocked_since = clock_ms();
+			wakeup = true;
+		}
+		energy_set(ENERGY_GNSS, ENERGY_GNSS_WAIT);
+	} else {
+		gnss_blocked = 0;
+		energy_set(ENERGY_GNSS, ENERGY_GNSS_ON);
+	}
+
+	if (flags & NRF_GNSS_PVT_FLAG_FIX_VALID_BIT) {
+		stats.pvt_fix++;
+		/* Let the scheduler close the LTE-off window early. */
+		if (gnss_fix == 0 && exclusive)
+			wakeup = true;
+		gnss_fix = 1;
+	} else
+		gnss_fix = 0;
+	mdx_mutex_unlock(&radio_mtx);
+
+	/* Reschedule on a state change only. */
+	if (wakeup)
+		mdx_sem_post(&radio_sem);
+}
+
+void
+radio_stats(void)
+{
+	struct radio_stats s;
+	uint32_t util;
+	uint32_t lat;
+	uint32_t rrc;
+
+	mdx_mutex_lock(&radio_mtx);
+	s = stats;
+	mdx_mutex_unlock(&radio_mtx);
+
+	util = 0;
+	if (s.pvt > s.pvt_blocked)
+		util = s.pvt_fix * 100 / (s.pvt - s.pvt_blocked);
+
+	lat = 0;
+	if (s.uplinks)
+		lat = s.uplink_lat_ms / s.uplinks;
+
+	printf("radio: pvt %u blocked %u fix %u, fix-window util %u%%\n",
+	    s.pvt, s.pvt_blocked, s.pvt_fix, util);
+	printf("radio: lte-off windows %u (%u ms), lte active %u ms\n",
+	    s.exclusive, s.exclusive_ms, s.lte_active_ms);
+	printf("radio: uplinks %u, latency avg %u ms max %u ms\n",
+	    s.uplinks, lat, s.uplink_lat_max);
+
+	/* RRC connected time per byte is the energy per byte proxy. */
+	rrc = 0;
+	if (s.uplink_bytes)
+		rrc = (uint64_t)s.rrc_ms * 1000 / s.uplink_bytes;
+
+	printf("radio: uplink %u bytes (%u in poor coverage), "
+	    "%u forced by deadline, %u timed out, rrc connected %u ms "
+	    "(%u us/byte)\n", s.uplink_bytes, s.uplink_bytes_poor,
+	    s.uplink_deadline, s.uplink_timeouts, s.rrc_ms, rrc);
+}
+
+void
+radio_start(void)
+{
+	struct thread *td;
+	int i;
+
+	for (i = 0; i < nitems(radio_urcs); i++)
+		at_urc_register(&radio_urcs[i]);
+
+	/* Switch to the flight mode. */
+	at_cmd(flight, NULL, 0);
+
+	/* Read current system mode. */
+	at_cmd(systm_mode, NULL, 0);
+
+	/* Set new system mode */
+	at_cmd(catm1_gps, NULL, 0);
+
+	lte_configure();
+	at_cmd(modem_sleep_subscribe, NULL, 0);
+
+	/* Switch to normal mode. */
+	psm_attach_begin();
+	at_cmd(normal, NULL, 0);
+
+	mdx_mutex_lock(&radio_mtx);
+	lte_on = 1;
+	radio_energy();
+	mdx_mutex_unlock(&radio_mtx);
+
+	printf("Awaiting registration in the LTE-M network...\n");
+
+	at_cmd(gps_enable, NULL, 0);
+
+	td = mdx_thread_create("radio", PRIO_NORMAL, 0, 4096, radio_thread, NULL);
+	if (td == NULL)
+		panic("failed to create radio thread\n");
+	stack_watch(td);
+	mdx_sched_add(td);
+}
+
+void
+radio_init(void)
+{
+
+	mdx_mutex_init(&radio_mtx);
+	mdx_sem_init(&radio_sem, 0);
+	list_init(&uplink_waiters);
+	cpu_acct_register(&radio_acct);
+
+	/* Switch to LTE */
+	antenna_init();
+	psm_init();
+	cell_init();
+
+	metrics_register(&radio_group);
+}
@@ -0,0 +1,153 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+
+#include "ring.h"
+
+/*
+ * The head and tail are free running, the buffer index is taken
+ * modulo the size. The barrier orders the data accesses against the
+ * index update seen by the other side.
+ */
+
+#ifdef __arm__
+#define	ring_barrier()	__asm __volatile("dmb" ::: "memory")
+#else
+#define	ring_barrier()	__atomic_thread_fence(__ATOMIC_SEQ_CST)	/* host */
+#endif
+
+void
+ring_init(struct ring *r, uint8_t *buf, uint32_t size)
+{
+
+	r->buf = buf;
+	r->size = size;
+	r->head = 0;
+	r->tail = 0;
+}
+
+uint32_t
+ring_used(struct ring *r)
+{
+
+	return (r->head - r->tail);
+}
+
+uint32_t
+ring_space(struct ring *r)
+{
+
+	return (r->size - (r->head - r->tail));
+}
+
+/*
+ * Copy the whole chunk in, or nothing if it does not fit.
+ */
+int
+ring_put(struct ring *r, const void *data, uint32_t len)
+{
+	uint32_t head;
+	uint32_t off;
+	uint32_t n;
+
+	if (len > ring_space(r))
+		return (-1);
+
+	head = r->head;
+	off = head & (r->size - 1);
+	n = r->size - off;
+	if (n > len)
+		n = len;
+
+	memcpy(r->buf + off, data, n);
+	if (n < len)
+		memcpy(r->buf, (const uint8_t *)data + n, len - n);
+
+	ring_barrier();
+	r->head = head + len;
+
+	return (0);
+}
+
+/*
+ * Get the contiguous readable part, up to the buffer end.
+ */
+uint32_t
+ring_peek(struct ring *r, uint8_t **ptr)
+{
+	uint32_t used;
+	uint32_t off;
+	uint32_t n;
+
+	used = ring_used(r);
+	ring_barrier();
+
+	off = r->tail & (r->size - 1);
+	n = r->size - off;
+	if (n > used)
+		n = used;
+
+	*ptr = r->buf + off;
+
+	return (n);
+}
+
+/*
+ * Copy len bytes out, wrapping around the buffer end.
+ */
+int
+ring_get(struct ring *r, void *buf, uint32_t len)
+{
+	uint32_t off;
+	uint32_t n;
+
+	if (len > ring_used(r))
+		return (-1);
+	ring_barrier();
+
+	off = r->tail & (r->size - 1);
+	n = r->size - off;
+	if (n > len)
+		n = len;
+
+	memcpy(buf, r->buf + off, n);
+	if (n < len)
+		memcpy((uint8_t *)buf + n, r->buf, len - n);
+
+	ring_consume(r, len);
+
+	return (0);
+}
+
+void
+ring_consume(struct ring *r, uint32_t len)
+{
+
+	ring_barrier();
+	r->tail += len;
+}
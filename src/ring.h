@@ -0,0 +1,50 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_RING_H_
+#define	_SRC_RING_H_
+
+/*
+ * Single producer, single consumer byte ring.
+ * The producer may run in interrupt context, no locking is needed.
+ */
+
+struct ring {
+	uint8_t			*buf;
+	uint32_t		size;	/* Power of two */
+	volatile uint32_t	head;	/* Written by the producer only */
+	volatile uint32_t	tail;	/* Written by the consumer only */
+};
+
+void ring_init(struct ring *r, uint8_t *buf, uint32_t size);
+uint32_t ring_used(struct ring *r);
+uint32_t ring_space(struct ring *r);
+int ring_put(struct ring *r, const void *data, uint32_t len);
+uint32_t ring_peek(struct ring *r, uint8_t **ptr);
+int ring_get(struct ring *r, void *buf, uint32_t len);
+void ring_consume(struct ring *r, uint32_t len);
+
+#endif /* !_SRC_RING_H_ */
@@ -31,6 +31,7 @@
 #include <sys/malloc.h>
 #include <sys/thread.h>
 #include <sys/sem.h>
+#include <sys/mutex.h>
 
 #include <arm/arm/nvic.h>
 #include <arm/nordicsemi/nrf9160.h>
@@ -38,49 +39,48 @@
 #include <dev/mc6470/mc6470.h>
 
 #include "board.h"
+#include "clock.h"
+#include "metrics.h"
 #include "sensor.h"
+#include "trace.h"
+#include "workq.h"
 
 #include <lib/msun/src/math.h>
 
-static mdx_sem_t sem;
+/*
+ * The orientation is read by the reports only, there is no polling
+ * between them. The last reading is exported as metrics; sensor_mtx
+ * keeps the I2C transactions of a report and of the tap events apart.
+ */
+
+static struct work mc6470_work;
+static struct mdx_mutex sensor_mtx;
 static mdx_device_t i2c;
 static mdx_device_t gpiote;
 
-void
-mc6470_intr(void *arg, int irq)
-{
-
-	mdx_sem_post(&sem);
-}
-
-static void
-mc6470_ecompass(struct ecompass_data *data,
-    int16_t mag_x, int16_t mag_y, int16_t mag_z,
-    int16_t acc_x, int16_t acc_y, int16_t acc_z)
-{
-	double pitch, roll, azimuth;
-	double X_h, Y_h;
-
-	/* Calculate pitch and roll, in the range (-pi, pi). */
-	pitch = atan2((double) - acc_x,
-	    sqrt((long)acc_z * (long)acc_z + (long)acc_y * (long)acc_y));
-	roll = atan2((double)acc_y,
-	    sqrt((long)acc_z * (long)acc_z + (long)acc_x * (long)acc_x));
+static int32_t sensor_pitch;
+static int32_t sensor_roll;
+static int32_t sensor_azimuth;
 
-	X_h = (double)mag_x * cos(pitch) +
-	    (double)mag_y * sin(roll) * sin(pitch) +
-	    (double)mag_z * cos(roll) * sin(pitch);
+static const struct metric sensor_metrics[] = {
+	METRIC_I32("pitch", &sensor_pitch),
+	METRIC_I32("roll", &sensor_roll),
+	METRIC_I32("azimuth", &sensor_azimuth),
+};
 
-	Y_h = (double)mag_y * cos(roll) -
-	    (double)mag_z * sin(roll);
+static struct metrics_group sensor_group = {
+	.name = "sensor",
+	.metrics = sensor_metrics,
+	.nmetrics = nitems(sensor_metrics),
+};
 
-	azimuth = atan2(Y_h, X_h);
-	if(azimuth < 0)	/* Convert Azimuth in the range (0, 2pi) */
-		azimuth = 2 * M_PI + azimuth;
+void __ramfunc
+mc6470_intr(void *arg, int irq)
+{
 
-	data->azimuth = (int16_t)(azimuth * 180.0 / M_PI);
-	data->pitch = (int16_t)(pitch * 180.0 / M_PI);
-	data->roll = (int16_t)(roll * 180.0 / M_PI);
+	trace_intr_enter(irq);
+	work_post(&mc6470_work);
+	trace_intr_exit(irq);
 }
 
 int
@@ -93,6 +93,8 @@ mc6470_process(struct ecompass_data *data)
 	float xf, yf;
 	float a;
 
+	mdx_mutex_lock(&sensor_mtx);
+	trace_begin(TRACE_I2C, 0);
 	mc6470_read_reg(i2c, MC6470_MAG, MC6470_MAG_CTRL1, &ctrl1);
 
 	bzero(vals, 6);
@@ -106,6 +108,8 @@ mc6470_process(struct ecompass_data *data)
 	acc_x = vals[1] << 8 | vals[0] << 0;
 	acc_y = vals[3] << 8 | vals[2] << 0;
 	acc_z = vals[5] << 8 | vals[4] << 0;
+	trace_end(TRACE_I2C, 0);
+	mdx_mutex_unlock(&sensor_mtx);
 
 	if (1 == 0) {
 		printf("%d/%d, %d/%d, %d/%d\n",
@@ -132,41 +136,41 @@ mc6470_process(struct ecompass_data *data)
 
 	mc6470_ecompass(data, mag_x, mag_y, mag_z, acc_x, acc_y, acc_z);
 
+	sensor_pitch = data->pitch;
+	sensor_roll = data->roll;
+	sensor_azimuth = data->azimuth;
+
 	return (0);
 }
 
 static void
-mc6470_thread(void *arg)
+mc6470_event(struct work *w)
 {
 	uint8_t val;
 
-	while (1) {
-		mdx_sem_wait(&sem);
+	//printf("%s: event received\n", __func__);
 
-		//printf("%s: event received\n", __func__);
-
-		/* Ack the event by reading SR register. */
-		mc6470_read_reg(i2c, MC6470_ACC, MC6470_SR, &val);
-	}
+	/* Ack the event by reading SR register. */
+	mdx_mutex_lock(&sensor_mtx);
+	mc6470_read_reg(i2c, MC6470_ACC, MC6470_SR, &val);
+	mdx_mutex_unlock(&sensor_mtx);
 }
 
 void
 sensor_init(void)
 {
 	int16_t xoffs, yoffs, zoffs;
-	struct thread *td;
 	uint8_t val;
 	uint8_t reg;
 
-	mdx_sem_init(&sem, 0);
-	td = mdx_thread_create("mc6470", 1, 0, 4096, mc6470_thread, NULL);
-	mdx_sched_add(td);
+	mdx_mutex_init(&sensor_mtx);
+	work_init(&mc6470_work, "mc6470", WORK_PRIO_HIGH, mc6470_event, NULL);
 
-	i2c = mdx_device_lookup_by_name("nrf_twim", 0);
+	i2c = board_device("nrf_twim", 0);
 	if (i2c == NULL)
 		panic("could not find twim device");
 
-	gpiote = mdx_device_lookup_by_name("nrf_gpiote", 0);
+	gpiote = board_device("nrf_gpiote", 0);
 	if (gpiote == NULL)
 		panic("could not find gpiote device");
 
@@ -224,17 +228,6 @@ sensor_init(void)
 	mc6470_write_reg(i2c, MC6470_MAG, MC6470_MAG_CTRL3, val);
 	mdx_usleep(5000000);
 #endif
-}
 
-void
-sensor_test(void)
-{
-	struct ecompass_data data;
-
-	while (1) {
-		mc6470_process(&data);
-		printf("pitch %3d, roll %3d, azimuth %3d\n",
-		    data.pitch, data.roll, data.azimuth);
-		mdx_usleep(100000);
-	}
+	metrics_register(&sensor_group);
 }
@@ -34,8 +34,10 @@ struct ecompass_data {
 };
 
 void sensor_init(void);
-void sensor_test(void);
 void mc6470_intr(void *arg, int irq);
 int mc6470_process(struct ecompass_data *data);
+void mc6470_ecompass(struct ecompass_data *data,
+    int16_t mag_x, int16_t mag_y, int16_t mag_z,
+    int16_t acc_x, int16_t acc_y, int16_t acc_z);
 
 #endif /* !_SRC_SENSOR_H_ */
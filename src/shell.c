@@ -0,0 +1,346 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include <arm/nordicsemi/nrf9160.h>
+
+#include "at.h"
+#include "bench.h"
+#include "board.h"
+#include "boot.h"
+#include "clock.h"
+#include "cpu.h"
+#include "energy.h"
+#include "heap.h"
+#include "log.h"
+#include "metrics.h"
+#include "prof.h"
+#include "radio.h"
+#include "ring.h"
+#include "shell.h"
+#include "stack.h"
+#include "trace.h"
+
+/*
+ * Console shell.
+ *
+ * The UART callback runs in interrupt context: it only puts the
+ * character into the RX ring and wakes the shell thread, which does
+ * the line editing and runs the commands. The commands may block for
+ * long (AT commands, benchmarks, dumps), so the thread is a background
+ * one of its own rather than a work item.
+ */
+
+#define	SHELL_RX_SIZE		256
+#define	SHELL_MAXARGS		8
+#define	SHELL_STACK_SIZE	4096
+
+struct shell_cmd {
+	const char	*name;
+	const char	*help;
+	void		(*fn)(int argc, char **argv);
+};
+
+static uint8_t shell_rx_buf[SHELL_RX_SIZE];
+static struct ring shell_rx;
+static mdx_sem_t shell_sem;
+static struct shell_line shell_line;
+
+static uint32_t shell_rx_drops;
+
+static const struct metric shell_metrics[] = {
+	METRIC_U32("rx_drops", &shell_rx_drops),
+};
+
+static struct metrics_group shell_group = {
+	.name = "shell",
+	.metrics = shell_metrics,
+	.nmetrics = nitems(shell_metrics),
+};
+
+static void shell_help(int argc, char **argv);
+
+static void
+shell_at(int argc, char **argv)
+{
+	char resp[LC_MAX_READ_LENGTH * 2];
+	int result;
+
+	if (argc != 2) {
+		printf("usage: at <command>\n");
+		return;
+	}
+
+	result = at_cmd(argv[1], resp, sizeof(resp));
+	printf("%s%s\n", resp, result == AT_RESULT_OK ? "OK" : "ERROR");
+}
+
+static void
+shell_stats(int argc, char **argv)
+{
+
+	metrics_dump();
+	radio_stats();
+	cpu_stats();
+}
+
+static void
+shell_heap(int argc, char **argv)
+{
+
+	heap_stats();
+}
+
+static void
+shell_stack(int argc, char **argv)
+{
+
+	stack_stats();
+}
+
+static void
+shell_boot(int argc, char **argv)
+{
+
+	boot_stats();
+}
+
+static void
+shell_prof(int argc, char **argv)
+{
+	uint32_t hz;
+
+	if (argc >= 2 && strcmp(argv[1], "start") == 0) {
+		hz = argc == 3 ? atoi(argv[2]) : 0;
+		if (prof_start(hz) != 0)
+			printf("prof: can't start at %u Hz\n", hz);
+	} else if (argc == 2 && strcmp(argv[1], "stop") == 0)
+		prof_stop();
+	else if (argc == 2 && strcmp(argv[1], "reset") == 0)
+		prof_reset();
+	else if (argc == 2 && strcmp(argv[1], "dump") == 0)
+		prof_dump();
+	else
+		printf("usage: prof start [hz] | stop | reset | dump\n");
+}
+
+static void
+shell_energy(int argc, char **argv)
+{
+
+	if (argc == 3) {
+		if (energy_set_current(argv[1], atoi(argv[2])) != 0)
+			printf("energy: unknown state %s\n", argv[1]);
+		return;
+	}
+
+	energy_stats();
+}
+
+static void
+shell_trace(int argc, char **argv)
+{
+
+	trace_dump();
+}
+
+static void
+shell_log(int argc, char **argv)
+{
+	int i;
+
+	if (argc == 3) {
+		log_set_level(atoi(argv[1]), atoi(argv[2]));
+		return;
+	}
+
+	for (i = 0; i < LOG_NMODULES; i++)
+		printf("module %d level %d\n", i, log_levels[i]);
+}
+
+static void
+shell_bench(int argc, char **argv)
+{
+
+	log_bench();
+	bench_ramfunc();
+	bench_suite();
+}
+
+static const struct shell_cmd shell_cmds[] = {
+	{ "at", "at <command>: send an AT command", shell_at },
+	{ "stats", "stats: dump the metrics", shell_stats },
+	{ "heap", "heap: show the heap usage", shell_heap },
+	{ "log", "log [<module> <level>]: get or set log levels", shell_log },
+	{ "bench", "bench: run the benchmarks", shell_bench },
+	{ "stack", "stack: show the thread stack usage", shell_stack },
+	{ "boot", "boot: show the boot step timings", shell_boot },
+	{ "trace", "trace: dump the event trace", shell_trace },
+	{ "prof", "prof start [hz] | stop | reset | dump: PC sampling",
+	    shell_prof },
+	{ "energy", "energy [<state> <uA>]: show the energy model or set "
+	    "a current", shell_energy },
+	{ "help", "help: list the commands", shell_help },
+};
+
+static void
+shell_help(int argc, char **argv)
+{
+	int i;
+
+	for (i = 0; i < nitems(shell_cmds); i++)
+		printf("%s\n", shell_cmds[i].help);
+}
+
+static void
+shell_exec(char *line)
+{
+	char *argv[SHELL_MAXARGS];
+	char *t;
+	int argc;
+	int i;
+
+	/* AT commands are passed through as is. */
+	if (strncmp(line, "AT", 2) == 0 || strncmp(line, "at+", 3) == 0 ||
+	    strncmp(line, "at%", 3) == 0) {
+		argv[0] = "at";
+		argv[1] = line;
+		shell_at(2, argv);
+		return;
+	}
+
+	argc = 0;
+	t = line;
+
+	/* The last argument takes the rest of the line. */
+	while (argc < SHELL_MAXARGS - 1 &&
+	    (argv[argc] = strsep(&t, " ")) != NULL) {
+		if (*argv[argc] != '\0')
+			argc++;
+	}
+	if (t != NULL && argc == SHELL_MAXARGS - 1)
+		argv[argc++] = t;
+
+	if (argc == 0)
+		return;
+
+	for (i = 0; i < nitems(shell_cmds); i++)
+		if (strcmp(argv[0], shell_cmds[i].name) == 0) {
+			shell_cmds[i].fn(argc, argv);
+			return;
+		}
+
+	printf("%s: command not found\n", argv[0]);
+}
+
+/*
+ * Line discipline. Returns 1 once a line is complete, the line is
+ * NUL-terminated in l->buf then. Has no dependencies, so it can be
+ * built on the host.
+ */
+int
+shell_line_input(struct shell_line *l, int c)
+{
+
+	switch (c) {
+	case '\r':
+	case '\n':
+		if (l->len == 0)
+			return (0);
+		l->buf[l->len] = '\0';
+		return (1);
+	case '\b':
+	case 0x7f:
+		if (l->len > 0)
+			l->len--;
+		return (0);
+	default:
+		if (c < ' ' || c > '~')
+			return (0);
+		if (l->len < SHELL_LINE_SIZE - 1)
+			l->buf[l->len++] = c;
+		return (0);
+	}
+}
+
+static void
+shell_input(int c, void *arg)
+{
+	uint8_t ch;
+
+	ch = c;
+
+	if (ring_put(&shell_rx, &ch, 1) != 0) {
+		shell_rx_drops++;
+		return;
+	}
+
+	mdx_sem_post(&shell_sem);
+}
+
+static void
+shell_thread(void *arg)
+{
+	uint8_t c;
+
+	while (1) {
+		mdx_sem_wait(&shell_sem);
+		while (ring_get(&shell_rx, &c, 1) == 0) {
+			if (shell_line_input(&shell_line, c) == 0)
+				continue;
+			shell_exec(shell_line.buf);
+			shell_line.len = 0;
+		}
+	}
+}
+
+void
+shell_init(void)
+{
+	struct thread *td;
+	mdx_device_t uart;
+
+	ring_init(&shell_rx, shell_rx_buf, SHELL_RX_SIZE);
+	mdx_sem_init(&shell_sem, 0);
+
+	td = mdx_thread_create("shell", PRIO_BACKGROUND, 0, SHELL_STACK_SIZE,
+	    shell_thread, NULL);
+	if (td == NULL)
+		panic("failed to create shell thread\n");
+	stack_watch(td);
+	mdx_sched_add(td);
+
+	uart = board_device("nrf_uarte", 0);
+	if (!uart)
+		panic("uart dev not found");
+	nrf_uarte_register_callback(uart, shell_input, NULL);
+
+	metrics_register(&shell_group);
+}
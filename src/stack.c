@@ -0,0 +1,284 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+
+#include "log.h"
+#include "metrics.h"
+#include "stack.h"
+#include "workq.h"
+
+/*
+ * Thread stack watermarks.
+ *
+ * The unused part of a stack is filled with a pattern when the thread
+ * is registered. The stacks grow down, so the number of intact pattern
+ * words from the bottom is the headroom that was never touched.
+ *
+ * A new thread is painted up to its initial frame, before it is added
+ * to the scheduler. The running thread is painted up to a margin below
+ * its current stack pointer.
+ *
+ * A thread that exits must call stack_unwatch() first. The scan and
+ * the report use a thread outside of the critical section, so the
+ * removal waits until they are done with that thread.
+ */
+
+#define	STACK_PAINT		0xa5a5a5a5
+#define	STACK_MAX_THREADS	16
+#define	STACK_SELF_MARGIN	64
+#define	STACK_WARN_PCT		85
+#define	STACK_SPARE_PCT		25	/* Margin for the suggested size */
+#define	STACK_SCAN_MS		60000
+#define	STACK_SCAN_SLACK_MS	10000
+#define	STACK_UNWATCH_US	1000
+
+struct stack_info {
+	struct thread	*td;
+	uint32_t	peak;
+	int		warned;
+	int		busy;		/* In use outside of critical sections */
+};
+
+static struct stack_info stacks[STACK_MAX_THREADS];
+static int nstacks;
+static struct work stack_work;
+
+static uint32_t stack_min_free;
+static uint32_t stack_warnings;
+
+static const struct metric stack_metrics[] = {
+	METRIC_U32("min_free", &stack_min_free),
+	METRIC_U32("warnings", &stack_warnings),
+};
+
+static struct metrics_group stack_group = {
+	.name = "stack",
+	.metrics = stack_metrics,
+	.nmetrics = nitems(stack_metrics),
+};
+
+void
+stack_watch(struct thread *td)
+{
+	uint32_t *p, *end;
+	uint8_t *top;
+
+	if (nstacks >= STACK_MAX_THREADS) {
+		log_warn("%s: too many threads, %s is not watched\n",
+		    __func__, td->td_name);
+		return;
+	}
+
+	if (td == curthread)
+		top = (uint8_t *)__builtin_frame_address(0) -
+		    STACK_SELF_MARGIN;
+	else
+		top = (uint8_t *)td->td_tf;
+
+	p = (uint32_t *)td->td_stack;
+	end = (uint32_t *)((uintptr_t)top & ~3);
+	while (p < end)
+		*p++ = STACK_PAINT;
+
+	critical_enter();
+	stacks[nstacks].td = td;
+	stacks[nstacks].peak = 0;
+	stacks[nstacks].warned = 0;
+	stacks[nstacks].busy = 0;
+	nstacks++;
+	critical_exit();
+}
+
+/*
+ * Find the entry of a thread. Called in a critical section.
+ */
+static int
+stack_find(struct thread *td)
+{
+	int i;
+
+	for (i = 0; i < nstacks; i++)
+		if (stacks[i].td == td)
+			return (i);
+
+	return (-1);
+}
+
+/*
+ * Hold or drop the entry at i, which can move but not go away while
+ * it is held. Returns its thread.
+ */
+static struct thread *
+stack_hold(int i)
+{
+	struct thread *td;
+
+	td = NULL;
+
+	critical_enter();
+	if (i < nstacks) {
+		td = stacks[i].td;
+		stacks[i].busy++;
+	}
+	critical_exit();
+
+	return (td);
+}
+
+static void
+stack_drop(struct thread *td)
+{
+
+	critical_enter();
+	stacks[stack_find(td)].busy--;
+	critical_exit();
+}
+
+void
+stack_unwatch(struct thread *td)
+{
+	int i;
+
+	while (1) {
+		critical_enter();
+		i = stack_find(td);
+		if (i < 0 || stacks[i].busy == 0)
+			break;
+		critical_exit();
+		mdx_usleep(STACK_UNWATCH_US);
+	}
+
+	if (i >= 0) {
+		nstacks--;
+		for (; i < nstacks; i++)
+			stacks[i] = stacks[i + 1];
+	}
+	critical_exit();
+}
+
+static uint32_t
+stack_used(struct thread *td)
+{
+	uint32_t *p, *end;
+
+	p = (uint32_t *)td->td_stack;
+	end = (uint32_t *)(td->td_stack + td->td_stack_size);
+	while (p < end && *p == STACK_PAINT)
+		p++;
+
+	return ((uint8_t *)end - (uint8_t *)p);
+}
+
+void
+stack_scan(void)
+{
+	struct stack_info *s;
+	struct thread *td;
+	uint32_t avail;
+	uint32_t size;
+	uint32_t peak;
+	bool warn;
+	int i;
+
+	stack_min_free = 0xffffffff;
+
+	for (i = 0; (td = stack_hold(i)) != NULL; i++) {
+		size = td->td_stack_size;
+		peak = stack_used(td);
+		avail = size - peak;
+		if (avail < stack_min_free)
+			stack_min_free = avail;
+
+		/* Other threads may have been removed meanwhile. */
+		critical_enter();
+		s = &stacks[stack_find(td)];
+		s->peak = peak;
+		warn = s->warned == 0 && peak * 100 >= size * STACK_WARN_PCT;
+		if (warn)
+			s->warned = 1;
+		critical_exit();
+
+		if (warn) {
+			stack_warnings++;
+			log_warn("%s: %s stack at %u%% (%u of %u bytes)\n",
+			    __func__, td->td_name, peak * 100 / size,
+			    peak, size);
+		}
+
+		stack_drop(td);
+	}
+}
+
+static void
+stack_scan_work(struct work *w)
+{
+
+	stack_scan();
+}
+
+void
+stack_stats(void)
+{
+	struct stack_info s;
+	struct thread *td;
+	uint32_t size;
+	uint32_t want;
+	int i;
+
+	stack_scan();
+
+	printf("stack: %-10s %6s %6s %4s %6s\n",
+	    "thread", "size", "peak", "pct", "suggest");
+	for (i = 0; (td = stack_hold(i)) != NULL; i++) {
+		critical_enter();
+		s = stacks[stack_find(td)];
+		critical_exit();
+
+		size = s.td->td_stack_size;
+		want = s.peak + s.peak * STACK_SPARE_PCT / 100;
+		want = (want + 255) & ~255;
+		printf("stack: %-10s %6u %6u %3u%% %6u\n", s.td->td_name,
+		    size, s.peak, s.peak * 100 / size, want);
+
+		stack_drop(td);
+	}
+}
+
+void
+stack_init(void)
+{
+
+	/* The calling (main) thread. */
+	stack_watch(curthread);
+
+	work_init(&stack_work, "stack", WORK_PRIO_LOW, stack_scan_work, NULL);
+	work_periodic(&stack_work, STACK_SCAN_MS, STACK_SCAN_SLACK_MS);
+
+	metrics_register(&stack_group);
+}
@@ -39,6 +39,9 @@
 #include <mbedtls/error.h>
 #include <mbedtls/debug.h>
 
+#define	LOG_MODULE	LOG_MOD_TLS
+
+#include "log.h"
 #include "tls.h"
 
 static char buf[1024];
@@ -155,9 +158,9 @@ ssl_recv(void *arg, unsigned char *buf, size_t len)
 
 	fd = (int)arg;
 
-	printf("%s: len %d\n", __func__, len);
+	log_debug("%s: len %d\n", __func__, len);
 	err = nrf_read(fd, buf, len);
-	printf("%s: err %d\n", __func__, err);
+	log_debug("%s: err %d\n", __func__, err);
 
 	return (err);
 }
@@ -170,9 +173,9 @@ ssl_send(void *arg, const unsigned char *buf, size_t len)
 
 	fd = (int)arg;
 
-	printf("%s: len %d\n", __func__, len);
+	log_debug("%s: len %d\n", __func__, len);
 	err = nrf_write(fd, buf, len);
-	printf("%s: err %d\n", __func__, err);
+	log_debug("%s: err %d\n", __func__, err);
 
 	return (err);
 }
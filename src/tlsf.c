@@ -0,0 +1,336 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+
+#include "tlsf.h"
+
+/*
+ * TLSF allocator core. It has no dependencies besides the compiler, so
+ * the same file is built into tools/heapreplay on the host. Locking is
+ * up to the caller.
+ *
+ * Every block has a header, 8 bytes on the target. The size field holds the payload
+ * size and two flags: this block is free, and the physically previous
+ * block is free. A free block keeps its list links in the payload.
+ * Each region ends with a used zero-size sentinel block, so the blocks
+ * of different regions are never merged.
+ */
+
+#define	TLSF_BLOCK_FREE		(1 << 0)
+#define	TLSF_PREV_FREE		(1 << 1)
+#define	TLSF_FLAGS		(TLSF_BLOCK_FREE | TLSF_PREV_FREE)
+#define	TLSF_ALIGN		(1 << TLSF_ALIGN_SHIFT)
+#define	TLSF_HDR		__builtin_offsetof(struct tlsf_block, next_free)
+#define	TLSF_MIN_SIZE		(2 * sizeof(struct tlsf_block *))
+#define	TLSF_SMALL		(1 << TLSF_FL_SHIFT)
+#define	TLSF_MAX_SIZE		(1 << TLSF_FL_MAX_LOG2)
+
+struct tlsf_block {
+	struct tlsf_block	*prev_phys;
+	uint32_t		size;
+	/* Payload starts here. Free blocks only: */
+	struct tlsf_block	*next_free;
+	struct tlsf_block	*prev_free;
+};
+
+static inline int
+tlsf_fls(uint32_t x)
+{
+
+	return (31 - __builtin_clz(x));
+}
+
+static inline int
+tlsf_ffs(uint32_t x)
+{
+
+	return (__builtin_ctz(x));
+}
+
+static inline uint32_t
+block_size(struct tlsf_block *b)
+{
+
+	return (b->size & ~TLSF_FLAGS);
+}
+
+static inline void *
+block_payload(struct tlsf_block *b)
+{
+
+	return ((uint8_t *)b + TLSF_HDR);
+}
+
+static inline struct tlsf_block *
+block_from_payload(void *ptr)
+{
+
+	return ((struct tlsf_block *)((uint8_t *)ptr - TLSF_HDR));
+}
+
+static inline struct tlsf_block *
+block_next(struct tlsf_block *b)
+{
+
+	return ((struct tlsf_block *)((uint8_t *)block_payload(b) +
+	    block_size(b)));
+}
+
+static void
+mapping(uint32_t size, int *fl, int *sl)
+{
+	int f;
+
+	if (size < TLSF_SMALL) {
+		*fl = 0;
+		*sl = size / (TLSF_SMALL / TLSF_SL_COUNT);
+	} else {
+		f = tlsf_fls(size);
+		*sl = (size >> (f - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+		*fl = f - TLSF_FL_SHIFT + 1;
+	}
+}
+
+/*
+ * Round the request up to the next list boundary, so that any block
+ * found in the list is large enough.
+ */
+static void
+mapping_search(uint32_t size, int *fl, int *sl)
+{
+
+	if (size >= TLSF_SMALL)
+		size += (1 << (tlsf_fls(size) - TLSF_SL_LOG2)) - 1;
+	mapping(size, fl, sl);
+}
+
+static void
+block_insert(struct tlsf *t, struct tlsf_block *b)
+{
+	struct tlsf_block *head;
+	int fl, sl;
+
+	mapping(block_size(b), &fl, &sl);
+
+	head = t->blocks[fl][sl];
+	b->next_free = head;
+	b->prev_free = NULL;
+	if (head != NULL)
+		head->prev_free = b;
+	t->blocks[fl][sl] = b;
+
+	t->fl_bitmap |= (1 << fl);
+	t->sl_bitmap[fl] |= (1 << sl);
+}
+
+static void
+block_remove(struct tlsf *t, struct tlsf_block *b)
+{
+	int fl, sl;
+
+	mapping(block_size(b), &fl, &sl);
+
+	if (b->next_free != NULL)
+		b->next_free->prev_free = b->prev_free;
+	if (b->prev_free != NULL)
+		b->prev_free->next_free = b->next_free;
+	else {
+		t->blocks[fl][sl] = b->next_free;
+		if (b->next_free == NULL) {
+			t->sl_bitmap[fl] &= ~(1 << sl);
+			if (t->sl_bitmap[fl] == 0)
+				t->fl_bitmap &= ~(1 << fl);
+		}
+	}
+}
+
+static struct tlsf_block *
+block_find(struct tlsf *t, int fl, int sl)
+{
+	uint32_t map;
+
+	map = t->sl_bitmap[fl] & (~0U << sl);
+	if (map == 0) {
+		if (fl + 1 >= TLSF_FL_COUNT)
+			return (NULL);
+		map = t->fl_bitmap & (~0U << (fl + 1));
+		if (map == 0)
+			return (NULL);
+		fl = tlsf_ffs(map);
+		map = t->sl_bitmap[fl];
+	}
+	sl = tlsf_ffs(map);
+
+	return (t->blocks[fl][sl]);
+}
+
+void
+tlsf_init(struct tlsf *t)
+{
+	int fl, sl;
+
+	t->fl_bitmap = 0;
+	for (fl = 0; fl < TLSF_FL_COUNT; fl++) {
+		t->sl_bitmap[fl] = 0;
+		for (sl = 0; sl < TLSF_SL_COUNT; sl++)
+			t->blocks[fl][sl] = NULL;
+	}
+}
+
+int
+tlsf_add_region(struct tlsf *t, void *base, uint32_t size)
+{
+	struct tlsf_block *b, *end;
+	uintptr_t start;
+
+	start = ((uintptr_t)base + TLSF_ALIGN - 1) & ~(TLSF_ALIGN - 1);
+	size -= start - (uintptr_t)base;
+	size &= ~(TLSF_ALIGN - 1);
+
+	/* A free block and the sentinel. */
+	if (size < 2 * TLSF_HDR + TLSF_MIN_SIZE)
+		return (-1);
+	size -= 2 * TLSF_HDR;
+	if (size >= TLSF_MAX_SIZE)
+		size = TLSF_MAX_SIZE - TLSF_ALIGN;
+
+	b = (struct tlsf_block *)start;
+	b->prev_phys = NULL;
+	b->size = size | TLSF_BLOCK_FREE;
+
+	end = block_next(b);
+	end->prev_phys = b;
+	end->size = 0 | TLSF_PREV_FREE;
+
+	block_insert(t, b);
+
+	return (0);
+}
+
+void *
+tlsf_malloc(struct tlsf *t, uint32_t size)
+{
+	struct tlsf_block *b, *rem, *next;
+	int fl, sl;
+
+	if (size == 0 || size >= TLSF_MAX_SIZE / 2)
+		return (NULL);
+
+	size = (size + TLSF_ALIGN - 1) & ~(TLSF_ALIGN - 1);
+	if (size < TLSF_MIN_SIZE)
+		size = TLSF_MIN_SIZE;
+
+	mapping_search(size, &fl, &sl);
+	if (fl >= TLSF_FL_COUNT)
+		return (NULL);
+
+	b = block_find(t, fl, sl);
+	if (b == NULL)
+		return (NULL);
+	block_remove(t, b);
+
+	next = block_next(b);
+
+	/* Split off the tail if it can hold a block. */
+	if (block_size(b) - size >= TLSF_HDR + TLSF_MIN_SIZE) {
+		rem = (struct tlsf_block *)((uint8_t *)block_payload(b) + size);
+		rem->prev_phys = b;
+		rem->size = (block_size(b) - size - TLSF_HDR) |
+		    TLSF_BLOCK_FREE;
+		next->prev_phys = rem;
+		block_insert(t, rem);
+
+		b->size = size | (b->size & TLSF_PREV_FREE);
+	} else {
+		b->size &= ~TLSF_BLOCK_FREE;
+		next->size &= ~TLSF_PREV_FREE;
+	}
+
+	return (block_payload(b));
+}
+
+void
+tlsf_free(struct tlsf *t, void *ptr)
+{
+	struct tlsf_block *b, *prev, *next;
+
+	if (ptr == NULL)
+		return;
+
+	b = block_from_payload(ptr);
+
+	if (b->size & TLSF_PREV_FREE) {
+		prev = b->prev_phys;
+		block_remove(t, prev);
+		prev->size += TLSF_HDR + block_size(b);
+		b = prev;
+	}
+
+	next = block_next(b);
+	if (next->size & TLSF_BLOCK_FREE) {
+		block_remove(t, next);
+		b->size += TLSF_HDR + block_size(next);
+		next = block_next(b);
+	}
+
+	b->size |= TLSF_BLOCK_FREE;
+	next->prev_phys = b;
+	next->size |= TLSF_PREV_FREE;
+
+	block_insert(t, b);
+}
+
+uint32_t
+tlsf_usable_size(void *ptr)
+{
+
+	return (block_size(block_from_payload(ptr)));
+}
+
+/*
+ * Walks all the free lists, so not constant time. For reports only.
+ */
+void
+tlsf_get_stats(struct tlsf *t, struct tlsf_stats *s)
+{
+	struct tlsf_block *b;
+	int fl, sl;
+
+	s->free = 0;
+	s->largest = 0;
+	s->nfree = 0;
+
+	for (fl = 0; fl < TLSF_FL_COUNT; fl++)
+		for (sl = 0; sl < TLSF_SL_COUNT; sl++)
+			for (b = t->blocks[fl][sl]; b != NULL;
+			    b = b->next_free) {
+				s->free += block_size(b);
+				s->nfree++;
+				if (block_size(b) > s->largest)
+					s->largest = block_size(b);
+			}
+}
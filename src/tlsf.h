@@ -0,0 +1,64 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_TLSF_H_
+#define	_SRC_TLSF_H_
+
+/*
+ * Two-level segregated fit allocator: the first level splits the sizes
+ * by power of two, the second level splits each of these linearly in
+ * TLSF_SL_COUNT lists. Both malloc and free are O(1).
+ */
+
+#define	TLSF_ALIGN_SHIFT	3
+#define	TLSF_SL_LOG2		4
+#define	TLSF_SL_COUNT		(1 << TLSF_SL_LOG2)
+#define	TLSF_FL_SHIFT		(TLSF_SL_LOG2 + TLSF_ALIGN_SHIFT)
+#define	TLSF_FL_MAX_LOG2	20	/* 1 MB blocks */
+#define	TLSF_FL_COUNT		(TLSF_FL_MAX_LOG2 - TLSF_FL_SHIFT + 1)
+
+struct tlsf_block;
+
+struct tlsf {
+	uint32_t		fl_bitmap;
+	uint32_t		sl_bitmap[TLSF_FL_COUNT];
+	struct tlsf_block	*blocks[TLSF_FL_COUNT][TLSF_SL_COUNT];
+};
+
+struct tlsf_stats {
+	uint32_t		free;
+	uint32_t		largest;
+	uint32_t		nfree;		/* Free blocks */
+};
+
+void tlsf_init(struct tlsf *t);
+int tlsf_add_region(struct tlsf *t, void *base, uint32_t size);
+void *tlsf_malloc(struct tlsf *t, uint32_t size);
+void tlsf_free(struct tlsf *t, void *ptr);
+uint32_t tlsf_usable_size(void *ptr);
+void tlsf_get_stats(struct tlsf *t, struct tlsf_stats *s);
+
+#endif /* !_SRC_TLSF_H_ */
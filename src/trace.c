@@ -0,0 +1,113 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+
+#include "clock.h"
+#include "metrics.h"
+#include "trace.h"
+
+/*
+ * The records are dumped oldest first, with tracing paused so that
+ * they are not overwritten while printing. The timestamps are the
+ * 32-bit cycle counter, the decoder unwraps them.
+ */
+
+#define	TRACE_BENCH_N		64
+
+#ifdef TRACE
+struct trace_rec trace_buf[TRACE_NRECS];
+uint32_t trace_head;
+int trace_on;
+
+static uint32_t trace_event_cycles;
+
+static const struct metric trace_metrics[] = {
+	METRIC_U32("events", &trace_head),
+	METRIC_U32("event_cycles", &trace_event_cycles),
+};
+
+static struct metrics_group trace_group = {
+	.name = "trace",
+	.metrics = trace_metrics,
+	.nmetrics = nitems(trace_metrics),
+};
+
+void
+trace_dump(void)
+{
+	struct trace_rec *r;
+	uint32_t head;
+	uint32_t i, n;
+
+	critical_enter();
+	trace_on = 0;
+	head = trace_head;
+	critical_exit();
+
+	n = head < TRACE_NRECS ? head : TRACE_NRECS;
+	for (i = head - n; i != head; i++) {
+		r = &trace_buf[i & (TRACE_NRECS - 1)];
+		printf("#T %08x %08x %08x %08x\n", r->cycles, r->thread,
+		    r->what, r->arg);
+	}
+	printf("#T end\n");
+
+	trace_on = 1;
+}
+
+void
+trace_init(void)
+{
+	uint32_t t0;
+	int i;
+
+	/* The cost of a trace point, the first records are dropped. */
+	trace_on = 1;
+	t0 = clock_cycles();
+	for (i = 0; i < TRACE_BENCH_N; i++)
+		trace_event(TRACE_RUN, 0);
+	trace_event_cycles = (clock_cycles() - t0) / TRACE_BENCH_N;
+	trace_head = 0;
+
+	metrics_register(&trace_group);
+}
+#else
+void
+trace_dump(void)
+{
+
+	printf("%s: define TRACE in src/trace.h\n", __func__);
+}
+
+void
+trace_init(void)
+{
+
+}
+#endif
@@ -0,0 +1,119 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_TRACE_H_
+#define	_SRC_TRACE_H_
+
+/*
+ * Event tracer.
+ *
+ * A trace point stores a record of four words, the cycle counter, the
+ * name of the current thread (0 in interrupts), the event and phase,
+ * and one argument, into a RAM ring that keeps the latest
+ * TRACE_NRECS records. The "trace" shell command prints them as "#T"
+ * lines of hex words, which tools/tracedecode.py turns into a Chrome
+ * trace (JSON) for Perfetto or chrome://tracing.
+ *
+ * The trace points compile to nothing unless TRACE is defined.
+ * Include clock.h and sys/thread.h before.
+ */
+
+#define	TRACE
+#undef	TRACE
+
+#define	TRACE_NRECS	256		/* Power of two */
+
+/* Events, keep in sync with tools/tracedecode.py. */
+#define	TRACE_RUN	1	/* Thread busy, arg: cpu_acct name */
+#define	TRACE_WORK	2	/* Work item, arg: work name */
+#define	TRACE_INTR	3	/* Interrupt handler, arg: irq */
+#define	TRACE_SEND	4	/* nrf_send(), arg: len, then result */
+#define	TRACE_RECV	5	/* nrf_recv(), arg: len, then result */
+#define	TRACE_POLL	6	/* nrf_poll(), arg: timeout, then result */
+#define	TRACE_HANDSHAKE	7	/* Handshake step, arg: state, then result */
+#define	TRACE_MQTT_TX	8	/* MQTT packet out, arg: type << 16 | len */
+#define	TRACE_MQTT_RX	9	/* MQTT read, arg: first byte << 16 | len */
+#define	TRACE_I2C	10	/* mc6470 sample read */
+
+#define	TRACE_PH_BEGIN	0
+#define	TRACE_PH_END	1
+#define	TRACE_PH_EVENT	2
+
+#define	TRACE_WHAT(ev, ph)	((ev) << 8 | (ph))
+
+struct trace_rec {
+	uint32_t	cycles;
+	uint32_t	thread;
+	uint32_t	what;
+	uint32_t	arg;
+};
+
+void trace_init(void);
+void trace_dump(void);
+
+#ifdef TRACE
+extern struct trace_rec trace_buf[TRACE_NRECS];
+extern uint32_t trace_head;
+extern int trace_on;
+
+static inline void
+trace_write(uint32_t what, const char *thread, uint32_t arg)
+{
+	struct trace_rec *r;
+
+	critical_enter();
+	if (trace_on) {
+		r = &trace_buf[trace_head++ & (TRACE_NRECS - 1)];
+		r->cycles = clock_cycles();
+		r->thread = (uint32_t)(uintptr_t)thread;
+		r->what = what;
+		r->arg = arg;
+	}
+	critical_exit();
+}
+
+#define	trace_begin(ev, arg)						\
+	trace_write(TRACE_WHAT(ev, TRACE_PH_BEGIN), curthread->td_name,	\
+	    (uint32_t)(uintptr_t)(arg))
+#define	trace_end(ev, arg)						\
+	trace_write(TRACE_WHAT(ev, TRACE_PH_END), curthread->td_name,	\
+	    (uint32_t)(uintptr_t)(arg))
+#define	trace_event(ev, arg)						\
+	trace_write(TRACE_WHAT(ev, TRACE_PH_EVENT), curthread->td_name,	\
+	    (uint32_t)(uintptr_t)(arg))
+#define	trace_intr_enter(irq)						\
+	trace_write(TRACE_WHAT(TRACE_INTR, TRACE_PH_BEGIN), NULL, (irq))
+#define	trace_intr_exit(irq)						\
+	trace_write(TRACE_WHAT(TRACE_INTR, TRACE_PH_END), NULL, (irq))
+#else
+#define	trace_begin(ev, arg)	do { } while (0)
+#define	trace_end(ev, arg)	do { } while (0)
+#define	trace_event(ev, arg)	do { } while (0)
+#define	trace_intr_enter(irq)	do { } while (0)
+#define	trace_intr_exit(irq)	do { } while (0)
+#endif
+
+#endif /* !_SRC_TRACE_H_ */
@@ -0,0 +1,294 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/thread.h>
+#include <sys/sem.h>
+
+#include "board.h"
+#include "clock.h"
+#include "cpu.h"
+#include "metrics.h"
+#include "stack.h"
+#include "trace.h"
+#include "workq.h"
+
+/*
+ * Work queue.
+ *
+ * The items are kept on a list per priority. The worker runs every
+ * due item, the high priority ones first, and then sleeps until the
+ * earliest due + slack of the pending items. An item that becomes
+ * due within that window is run on the same wakeup, so the periodic
+ * items with a slack are merged into a few wakeups.
+ *
+ * work_post() may be called from the interrupt context.
+ */
+
+#define	WORKQ_STACK_SIZE	4096
+
+static struct entry workq[WORK_NPRIO];
+static mdx_sem_t workq_sem;
+static struct cpu_acct workq_acct = { .name = "workq" };
+
+static uint32_t workq_runs;
+static uint32_t workq_wakeups;
+static uint32_t workq_coalesced;
+static uint32_t workq_skipped;
+static uint32_t workq_late_max;
+
+static const struct metric workq_metrics[] = {
+	METRIC_U32("runs", &workq_runs),
+	METRIC_U32("wakeups", &workq_wakeups),
+	METRIC_U32("coalesced", &workq_coalesced),
+	METRIC_U32("skipped", &workq_skipped),
+	METRIC_U32("late_max_ms", &workq_late_max),
+};
+
+static struct metrics_group workq_group = {
+	.name = "workq",
+	.metrics = workq_metrics,
+	.nmetrics = nitems(workq_metrics),
+};
+
+/*
+ * Find the item to run at the time now. If nothing is due, return
+ * NULL and the number of ms to sleep in wait, or -1 if the queue is
+ * empty. Called in a critical section.
+ */
+static struct work *
+workq_next(uint32_t now, int32_t *wait)
+{
+	struct work *best;
+	struct work *w;
+	struct entry *e;
+	int32_t d;
+	int i;
+
+	*wait = -1;
+
+	for (i = 0; i < WORK_NPRIO; i++) {
+		best = NULL;
+		for (e = workq[i].next; e != &workq[i]; e = e->next) {
+			w = CONTAINER_OF(e, struct work, node);
+			d = (int32_t)(w->due - now);
+			if (d <= 0) {
+				if (best == NULL ||
+				    (int32_t)(w->due - best->due) < 0)
+					best = w;
+				continue;
+			}
+			d += w->slack;
+			if (*wait < 0 || d < *wait)
+				*wait = d;
+		}
+		if (best != NULL)
+			return (best);
+	}
+
+	return (NULL);
+}
+
+static void
+workq_insert(struct work *w, uint32_t due)
+{
+
+	if (w->pending)
+		list_remove(&w->node);
+	w->due = due;
+	w->pending = 1;
+	list_append(&workq[w->prio], &w->node);
+}
+
+static void
+workq_thread(void *arg)
+{
+	struct work *w;
+	uint32_t late;
+	uint32_t now;
+	int32_t wait;
+	int ran;
+
+	ran = 0;
+
+	while (1) {
+		now = clock_ms();
+
+		critical_enter();
+		w = workq_next(now, &wait);
+		if (w != NULL) {
+			late = now - w->due;
+			list_remove(&w->node);
+			w->pending = 0;
+
+			/*
+			 * Requeue a periodic item before running it, so
+			 * the handler can cancel or reschedule it. The
+			 * periods missed are dropped, not run back to back.
+			 */
+			if (w->period != 0) {
+				if (late >= w->period) {
+					workq_skipped += late / w->period;
+					workq_insert(w, now + w->period);
+				} else
+					workq_insert(w, w->due + w->period);
+			}
+		}
+		critical_exit();
+
+		if (w == NULL) {
+			if (ran > 1)
+				workq_coalesced += ran - 1;
+			ran = 0;
+
+			if (wait < 0)
+				mdx_sem_wait(&workq_sem);
+			else
+				mdx_sem_timedwait(&workq_sem, wait * 1000);
+			workq_wakeups++;
+			continue;
+		}
+
+		if (late > workq_late_max)
+			workq_late_max = late;
+		workq_runs++;
+		ran++;
+
+		cpu_acct_enter(&workq_acct);
+		trace_begin(TRACE_WORK, w->name);
+		w->fn(w);
+		trace_end(TRACE_WORK, w->name);
+		cpu_acct_exit(&workq_acct);
+	}
+}
+
+void
+work_init(struct work *w, const char *name, int prio,
+    void (*fn)(struct work *w), void *arg)
+{
+
+	w->fn = fn;
+	w->arg = arg;
+	w->name = name;
+	w->prio = prio;
+	w->due = 0;
+	w->period = 0;
+	w->slack = 0;
+	w->pending = 0;
+}
+
+/*
+ * Run the item as soon as possible. Posting an item that is already
+ * due does nothing, so a burst of interrupts is handled by one run.
+ */
+void
+work_post(struct work *w)
+{
+	uint32_t now;
+
+	now = clock_ms();
+
+	critical_enter();
+	if (w->pending && (int32_t)(w->due - now) <= 0) {
+		critical_exit();
+		return;
+	}
+	workq_insert(w, now);
+	critical_exit();
+
+	mdx_sem_post(&workq_sem);
+}
+
+/*
+ * Run the item once after delay ms. It may be deferred by up to
+ * slack ms to share a wakeup with the other items.
+ */
+void
+work_schedule(struct work *w, uint32_t delay, uint32_t slack)
+{
+	uint32_t now;
+
+	now = clock_ms();
+
+	critical_enter();
+	w->period = 0;
+	w->slack = slack;
+	workq_insert(w, now + delay);
+	critical_exit();
+
+	mdx_sem_post(&workq_sem);
+}
+
+void
+work_periodic(struct work *w, uint32_t period, uint32_t slack)
+{
+	uint32_t now;
+
+	now = clock_ms();
+
+	critical_enter();
+	w->period = period;
+	w->slack = slack;
+	workq_insert(w, now + period);
+	critical_exit();
+
+	mdx_sem_post(&workq_sem);
+}
+
+void
+work_cancel(struct work *w)
+{
+
+	critical_enter();
+	if (w->pending) {
+		list_remove(&w->node);
+		w->pending = 0;
+	}
+	w->period = 0;
+	critical_exit();
+}
+
+void
+workq_init(void)
+{
+	struct thread *td;
+	int i;
+
+	for (i = 0; i < WORK_NPRIO; i++)
+		list_init(&workq[i]);
+	mdx_sem_init(&workq_sem, 0);
+	cpu_acct_register(&workq_acct);
+
+	td = mdx_thread_create("workq", PRIO_NORMAL, 0, WORKQ_STACK_SIZE,
+	    workq_thread, NULL);
+	if (td == NULL)
+		panic("failed to create workq thread\n");
+	stack_watch(td);
+	mdx_sched_add(td);
+
+	metrics_register(&workq_group);
+}
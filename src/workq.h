@@ -0,0 +1,62 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SRC_WORKQ_H_
+#define	_SRC_WORKQ_H_
+
+/*
+ * Shared work queue for the periodic and event driven firmware tasks.
+ *
+ * All the work items run on the single "workq" thread, so a handler
+ * must not block for long: blocking AT commands are fine, waiting for
+ * the network is not.
+ */
+
+#define	WORK_PRIO_HIGH		0
+#define	WORK_PRIO_LOW		1
+#define	WORK_NPRIO		2
+
+struct work {
+	void		(*fn)(struct work *w);
+	void		*arg;
+	const char	*name;
+	int		prio;
+	uint32_t	due;		/* clock_ms() */
+	uint32_t	period;		/* ms, 0 for a one-shot item */
+	uint32_t	slack;		/* ms the item may be deferred by */
+	int		pending;
+	struct entry	node;
+};
+
+void workq_init(void);
+void work_init(struct work *w, const char *name, int prio,
+    void (*fn)(struct work *w), void *arg);
+void work_post(struct work *w);
+void work_schedule(struct work *w, uint32_t delay, uint32_t slack);
+void work_periodic(struct work *w, uint32_t period, uint32_t slack);
+void work_cancel(struct work *w);
+
+#endif /* !_SRC_WORKQ_H_ */
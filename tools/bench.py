@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""
+Cycle counts of the benchmark suite (bench_suite() in src/bench.c).
+
+Usage: bench.py [-o out.json] [-c baseline.json] [-t percent] file.elf
+       bench.py [-o out.json] [-c baseline.json] [-t percent] -l console.log
+
+The ELF is the QEMU image built by "make bench" and is run on the
+mps2-an505 machine with -icount, so the counts are deterministic. The
+"#B" lines can also be taken from a console log of the board with -l.
+
+With -o the results are written as JSON, to be used as a baseline.
+With -c they are compared with a baseline and the exit status is 1 if
+the average of a benchmark went up by more than the threshold given
+with -t (2 percent by default).
+"""
+
+import json
+import subprocess
+import sys
+
+QEMU = ["qemu-system-arm", "-M", "mps2-an505", "-nographic",
+        "-semihosting-config", "enable=on,target=native",
+        "-icount", "shift=6"]
+TIMEOUT = 600
+THRESHOLD = 2.0
+
+
+def run(elf):
+    """Run the image in QEMU and return its console output."""
+    proc = subprocess.run(QEMU + ["-kernel", elf], stdout=subprocess.PIPE,
+                          stdin=subprocess.DEVNULL, timeout=TIMEOUT)
+    if proc.returncode != 0:
+        sys.exit("qemu exited with status %d" % proc.returncode)
+    return proc.stdout.decode("ascii", "replace")
+
+
+def parse(text):
+    """Collect the "#B name runs min avg max" lines."""
+    results = {}
+    done = False
+    for line in text.splitlines():
+        words = line.split()
+        if not words or words[0] != "#B":
+            continue
+        if words[1:] == ["end"]:
+            done = True
+            break
+        if len(words) == 3 and words[2] == "failed":
+            print("%s: failed" % words[1], file=sys.stderr)
+            continue
+        if len(words) != 6:
+            continue
+        runs, lo, avg, hi = [int(w) for w in words[2:]]
+        results[words[1]] = {"runs": runs, "min": lo, "avg": avg,
+                             "max": hi}
+    if not done:
+        sys.exit("incomplete output, no \"#B end\" line")
+    return results
+
+
+def report(results):
+    print("%-12s %6s %12s %12s %12s" % ("bench", "runs", "min", "avg",
+                                        "max"))
+    for name, r in results.items():
+        print("%-12s %6d %12d %12d %12d" % (name, r["runs"], r["min"],
+                                            r["avg"], r["max"]))
+
+
+def compare(results, baseline, threshold):
+    """Return the number of benchmarks slower than the baseline."""
+    regressions = 0
+    print("%-12s %12s %12s %8s" % ("bench", "baseline", "avg", "delta"))
+    for name, base in baseline.items():
+        if name not in results:
+            print("%-12s %12d %12s" % (name, base["avg"], "missing"))
+            regressions += 1
+            continue
+        avg = results[name]["avg"]
+        delta = 100.0 * (avg - base["avg"]) / max(base["avg"], 1)
+        mark = ""
+        if delta > threshold:
+            mark = " regression"
+            regressions += 1
+        print("%-12s %12d %12d %+7.2f%%%s" % (name, base["avg"], avg,
+                                              delta, mark))
+    return regressions
+
+
+def main():
+    args = sys.argv[1:]
+    out = None
+    baseline = None
+    threshold = THRESHOLD
+    log = None
+    while len(args) > 1 and args[0] in ("-o", "-c", "-t", "-l"):
+        opt, val = args[:2]
+        args = args[2:]
+        if opt == "-o":
+            out = val
+        elif opt == "-c":
+            baseline = val
+        elif opt == "-t":
+            threshold = float(val)
+        else:
+            log = val
+    if len(args) != (1 if log is None else 0):
+        sys.exit("usage: bench.py [-o out.json] [-c baseline.json] "
+                 "[-t percent] file.elf | -l console.log")
+
+    if log is not None:
+        with open(log) as f:
+            text = f.read()
+    else:
+        text = run(args[0])
+
+    results = parse(text)
+    report(results)
+
+    if out is not None:
+        with open(out, "w") as f:
+            json.dump(results, f, indent=1, sort_keys=True)
+            f.write("\n")
+
+    if baseline is not None:
+        with open(baseline) as f:
+            base = json.load(f)
+        print()
+        if compare(results, base, threshold):
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,401 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""
+Generate the static device table src/devtab.c from the device tree.
+
+Usage: dts2c.py obj/md009.dts > src/devtab.c
+
+The input is md009.dts after cpp, see the devtab target in the Makefile.
+Every enabled node with a compatible string listed in DRIVERS gets a
+statically allocated softc and mdx_device, and devtab_attach() calls the
+driver init routine with the base address and the properties it needs,
+so the board comes up without parsing the DTB or allocating from the
+heap. The interrupt controller is attached first.
+"""
+
+import re
+import sys
+
+# compatible: (driver name, softc, init call, interrupt handler or None)
+# In the init call {dev} is the device, {base} the translated first reg
+# address and {prop} the first cell of a property.
+DRIVERS = {
+    "arm,v8m-nvic": (
+        "nvic", "struct arm_nvic_softc",
+        ["arm_nvic_init({dev}, {base})"], None),
+    "nordic,nrf91-flash-controller": (
+        "nrf_nvmc", "struct nrf_nvmc_softc",
+        ["nrf_nvmc_init({dev}, {base})"], None),
+    "nordic,nrf-gpio": (
+        "nrf_gpio", "struct nrf_gpio_softc",
+        ["nrf_gpio_init({dev}, {base})"], None),
+    "nordic,nrf-gpiote": (
+        "nrf_gpiote", "struct nrf_gpiote_softc",
+        ["nrf_gpiote_init({dev}, {base})"], "nrf_gpiote_intr"),
+    "nordic,nrf-timer": (
+        "nrf_timer", "struct nrf_timer_softc",
+        ["nrf_timer_init({dev}, {base}, 1000000)"], "nrf_timer_intr"),
+    "nordic,nrf-twim": (
+        "nrf_twim", "struct nrf_twim_softc",
+        ["nrf_twim_init({dev}, {base}, {sda-pin}, {scl-pin})"],
+        "nrf_twim_intr"),
+    "nordic,nrf-uarte": (
+        "nrf_uarte", "struct nrf_uarte_softc",
+        ["nrf_uarte_init({dev}, {base}, {tx-pin}, {rx-pin})",
+         "mdx_uart_setup({dev}, {current-speed}, UART_DATABITS_8,\n"
+         "\t    UART_STOPBITS_1, UART_PARITY_NONE)"],
+        "nrf_uarte_intr"),
+}
+
+INTC = "nvic"
+
+HEADER = """\
+/*
+ * Generated by tools/dts2c.py from md009.dts, do not edit.
+ * Regenerate with 'make devtab' after changing the device tree.
+ */
+
+#include <sys/cdefs.h>
+#include <sys/systm.h>
+#include <sys/console.h>
+
+#include <arm/arm/nvic.h>
+#include <arm/nordicsemi/nrf9160.h>
+
+#include <dev/intc/intc.h>
+#include <dev/uart/uart.h>
+
+#include "board.h"
+
+#ifdef BOARD_DEVTAB
+
+#include "devtab.h"
+"""
+
+TOKEN = re.compile(r"""
+    (?P<space>\s+|//[^\n]*|/\*.*?\*/|^\#[^\n]*) |
+    (?P<string>"(?:[^"\\]|\\.)*") |
+    (?P<cells><[^>]*>) |
+    (?P<bytes>\[[^\]]*\]) |
+    (?P<ref>&[A-Za-z_][\w]*) |
+    (?P<directive>/[a-z0-9-]+/) |
+    (?P<punct>[{};=,/]) |
+    (?P<label>[A-Za-z_][\w]*:(?![\w])) |
+    (?P<name>[\w,.+\-@#?]+)
+""", re.X | re.S | re.M)
+
+
+class Node:
+    def __init__(self, name, parent):
+        self.name = name
+        self.parent = parent
+        self.props = {}
+        self.children = []
+
+    def child(self, name):
+        for c in self.children:
+            if c.name == name:
+                return c
+        c = Node(name, self)
+        self.children.append(c)
+        return c
+
+    def path(self):
+        if self.parent is None:
+            return "/"
+        return self.parent.path().rstrip("/") + "/" + self.name
+
+
+def tokenize(text):
+    pos = 0
+    while pos < len(text):
+        m = TOKEN.match(text, pos)
+        if m is None:
+            raise SyntaxError("unexpected input at %r" % text[pos:pos + 20])
+        pos = m.end()
+        if m.lastgroup != "space":
+            yield m.lastgroup, m.group()
+
+
+def cell(tok):
+    if tok.startswith("&"):
+        return tok
+    # cpp leaves the binding macros as arithmetic, e.g. (1 << 2)
+    if not re.fullmatch(r"[\s\dA-Fa-fxX()+\-*/<>|&~]+", tok):
+        raise SyntaxError("bad cell %r" % tok)
+    return eval(tok.replace("/", "//"), {}, {})
+
+
+def cells(tok):
+    body = tok[1:-1]
+    out = []
+    depth = 0
+    cur = ""
+    for ch in body:
+        if ch == "(":
+            depth += 1
+        elif ch == ")":
+            depth -= 1
+        if ch.isspace() and depth == 0:
+            if cur:
+                out.append(cell(cur))
+            cur = ""
+        else:
+            cur += ch
+    if cur:
+        out.append(cell(cur))
+    return out
+
+
+class Parser:
+    def __init__(self, text):
+        self.toks = list(tokenize(text))
+        self.pos = 0
+        self.root = Node("", None)
+        self.labels = {}
+
+    def next(self):
+        tok = self.toks[self.pos]
+        self.pos += 1
+        return tok
+
+    def peek(self):
+        return self.toks[self.pos]
+
+    def expect(self, value):
+        kind, tok = self.next()
+        if tok != value:
+            raise SyntaxError("expected %r, got %r" % (value, tok))
+
+    def parse(self):
+        while self.pos < len(self.toks):
+            kind, tok = self.next()
+            if kind == "directive":
+                # /dts-v1/; /plugin/; /memreserve/ <a> <b>;
+                while self.next()[1] != ";":
+                    pass
+            elif tok == "/":
+                self.body(self.root)
+            elif kind == "ref":
+                self.body(self.labels[tok[1:]])
+            elif kind == "label":
+                self.next()
+                self.body(self.root)
+            else:
+                raise SyntaxError("unexpected %r" % tok)
+        return self.root
+
+    def body(self, node):
+        self.expect("{")
+        while self.peek()[1] != "}":
+            labels = []
+            while self.peek()[0] == "label":
+                labels.append(self.next()[1][:-1])
+            kind, name = self.next()
+            if kind == "directive":
+                # /delete-node/ and /delete-property/
+                target = self.next()[1]
+                self.expect(";")
+                if name == "/delete-node/":
+                    node.children = [c for c in node.children
+                                     if c.name != target]
+                else:
+                    node.props.pop(target, None)
+                continue
+            kind, tok = self.peek()
+            if tok == "{":
+                child = node.child(name)
+                for label in labels:
+                    self.labels[label] = child
+                self.body(child)
+            elif tok == "=":
+                self.next()
+                node.props[name] = self.value()
+            else:
+                self.expect(";")
+                node.props[name] = []
+        self.expect("}")
+        self.expect(";")
+
+    def value(self):
+        out = []
+        while True:
+            kind, tok = self.next()
+            if kind == "string":
+                out.append(tok[1:-1])
+            elif kind == "cells":
+                out.extend(cells(tok))
+            elif kind == "ref":
+                out.append(tok)
+            elif kind != "bytes":
+                raise SyntaxError("bad value %r" % tok)
+            kind, tok = self.next()
+            if tok == ";":
+                return out
+            if tok != ",":
+                raise SyntaxError("expected , or ;, got %r" % tok)
+
+
+def ncells(node, prop, default):
+    if node is None:
+        return default
+    return node.props.get(prop, [default])[0]
+
+
+def translate(node, addr):
+    """Translate a bus address through the ranges of the parents."""
+    bus = node.parent
+    while bus is not None and bus.parent is not None:
+        ranges = bus.props.get("ranges")
+        if ranges:
+            ac = ncells(bus, "#address-cells", 2)
+            pac = ncells(bus.parent, "#address-cells", 2)
+            sc = ncells(bus, "#size-cells", 1)
+            step = ac + pac + sc
+            for i in range(0, len(ranges), step):
+                child = ranges[i + ac - 1]
+                parent = ranges[i + ac + pac - 1]
+                size = ranges[i + step - 1]
+                if child <= addr < child + size:
+                    addr = addr - child + parent
+                    break
+        bus = bus.parent
+    return addr
+
+
+def enabled(node):
+    status = node.props.get("status", ["okay"])[0]
+    return status in ("okay", "ok")
+
+
+def devices(root):
+    out = []
+
+    def walk(node):
+        if not enabled(node):
+            return
+        for compat in node.props.get("compatible", []):
+            if compat in DRIVERS:
+                out.append((node, compat))
+                break
+        for c in node.children:
+            walk(c)
+
+    walk(root)
+    # The interrupt controller first, then in the tree order.
+    out.sort(key=lambda d: DRIVERS[d[1]][0] != INTC)
+    return out
+
+
+def ident(node):
+    name = node.name.split("@")[0]
+    return re.sub(r"\W", "_", name)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit("usage: dts2c.py obj/md009.dts")
+
+    with open(sys.argv[1]) as f:
+        parser = Parser(f.read())
+    root = parser.parse()
+
+    devs = devices(root)
+    units = {}
+    entries = []
+    for node, compat in devs:
+        drv, softc, init, intr = DRIVERS[compat]
+        unit = units.get(drv, 0)
+        units[drv] = unit + 1
+        var = "%s%d" % (drv, unit)
+        base = 0
+        if "reg" in node.props:
+            base = translate(node, node.props["reg"][
+                ncells(node.parent, "#address-cells", 2) - 1])
+        args = {"dev": "&%s_dev" % var, "base": "0x%08x" % base}
+        for key, val in node.props.items():
+            if val and isinstance(val[0], int):
+                args[key] = "%d" % val[0]
+        calls = []
+        for call in init:
+            try:
+                calls.append(re.sub(r"\{([\w#,-]+)\}",
+                                    lambda m: args[m.group(1)], call))
+            except KeyError as e:
+                sys.exit("%s: missing property %s" % (node.path(), e))
+        irq = None
+        if intr and "interrupts" in node.props:
+            irq = node.props["interrupts"][0]
+        entries.append((node, drv, unit, var, softc, calls, intr, irq))
+
+    console = None
+    chosen = root.child("chosen")
+    ref = chosen.props.get("mdepx,console", [None])[0]
+    if ref is not None:
+        console = parser.labels[ref[1:]]
+
+    print(HEADER)
+    for node, drv, unit, var, softc, calls, intr, irq in entries:
+        print("/* %s */" % node.path())
+        print("static %s %s_sc;" % (softc, var))
+        print("static struct mdx_device %s_dev = { .sc = &%s_sc };" %
+              (var, var))
+        print()
+
+    print("const struct devtab_entry devtab[] = {")
+    for node, drv, unit, var, softc, calls, intr, irq in entries:
+        print("\t{ \"%s\", %d, &%s_dev }," % (drv, unit, var))
+    print("};")
+    print()
+    print("const int devtab_ndevs = nitems(devtab);")
+    print()
+    print("void\ndevtab_attach(void)\n{")
+    print()
+    intc = None
+    for i, (node, drv, unit, var, softc, calls, intr, irq) in \
+            enumerate(entries):
+        if i > 0:
+            print()
+        for call in calls:
+            print("\t%s;" % call)
+        if drv == INTC and intc is None:
+            intc = "&%s_dev" % var
+        if irq is not None:
+            if intc is None:
+                sys.exit("%s: no interrupt controller" % node.path())
+            print("\tmdx_intc_setup(%s, %d, %s, &%s_dev);" %
+                  (intc, irq, intr, var))
+            print("\tmdx_intc_enable(%s, %d);" % (intc, irq))
+        if node is console:
+            print("\tmdx_console_register_uart(&%s_dev);" % var)
+    print("}")
+    print()
+    print("#endif /* BOARD_DEVTAB */")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,444 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""
+Flash and RAM footprint of the image per module and per mbedTLS feature.
+
+Usage: footprint.py [-m obj/md009.map] obj/md009.elf
+       footprint.py -b full tls12 min
+
+The .text, .rodata, .data and .bss contributions are attributed to the
+objects that provide them, from the linker map when given with -m, or
+else from the objects and archives under obj/. The objects are linked
+whole, as there is no --gc-sections, and an archive member only if the
+image has one of its symbols. The total is checked against the section
+headers of the ELF.
+
+With -b each mbedTLS configuration profile (see src/mbedtls_config.h)
+is built from clean in turn and the totals are compared with the first
+one.
+"""
+
+import os
+import re
+import struct
+import subprocess
+import sys
+
+OBJDIR = "obj"
+ELF = "obj/md009.elf"
+CONF = "mdepx.conf"
+EMITTER = "mdepx/tools/emitter.py"
+
+KINDS = ("text", "rodata", "data", "bss")
+
+# mbedTLS library objects grouped by feature.
+FEATURES = {
+    "TLS": ("ssl_tls", "ssl_cli", "ssl_msg", "ssl_ciphersuites",
+            "ssl_srv", "ssl_cache"),
+    "DTLS": ("ssl_cookie",),
+    "session tickets": ("ssl_ticket",),
+    "X.509": ("x509", "x509_crt", "x509_create", "x509write_crt"),
+    "X.509 CRL/CSR": ("x509_crl", "x509_csr", "x509write_csr"),
+    "PK": ("pk", "pk_wrap", "pkparse", "pkwrite"),
+    "PEM/ASN.1": ("pem", "base64", "asn1parse", "asn1write", "oid"),
+    "RSA": ("rsa", "rsa_internal"),
+    "bignum": ("bignum",),
+    "ECP": ("ecp",),
+    "ECP curves": ("ecp_curves",),
+    "ECDH/ECDSA": ("ecdh", "ecdsa"),
+    "DHM": ("dhm",),
+    "AES": ("aes", "aesni"),
+    "GCM": ("gcm",),
+    "CCM": ("ccm",),
+    "ChaCha20/Poly1305": ("chacha20", "chachapoly", "poly1305"),
+    "DES": ("des",),
+    "ARC4": ("arc4",),
+    "cipher": ("cipher", "cipher_wrap"),
+    "SHA-1": ("sha1",),
+    "SHA-256": ("sha256",),
+    "SHA-512": ("sha512",),
+    "MD5": ("md5",),
+    "RIPEMD-160": ("ripemd160",),
+    "MD": ("md", "md_wrap", "hkdf"),
+    "PKCS#5/#12": ("pkcs5", "pkcs12"),
+    "DRBG": ("ctr_drbg", "hmac_drbg"),
+    "entropy": ("entropy", "entropy_poll"),
+    "debug": ("debug", "error", "version", "version_features"),
+    "test certs": ("certs",),
+}
+
+FEATURE_OF = {}
+for feature, objs in FEATURES.items():
+    for obj in objs:
+        FEATURE_OF[obj] = feature
+
+# Profile name: preprocessor flag, None for the default.
+PROFILES = {
+    "full": None,
+    "tls12": "-DMBEDTLS_PROFILE_TLS12",
+    "min": "-DMBEDTLS_PROFILE_MIN",
+}
+
+SHF_WRITE = 0x1
+SHF_ALLOC = 0x2
+SHF_EXECINSTR = 0x4
+SHT_SYMTAB = 2
+SHT_NOBITS = 8
+STB_LOCAL = 0
+SHN_UNDEF = 0
+
+
+def sections(data):
+    """(name, kind, size) of the allocated sections of an ELF32 file."""
+    if data[:4] != b"\x7fELF" or data[4] != 1:
+        return []
+    (shoff,) = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2e)
+    if shoff == 0:
+        return []
+    hdrs = [struct.unpack_from("<IIIIIIIIII", data, shoff + i * shentsize)
+            for i in range(shnum)]
+    stroff = hdrs[shstrndx][4]
+    out = []
+    for (name, type, flags, addr, off, size, _, _, _, _) in hdrs:
+        if not flags & SHF_ALLOC or size == 0:
+            continue
+        end = data.index(b"\0", stroff + name)
+        sname = data[stroff + name:end].decode("ascii", "replace")
+        if type == SHT_NOBITS:
+            kind = "bss"
+        elif flags & SHF_EXECINSTR:
+            kind = "text"
+        elif flags & SHF_WRITE:
+            kind = "data"
+        else:
+            kind = "rodata"
+        out.append((sname, kind, size))
+    return out
+
+
+def symbols(data):
+    """Names of the global symbols an ELF32 file defines."""
+    if data[:4] != b"\x7fELF" or data[4] != 1:
+        return set()
+    (shoff,) = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum = struct.unpack_from("<HH", data, 0x2e)
+    hdrs = [struct.unpack_from("<IIIIIIIIII", data, shoff + i * shentsize)
+            for i in range(shnum)]
+    out = set()
+    for (_, type, _, _, off, size, link, _, _, entsize) in hdrs:
+        if type != SHT_SYMTAB:
+            continue
+        stroff = hdrs[link][4]
+        for pos in range(off + entsize, off + size, entsize):
+            name, _, _, info, _, shndx = struct.unpack_from("<IIIBBH",
+                data, pos)
+            if info >> 4 == STB_LOCAL or shndx == SHN_UNDEF:
+                continue
+            end = data.index(b"\0", stroff + name)
+            out.add(data[stroff + name:end])
+    return out
+
+
+def members(data):
+    """(name, data) of the members of an ar archive."""
+    pos = 8
+    names = b""
+    while pos + 60 <= len(data):
+        hdr = data[pos:pos + 60]
+        name = hdr[:16].decode("ascii").strip()
+        size = int(hdr[48:58])
+        body = data[pos + 60:pos + 60 + size]
+        pos += 60 + size + (size & 1)
+        if name == "//":
+            names = body
+        elif name in ("/", "/SYM64/"):
+            continue
+        elif name.startswith("/"):
+            off = int(name[1:])
+            end = names.index(b"/\n", off)
+            yield names[off:end].decode("ascii"), body
+        else:
+            yield name.rstrip("/"), body
+
+
+def module(path):
+    """Attribute an object path to (module, mbedTLS feature or None)."""
+    path = path.replace("\\", "/")
+    if path.startswith(OBJDIR + "/"):
+        path = path[len(OBJDIR) + 1:]
+    member = None
+    m = re.match(r"(.*)\((.*)\)$", path)
+    if m:
+        path, member = m.groups()
+    base = os.path.splitext(os.path.basename(member or path))[0]
+    parts = path.split("/")
+    if "mbedtls" in parts:
+        return "mbedtls", FEATURE_OF.get(base, base)
+    if parts[0] == "src":
+        return "src/" + base, None
+    if parts[0] == "mdepx":
+        if parts[1] == "lib" and len(parts) > 3:
+            return "/".join(parts[:3]), None
+        return "/".join(parts[:2]), None
+    if path.endswith(".a"):
+        return os.path.basename(path), None
+    return "/".join(parts[:-1]) or base, None
+
+
+def from_objects(objdir, elf):
+    """{(module, feature): {kind: size}} from the objects and archives.
+
+    The archive members are counted only if the image has one of their
+    symbols, like the linker pulls them in.
+    """
+    out = {}
+
+    with open(elf, "rb") as fp:
+        image = symbols(fp.read())
+
+    def add(path, data, member=False):
+        if member and not symbols(data) & image:
+            return
+        mod = module(path)
+        acc = out.setdefault(mod, dict.fromkeys(KINDS, 0))
+        for name, kind, size in sections(data):
+            acc[kind] += size
+
+    for root, dirs, files in os.walk(objdir):
+        for f in sorted(files):
+            path = os.path.join(root, f)
+            if os.path.abspath(path) == os.path.abspath(elf):
+                continue
+            if f.endswith(".o"):
+                with open(path, "rb") as fp:
+                    add(path, fp.read())
+            elif f.endswith(".a"):
+                with open(path, "rb") as fp:
+                    data = fp.read()
+                for name, body in members(data):
+                    add("%s(%s)" % (path, name), body, True)
+
+    # The bsdlib and oberon archives are linked from nrfxlib directly.
+    for root, dirs, files in os.walk("nrfxlib"):
+        for f in sorted(files):
+            if not f.endswith(".a") or "hard-float" not in root:
+                continue
+            path = os.path.join(root, f)
+            with open(path, "rb") as fp:
+                data = fp.read()
+            for name, body in members(data):
+                add("%s(%s)" % (f, name), body, True)
+    return out
+
+
+MAP_INPUT = re.compile(
+    r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+
+
+def from_map(path):
+    """{(module, feature): {kind: size}} from a GNU ld map file."""
+    out = {}
+    insec = None
+    outsec = None
+    started = False
+    with open(path) as f:
+        for line in f:
+            line = line.rstrip("\n")
+            if line.startswith("Linker script and memory map"):
+                started = True
+                continue
+            if not started or not line:
+                continue
+            if not line[0].isspace():
+                outsec = line.split()[0]
+                continue
+            m = MAP_INPUT.match(line)
+            if m is None:
+                # A long input section name is on a line of its own.
+                words = line.split()
+                if len(words) == 1 and words[0].startswith("."):
+                    insec = words[0]
+                elif len(words) == 1 and words[0] == "COMMON":
+                    insec = "COMMON"
+                continue
+            name, addr, size, obj = m.groups()
+            name = name or insec
+            insec = None
+            size = int(size, 16)
+            if name is None or size == 0 or int(addr, 16) == 0:
+                continue
+            if obj.startswith("load address") or "=" in obj:
+                continue
+            if name.startswith(".text") or name.startswith(".ramfunc"):
+                kind = "text"
+            elif name.startswith(".rodata") or name.startswith(".ARM"):
+                kind = "rodata"
+            elif name.startswith(".bss") or name == "COMMON":
+                kind = "bss"
+            elif name.startswith(".data"):
+                kind = "data"
+            elif outsec in (".bss", ".heap", ".stack"):
+                kind = "bss"
+            else:
+                continue
+            mod = module(obj.strip())
+            acc = out.setdefault(mod, dict.fromkeys(KINDS, 0))
+            acc[kind] += size
+    return out
+
+
+def totals(sizes):
+    acc = dict.fromkeys(KINDS, 0)
+    for s in sizes:
+        for k in KINDS:
+            acc[k] += s[k]
+    return acc
+
+
+def flash(s):
+    return s["text"] + s["rodata"] + s["data"]
+
+
+def ram(s):
+    return s["data"] + s["bss"]
+
+
+def row(name, s):
+    return "%-28s %8d %8d %8d %8d %8d %8d" % (name, s["text"], s["rodata"],
+        s["data"], s["bss"], flash(s), ram(s))
+
+
+def header(title):
+    return "%-28s %8s %8s %8s %8s %8s %8s" % (title, "text", "rodata",
+        "data", "bss", "flash", "ram")
+
+
+def group(result, key):
+    out = {}
+    for (mod, feature), s in result.items():
+        k = key(mod, feature)
+        if k is None:
+            continue
+        acc = out.setdefault(k, dict.fromkeys(KINDS, 0))
+        for kind in KINDS:
+            acc[kind] += s[kind]
+    return out
+
+
+def report(result, elf):
+    mods = group(result, lambda mod, feature: mod)
+    print(header("module"))
+    for name, s in sorted(mods.items(), key=lambda i: -flash(i[1])):
+        print(row(name, s))
+    print(row("total", totals(mods.values())))
+
+    with open(elf, "rb") as f:
+        image = dict.fromkeys(KINDS, 0)
+        for name, kind, size in sections(f.read()):
+            image[kind] += size
+    print(row(elf, image))
+
+    feats = group(result,
+                  lambda mod, feature: feature if mod == "mbedtls" else None)
+    if feats:
+        print()
+        print(header("mbedtls feature"))
+        for name, s in sorted(feats.items(), key=lambda i: -flash(i[1])):
+            print(row(name, s))
+        print(row("total", totals(feats.values())))
+
+
+def build(flag):
+    """Build the image from clean with an extra compiler flag."""
+    subprocess.check_call(["make", "clean"])
+    conf = CONF
+    if flag is not None:
+        conf = "mdepx-footprint.conf"
+        with open(CONF) as f:
+            text = f.read()
+        # After the last set-build-flags statement.
+        pos = text.index(";", text.rindex("set-build-flags")) + 1
+        with open(conf, "w") as f:
+            f.write(text[:pos] + "\n\nset-build-flags %s;\n" % flag +
+                    text[pos:])
+    try:
+        subprocess.check_call(["python3", "-B", EMITTER, "-j", conf])
+    finally:
+        if conf != CONF:
+            os.unlink(conf)
+
+
+def compare(profiles):
+    results = []
+    for name in profiles:
+        if name not in PROFILES:
+            sys.exit("unknown profile %s, one of %s" %
+                     (name, ", ".join(PROFILES)))
+        build(PROFILES[name])
+        result = from_objects(OBJDIR, ELF)
+        tls = totals([s for (mod, feature), s in result.items()
+                      if mod == "mbedtls"])
+        with open(ELF, "rb") as f:
+            image = dict.fromkeys(KINDS, 0)
+            for sname, kind, size in sections(f.read()):
+                image[kind] += size
+        results.append((name, image, tls))
+
+    print("%-10s %8s %8s %8s %8s %8s %8s" % ("profile", "flash", "ram",
+        "tls flash", "tls ram", "d flash", "d ram"))
+    base = results[0][1]
+    for name, image, tls in results:
+        print("%-10s %8d %8d %9d %8d %+8d %+8d" % (name, flash(image),
+            ram(image), flash(tls), ram(tls), flash(image) - flash(base),
+            ram(image) - ram(base)))
+
+
+def main():
+    args = sys.argv[1:]
+    if args and args[0] == "-b":
+        if len(args) < 2:
+            sys.exit("usage: footprint.py -b profile...")
+        compare(args[1:])
+        return
+
+    mapfile = None
+    if len(args) == 3 and args[0] == "-m":
+        mapfile = args[1]
+        args = args[2:]
+    if len(args) != 1:
+        sys.exit("usage: footprint.py [-m file.map] file.elf")
+
+    if mapfile is not None:
+        result = from_map(mapfile)
+    else:
+        result = from_objects(OBJDIR, args[0])
+    report(result, args[0])
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,376 @@
+/*-
+ * Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Replay a heap trace against TLSF and a first-fit free list allocator
+ * modelled after mdepx fl, and compare the worst-case latency, the
+ * failures and the fragmentation.
+ *
+ * The trace is the "#H" lines printed by src/heap.c with HEAP_TRACE
+ * defined, e.g. captured over a few MQTT reconnects:
+ *
+ *   #H a 20031a48 16708
+ *   #H f 20031a48
+ *
+ * Build and run on the host:
+ *
+ *   cc -O2 -m32 -include stdint.h -include stddef.h -I src \
+ *       -o heapreplay tools/heapreplay.c src/tlsf.c
+ *   ./heapreplay < console.txt
+ *
+ * -m32 gives the same block headers as on the target; without it the
+ * headers are larger and the results are slightly pessimistic.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tlsf.h"
+
+#define	REGION0_SIZE	0x0c000		/* As in board_init() */
+#define	REGION1_SIZE	0x10000
+#define	MAX_LIVE	4096
+#define	FL_HDR		8
+
+struct live {
+	unsigned long	id;
+	void		*ptr;
+	uint32_t	size;
+};
+
+struct result {
+	const char	*name;
+	uint64_t	worst_ns;
+	uint64_t	total_ns;
+	uint32_t	ops;
+	uint32_t	fails;
+	uint32_t	peak;
+	uint32_t	peak_free;
+	uint32_t	peak_largest;
+	uint32_t	end_free;
+	uint32_t	end_largest;
+};
+
+struct allocator {
+	const char	*name;
+	void		(*init)(void);
+	void		*(*alloc)(uint32_t size);
+	void		(*free)(void *ptr);
+	void		(*stats)(uint32_t *free, uint32_t *largest);
+};
+
+/*
+ * First fit, address ordered free list with coalescing.
+ */
+
+struct fl_block {
+	uint32_t	size;		/* Payload */
+	struct fl_block	*next;		/* Free blocks only */
+};
+
+static struct fl_block *fl_head;
+static uint64_t region0[REGION0_SIZE / 8];
+static uint64_t region1[REGION1_SIZE / 8];
+
+static void
+fl_insert(struct fl_block *b)
+{
+	struct fl_block **pp, *n;
+
+	for (pp = &fl_head; *pp != NULL && *pp < b; pp = &(*pp)->next)
+		;
+	b->next = *pp;
+	*pp = b;
+
+	n = b->next;
+	if (n != NULL && (uint8_t *)b + FL_HDR + b->size == (uint8_t *)n) {
+		b->size += FL_HDR + n->size;
+		b->next = n->next;
+	}
+	if (pp != &fl_head) {
+		n = (struct fl_block *)((uint8_t *)pp -
+		    __builtin_offsetof(struct fl_block, next));
+		if ((uint8_t *)n + FL_HDR + n->size == (uint8_t *)b) {
+			n->size += FL_HDR + b->size;
+			n->next = b->next;
+		}
+	}
+}
+
+static void *
+fl_alloc(uint32_t size)
+{
+	struct fl_block **pp, *b, *rem;
+
+	size = (size + 7) & ~7;
+	for (pp = &fl_head; *pp != NULL; pp = &(*pp)->next) {
+		b = *pp;
+		if (b->size < size)
+			continue;
+		if (b->size - size >= FL_HDR + 16) {
+			rem = (struct fl_block *)((uint8_t *)b + FL_HDR + size);
+			rem->size = b->size - size - FL_HDR;
+			rem->next = b->next;
+			b->size = size;
+			*pp = rem;
+		} else
+			*pp = b->next;
+		return ((uint8_t *)b + FL_HDR);
+	}
+
+	return (NULL);
+}
+
+static void
+fl_free(void *ptr)
+{
+
+	fl_insert((struct fl_block *)((uint8_t *)ptr - FL_HDR));
+}
+
+static void
+fl_stats(uint32_t *free, uint32_t *largest)
+{
+	struct fl_block *b;
+
+	*free = 0;
+	*largest = 0;
+	for (b = fl_head; b != NULL; b = b->next) {
+		*free += b->size;
+		if (b->size > *largest)
+			*largest = b->size;
+	}
+}
+
+
+static void
+fl_setup(void)
+{
+	struct fl_block *b;
+
+	fl_head = NULL;
+	b = (struct fl_block *)region0;
+	b->size = REGION0_SIZE - FL_HDR;
+	fl_insert(b);
+	b = (struct fl_block *)region1;
+	b->size = REGION1_SIZE - FL_HDR;
+	fl_insert(b);
+}
+
+static struct tlsf tlsf;
+
+static void
+tlsf_setup(void)
+{
+
+	tlsf_init(&tlsf);
+	tlsf_add_region(&tlsf, region0, REGION0_SIZE);
+	tlsf_add_region(&tlsf, region1, REGION1_SIZE);
+}
+
+static void *
+tlsf_alloc1(uint32_t size)
+{
+
+	return (tlsf_malloc(&tlsf, size));
+}
+
+static void
+tlsf_free1(void *ptr)
+{
+
+	tlsf_free(&tlsf, ptr);
+}
+
+static void
+tlsf_stats1(uint32_t *free, uint32_t *largest)
+{
+	struct tlsf_stats s;
+
+	tlsf_get_stats(&tlsf, &s);
+	*free = s.free;
+	*largest = s.largest;
+}
+
+static const struct allocator allocators[] = {
+	{ "fl", fl_setup, fl_alloc, fl_free, fl_stats },
+	{ "tlsf", tlsf_setup, tlsf_alloc1, tlsf_free1, tlsf_stats1 },
+};
+
+struct op {
+	char		type;
+	unsigned long	id;
+	uint32_t	size;
+};
+
+static struct op *ops;
+static int nops;
+
+static void
+trace_read(FILE *fp)
+{
+	char line[256];
+	unsigned long id;
+	unsigned size;
+	char type;
+	int cap;
+
+	cap = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		size = 0;
+		if (sscanf(line, "#H %c %lx %u", &type, &id, &size) < 2)
+			continue;
+		if (type != 'a' && type != 'f')
+			continue;
+		if (nops == cap) {
+			cap = cap ? cap * 2 : 1024;
+			ops = realloc(ops, cap * sizeof(struct op));
+			if (ops == NULL)
+				exit(1);
+		}
+		ops[nops].type = type;
+		ops[nops].id = id;
+		ops[nops].size = size;
+		nops++;
+	}
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void
+replay(const struct allocator *a, struct result *r)
+{
+	static struct live live[MAX_LIVE];
+	uint64_t t0, dt;
+	uint32_t used;
+	void *ptr;
+	int nlive;
+	int i, j;
+
+	memset(r, 0, sizeof(*r));
+	r->name = a->name;
+
+	/* Fault the pages in, so they do not count as latency. */
+	memset(region0, 0, sizeof(region0));
+	memset(region1, 0, sizeof(region1));
+	a->init();
+
+	nlive = 0;
+	used = 0;
+
+	for (i = 0; i < nops; i++) {
+		if (ops[i].type == 'a') {
+			t0 = now_ns();
+			ptr = a->alloc(ops[i].size);
+			dt = now_ns() - t0;
+			if (ptr == NULL) {
+				r->fails++;
+				continue;
+			}
+			if (nlive == MAX_LIVE) {
+				fprintf(stderr, "too many live blocks\n");
+				exit(1);
+			}
+			live[nlive].id = ops[i].id;
+			live[nlive].ptr = ptr;
+			live[nlive].size = ops[i].size;
+			nlive++;
+			used += ops[i].size;
+			if (used > r->peak) {
+				r->peak = used;
+				a->stats(&r->peak_free, &r->peak_largest);
+			}
+		} else {
+			for (j = nlive - 1; j >= 0; j--)
+				if (live[j].id == ops[i].id)
+					break;
+			if (j < 0)
+				continue;	/* Allocated before the trace */
+			t0 = now_ns();
+			a->free(live[j].ptr);
+			dt = now_ns() - t0;
+			used -= live[j].size;
+			live[j] = live[--nlive];
+		}
+
+		r->ops++;
+		r->total_ns += dt;
+		if (dt > r->worst_ns)
+			r->worst_ns = dt;
+	}
+
+	a->stats(&r->end_free, &r->end_largest);
+}
+
+static uint32_t
+frag(uint32_t free, uint32_t largest)
+{
+
+	if (free == 0)
+		return (0);
+
+	return (1000 - (uint64_t)largest * 1000 / free);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct result r;
+	int i;
+
+	trace_read(stdin);
+	if (nops == 0) {
+		fprintf(stderr, "no #H records on stdin\n");
+		return (1);
+	}
+
+	printf("%d operations\n", nops);
+	printf("%-6s %8s %8s %6s %8s %10s %10s\n", "alloc", "worst_ns",
+	    "avg_ns", "fails", "peak", "frag_peak", "frag_end");
+
+	for (i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+		replay(&allocators[i], &r);
+		printf("%-6s %8llu %8llu %6u %8u %9u%% %9u%%\n", r.name,
+		    (unsigned long long)r.worst_ns,
+		    (unsigned long long)(r.ops ? r.total_ns / r.ops : 0),
+		    r.fails, r.peak,
+		    frag(r.peak_free, r.peak_largest) / 10,
+		    frag(r.end_free, r.end_largest) / 10);
+	}
+
+	return (0);
+}
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""
+Decode the binary log records printed by src/log.c with LOG_BINARY.
+
+Usage: logdecode.py obj/md009.elf < console.txt
+
+Lines of the form "#L <fmt> <meta> <ms> <args...>" are replaced with
+the formatted message, everything else is passed through. The format
+strings and %s arguments are read from the ELF image.
+"""
+
+import re
+import struct
+import sys
+
+LEVELS = "EWID"
+
+
+class Elf:
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1:
+            raise ValueError("not an ELF32 file")
+        (shoff,) = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2e)
+        self.sections = []
+        for i in range(shnum):
+            (name, type, flags, addr, off, size) = struct.unpack_from(
+                "<IIIIII", self.data, shoff + i * shentsize)
+            # SHT_PROGBITS with SHF_ALLOC
+            if type == 1 and flags & 0x2 and addr:
+                self.sections.append((addr, off, size))
+
+    def string(self, addr):
+        for (start, off, size) in self.sections:
+            if start <= addr < start + size:
+                pos = off + addr - start
+                end = self.data.index(b"\0", pos)
+                return self.data[pos:end].decode("ascii", "replace")
+        return "<0x%08x>" % addr
+
+
+SPEC = re.compile(r"%([-+ #0]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+def cformat(elf, fmt, args):
+    args = list(args)
+
+    def conv(m):
+        flags, width, prec, _, c = m.groups()
+        if c == "%":
+            return "%"
+        v = args.pop(0) if args else 0
+        spec = "%" + flags + width + ("." + prec if prec else "")
+        if c in "di":
+            if v & 0x80000000:
+                v -= 1 << 32
+            return (spec + "d") % v
+        if c == "s":
+            return (spec + "s") % elf.string(v)
+        if c == "c":
+            return (spec + "c") % chr(v & 0xff)
+        if c == "p":
+            return "0x%08x" % v
+        return (spec + c) % v
+
+    return SPEC.sub(conv, fmt)
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: %s file.elf < log\n" % sys.argv[0])
+        sys.exit(1)
+
+    elf = Elf(sys.argv[1])
+
+    for line in sys.stdin:
+        if not line.startswith("#L "):
+            sys.stdout.write(line)
+            continue
+        words = [int(w, 16) for w in line.split()[1:]]
+        if len(words) < 3:
+            sys.stdout.write(line)
+            continue
+        fmt, meta, ms = words[:3]
+        msg = cformat(elf, elf.string(fmt), words[3:])
+        sys.stdout.write("[%u.%03u] %s %s" % (ms // 1000, ms % 1000,
+            LEVELS[meta & 3], msg))
+
+
+if __name__ == "__main__":
+    main()
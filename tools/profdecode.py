@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""
+Symbolize a PC sampling profile dumped by src/prof.c.
+
+Usage: profdecode.py [-f folded.txt] obj/md009.elf < console.txt
+
+The "#P <pc> <thread> <count>" lines of the last dump are read from the
+console log and the PCs are looked up in the symbol table of the ELF
+image. A flat profile per function is printed. With -f the samples are
+also written as folded stacks, "thread;function count", for
+flamegraph.pl or speedscope. There is no stack unwinding, so the
+flame graph has the thread and the sampled function only.
+"""
+
+import bisect
+import struct
+import sys
+
+from logdecode import Elf
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+
+
+class Symbols:
+    def __init__(self, data):
+        (shoff,) = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x2e)
+        headers = [struct.unpack_from("<IIIIIIIIII", data,
+                                      shoff + i * shentsize)
+                   for i in range(shnum)]
+        funcs = []
+        for h in headers:
+            if h[1] != SHT_SYMTAB:
+                continue
+            strtab = headers[h[6]]
+            for off in range(h[4], h[4] + h[5], h[9]):
+                name, value, size, info = struct.unpack_from(
+                    "<IIIB", data, off)
+                if info & 0xf != STT_FUNC or value == 0:
+                    continue
+                pos = strtab[4] + name
+                end = data.index(b"\0", pos)
+                funcs.append((value & ~1, size,
+                              data[pos:end].decode("ascii", "replace")))
+        funcs.sort()
+        self.addrs = [f[0] for f in funcs]
+        self.funcs = funcs
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.addrs, pc) - 1
+        if i >= 0:
+            addr, size, name = self.funcs[i]
+            if pc < addr + max(size, 2):
+                return name
+        return "0x%08x" % pc
+
+
+def read(lines):
+    """Return the samples of the last complete dump."""
+    samples, last = [], []
+    for line in lines:
+        if not line.startswith("#P "):
+            continue
+        words = line.split()[1:]
+        if words == ["end"]:
+            last, samples = samples, []
+        elif len(words) == 3:
+            samples.append([int(w, 16) for w in words])
+    return last
+
+
+def main():
+    argv = sys.argv[1:]
+    folded = None
+    if len(argv) == 3 and argv[0] == "-f":
+        folded = argv[1]
+        argv = argv[2:]
+    if len(argv) != 1:
+        sys.stderr.write("usage: %s [-f folded.txt] file.elf < log\n" %
+                         sys.argv[0])
+        sys.exit(1)
+
+    elf = Elf(argv[0])
+    syms = Symbols(elf.data)
+    samples = read(sys.stdin)
+    if not samples:
+        sys.exit("no complete profile dump (\"#P end\") in the input")
+
+    flat = {}
+    stacks = {}
+    total = 0
+    for pc, thread, count in samples:
+        func = syms.lookup(pc)
+        tname = elf.string(thread) if thread else "interrupt"
+        flat[func] = flat.get(func, 0) + count
+        key = "%s;%s" % (tname.replace(" ", "_"), func)
+        stacks[key] = stacks.get(key, 0) + count
+        total += count
+
+    print("%8s %6s  %s" % ("samples", "pct", "function"))
+    for func, count in sorted(flat.items(), key=lambda i: -i[1]):
+        print("%8d %5.1f%%  %s" % (count, 100.0 * count / total, func))
+    print("%8d %5.1f%%  total" % (total, 100.0))
+
+    if folded is not None:
+        with open(folded, "w") as f:
+            for key, count in sorted(stacks.items()):
+                f.write("%s %d\n" % (key, count))
+
+
+if __name__ == "__main__":
+    main()
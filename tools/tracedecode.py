@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2020 Ruslan Bukin <br@bsdpad.com>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+"""
+Convert the event trace dumped by src/trace.c into a Chrome trace.
+
+Usage: tracedecode.py [-f hz] obj/md009.elf < console.txt > trace.json
+
+The "#T <cycles> <thread> <event> <arg>" lines of the last dump are
+read from the console log. The thread and the run and work names are
+addresses of strings that are read from the ELF image. The output is
+the Chrome trace JSON format, to be opened in https://ui.perfetto.dev
+or chrome://tracing: one track per thread, one for the interrupts and
+one for the thread that was running between the trace points.
+"""
+
+import json
+import sys
+
+from logdecode import Elf
+
+HZ = 64000000
+
+# src/trace.h
+RUN, WORK, INTR, SEND, RECV, POLL, HANDSHAKE, MQTT_TX, MQTT_RX, I2C = \
+    range(1, 11)
+BEGIN, END, EVENT = range(3)
+
+# mbedtls_ssl_states
+STATES = ["hello_request", "client_hello", "server_hello",
+          "server_certificate", "server_key_exchange",
+          "certificate_request", "server_hello_done", "client_certificate",
+          "client_key_exchange", "certificate_verify",
+          "client_change_cipher_spec", "client_finished",
+          "server_change_cipher_spec", "server_finished", "flush_buffers",
+          "handshake_wrapup", "handshake_over"]
+
+MQTT = {1: "CONNECT", 2: "CONNACK", 3: "PUBLISH", 4: "PUBACK",
+        5: "PUBREC", 6: "PUBREL", 7: "PUBCOMP", 8: "SUBSCRIBE",
+        9: "SUBACK", 10: "UNSUBSCRIBE", 11: "UNSUBACK", 12: "PINGREQ",
+        13: "PINGRESP", 14: "DISCONNECT"}
+
+TID_INTR = 1
+TID_CPU = 2
+
+
+def signed(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def name(elf, ev, arg):
+    if ev in (RUN, WORK):
+        return elf.string(arg)
+    if ev == INTR:
+        return "irq %d" % arg
+    if ev == HANDSHAKE:
+        return STATES[arg] if arg < len(STATES) else "state %d" % arg
+    if ev == MQTT_TX:
+        return "mqtt tx %s" % MQTT.get(arg >> 16, arg >> 16)
+    return {SEND: "nrf_send", RECV: "nrf_recv", POLL: "nrf_poll",
+            MQTT_RX: "mqtt rx", I2C: "mc6470 i2c"}.get(ev, "event %d" % ev)
+
+
+def args(ev, ph, arg):
+    if ev in (SEND, RECV):
+        return {"len": arg} if ph == BEGIN else {"ret": signed(arg)}
+    if ev == POLL:
+        return {"timeout": arg} if ph == BEGIN else {"ret": signed(arg)}
+    if ev == HANDSHAKE and ph == END:
+        return {"ret": signed(arg)}
+    if ev == MQTT_TX:
+        return {"len": arg & 0xffff}
+    if ev == MQTT_RX:
+        return {"len": arg & 0xffff, "first": "0x%02x" % (arg >> 16)}
+    return {}
+
+
+def read(lines):
+    """Return the records of the last complete dump."""
+    recs, last = [], []
+    for line in lines:
+        if not line.startswith("#T "):
+            continue
+        words = line.split()[1:]
+        if words == ["end"]:
+            last, recs = recs, []
+        elif len(words) == 4:
+            recs.append([int(w, 16) for w in words])
+    return last
+
+
+def convert(elf, recs, hz):
+    events = []
+    tids = {}
+    depth = {}
+    cycles = 0
+    prev = None
+    running = None
+
+    def tid(thread):
+        if thread == 0:
+            return TID_INTR
+        if thread not in tids:
+            tids[thread] = len(tids) + 3
+        return tids[thread]
+
+    for (cyc, thread, what, arg) in recs:
+        if prev is not None:
+            cycles += (cyc - prev) & 0xffffffff
+        prev = cyc
+        ts = cycles * 1e6 / hz
+        ev, ph = what >> 8, what & 0xff
+        t = tid(thread)
+
+        # The running thread, as seen from the trace points.
+        if thread != 0 and (running is None or running[0] != thread):
+            if running is not None:
+                events.append({"name": elf.string(running[0]), "ph": "X",
+                               "ts": running[1], "dur": ts - running[1],
+                               "pid": 0, "tid": TID_CPU})
+            running = (thread, ts)
+
+        e = {"ts": ts, "pid": 0, "tid": t, "args": args(ev, ph, arg)}
+        if ph == BEGIN:
+            e["ph"] = "B"
+            e["name"] = name(elf, ev, arg)
+            depth[t] = depth.get(t, 0) + 1
+        elif ph == END:
+            # The begin may have been overwritten in the ring.
+            if depth.get(t, 0) == 0:
+                continue
+            e["ph"] = "E"
+            depth[t] -= 1
+        else:
+            e["ph"] = "i"
+            e["s"] = "t"
+            e["name"] = name(elf, ev, arg)
+        events.append(e)
+
+    if running is not None:
+        events.append({"name": elf.string(running[0]), "ph": "X",
+                       "ts": running[1], "dur": ts - running[1],
+                       "pid": 0, "tid": TID_CPU})
+
+    meta = [{"name": "process_name", "ph": "M", "pid": 0,
+             "args": {"name": "md009"}},
+            {"name": "thread_name", "ph": "M", "pid": 0, "tid": TID_INTR,
+             "args": {"name": "interrupts"}},
+            {"name": "thread_name", "ph": "M", "pid": 0, "tid": TID_CPU,
+             "args": {"name": "running"}}]
+    for thread, t in tids.items():
+        meta.append({"name": "thread_name", "ph": "M", "pid": 0, "tid": t,
+                     "args": {"name": elf.string(thread)}})
+
+    return {"traceEvents": meta + events, "displayTimeUnit": "ns"}
+
+
+def main():
+    argv = sys.argv[1:]
+    hz = HZ
+    if len(argv) == 3 and argv[0] == "-f":
+        hz = int(argv[1])
+        argv = argv[2:]
+    if len(argv) != 1:
+        sys.stderr.write("usage: %s [-f hz] file.elf < log\n" % sys.argv[0])
+        sys.exit(1)
+
+    elf = Elf(argv[0])
+    recs = read(sys.stdin)
+    if not recs:
+        sys.exit("no complete trace dump (\"#T end\") in the input")
+
+    json.dump(convert(elf, recs, hz), sys.stdout, indent=0)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()